@@ -0,0 +1,39 @@
+# Builds and runs the benchmark once for every set of compiler flags,
+# which can be preceded by environment variables like PS_THREADS=2
+string(REPLACE "|" ";" VARIANTS "${VARIANTS}")
+foreach(VARIANT ${VARIANTS})
+    separate_arguments(ARGS UNIX_COMMAND "${VARIANT}")
+    set(FLAGS)
+    set(ENVIRONMENT)
+    foreach(ARG ${ARGS})
+        if (ARG MATCHES "^[A-Z_]+=")
+            list(APPEND ENVIRONMENT ${ARG})
+        else()
+            list(APPEND FLAGS ${ARG})
+        endif()
+    endforeach()
+    execute_process(COMMAND ${COMPILER_BIN} ${BENCHMARKS_DIR}/${BENCHMARK}
+        ${FLAGS} -o ${BENCHMARK}.ll RESULT_VARIABLE COMPILER_RESULT)
+    if (COMPILER_RESULT)
+        message(FATAL_ERROR "compiler error!")
+    endif()
+
+    execute_process(COMMAND llc -O2 -mcpu=native ${BENCHMARK}.ll
+        -o ${BENCHMARK}.s RESULT_VARIABLE LLC_RESULT)
+    if (LLC_RESULT)
+        message(FATAL_ERROR "llc error!")
+    endif()
+
+    execute_process(COMMAND ${COMPILER} ${BENCHMARKS_DIR}/timer.c
+        ${BENCHMARK}.s ${RUNTIME} -o ${BENCHMARK}.exe -no-pie
+        -lstdc++ -lpthread -lm
+        RESULT_VARIABLE COMPILATION_RESULT)
+    if (COMPILATION_RESULT)
+        message(FATAL_ERROR "compilation error!")
+    endif()
+
+    execute_process(COMMAND ${CMAKE_COMMAND} -E env ${ENVIRONMENT}
+        ./${BENCHMARK}.exe OUTPUT_VARIABLE OUTPUT)
+    string(STRIP "${OUTPUT}" OUTPUT)
+    message("${BENCHMARK} [${VARIANT}]: ${OUTPUT}")
+endforeach()
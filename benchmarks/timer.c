@@ -0,0 +1,12 @@
+#include "stdio.h"
+#include "time.h"
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+long report(double start, double checksum) {
+    return printf("%8.3f s  (checksum %g)\n", now() - start, checksum);
+}
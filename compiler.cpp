@@ -1,14 +1,38 @@
 #include "parser.h"
+#include "passes.h"
 
 int main(int argc, char **argv) {
   char *inputFile = nullptr, *outputFile = nullptr;
+  Optimizer optimizer;
   for (int i = 1; i < argc; ++i) {
     if (!strcmp("-h", argv[i]) || !strcmp("--help", argv[i])) {
       std::cout << "Usage:\n"
                 << argv[0]
-                << " [INPUT_FILE] [(--output | -o) OUTPUT_FILE]\n"
+                << " [INPUT_FILE] [(--output | -o) OUTPUT_FILE] [OPTIONS]\n"
                    "Give no input file to read from standard input.\n"
-                   "Give no output file to write to standard output.\n";
+                   "Give no output file to write to standard output.\n"
+                   "Options:\n"
+                   "  -O0, -O1, -O2, -O3    optimization level, 0 by default\n"
+                   "  -ffast-math           allow all floating-point "
+                   "optimizations\n"
+                   "  -ffp-contract=fast    allow fusing floating-point "
+                   "operations\n"
+                   "  -fno-signed-zeros     ignore the sign of floating-point "
+                   "zeros\n"
+                   "  -fno-complex-algebra  do not simplify complex "
+                   "arithmetic\n"
+                   "  -fno-bounds-checks    do not check indices of array "
+                   "elements\n"
+                   "  --profile-generate[=FILE]\n"
+                   "                        count branches and calls into "
+                   "FILE, ps.profile\n"
+                   "                        by default, when the program "
+                   "exits\n"
+                   "  --profile-use=FILE    optimize with the counts of the "
+                   "profile FILE\n"
+                   "  --instrument          print a profile of functions and "
+                   "while loops\n"
+                   "                        when the program exits\n";
       return 0;
     }
     if (!strcmp("-o", argv[i]) || !strcmp("--output", argv[i])) {
@@ -22,6 +46,27 @@ int main(int argc, char **argv) {
         return 1;
       }
       outputFile = argv[i];
+    } else if (!strcmp("-O0", argv[i]) || !strcmp("-O1", argv[i]) ||
+               !strcmp("-O2", argv[i]) || !strcmp("-O3", argv[i])) {
+      optimizer.level = argv[i][2] - '0';
+    } else if (!strcmp("-fno-complex-algebra", argv[i])) {
+      optimizer.complexAlgebra = false;
+    } else if (!strcmp("--profile-generate", argv[i])) {
+      optimizer.profileGenerate = "ps.profile";
+    } else if (!strncmp("--profile-generate=", argv[i], 19)) {
+      optimizer.profileGenerate = argv[i] + 19;
+    } else if (!strncmp("--profile-use=", argv[i], 14)) {
+      optimizer.profileUse = argv[i] + 14;
+    } else if (!strcmp("--instrument", argv[i])) {
+      Profiler::enabled = true;
+    } else if (!strcmp("-fno-bounds-checks", argv[i])) {
+      Index::checked = false;
+    } else if (!strcmp("-ffast-math", argv[i])) {
+      Node::fastMath.setFast();
+    } else if (!strcmp("-ffp-contract=fast", argv[i])) {
+      Node::fastMath.setAllowContract();
+    } else if (!strcmp("-fno-signed-zeros", argv[i])) {
+      Node::fastMath.setNoSignedZeros();
     } else {
       if (inputFile) {
         std::cerr << "More than one input file\n";
@@ -41,6 +86,12 @@ int main(int argc, char **argv) {
     std::cerr << err.what() << "\nCompilation failed!\n";
     return 1;
   }
+  try {
+    optimizer.run(*Node::module);
+  } catch (ProfileError &err) {
+    std::cerr << err.what() << "\nCompilation failed!\n";
+    return 1;
+  }
 
   std::error_code EC;
   llvm::raw_fd_ostream out(outputFile, EC);
@@ -0,0 +1,83 @@
+#ifndef INTERPRETER_H
+#define INTERPRETER_H
+
+#include "parse_tree.h"
+
+struct EvaluationError : std::runtime_error {
+public:
+  EvaluationError(const std::string &err);
+};
+
+/**
+ * Evaluates calls to ps-lang functions at compile time.
+ * Only local variables and parameters can be written, only them and constants
+ * can be read and only functions defined in the program can be called, so
+ * any evaluation touching a global variable, an extern function or a string
+ * is abandoned by throwing EvaluationError and the call is generated as
+ * usual.
+ * Every evaluated node consumes fuel, which together with the call depth
+ * limit guarantees that compilation terminates. Each evaluation gets at most
+ * FUEL of it, taken from a budget shared by the whole compilation, so that
+ * many call sites which cannot be evaluated do not slow it down.
+ * Results of successful calls are cached, as the functions are pure, and so
+ * are calls which failed, unless they could read globals.
+ * Initializers of global variables are evaluated the same way, except that
+ * they may also read initial values of other globals.
+ **/
+class Interpreter {
+  using Scope = std::unordered_map<std::string, std::pair<TypeID, const_value>>;
+  std::vector<std::vector<Scope>> frames;
+  std::unordered_map<std::string, const_value> cache;
+  std::unordered_set<std::string> failed;
+  size_t fuel, budget;
+
+  // Initial values of statically initialized globals
+  std::unordered_map<llvm::Value *, const_value> globals;
+  bool readGlobals;
+  size_t globalReads;
+
+  static std::string key(const std::string &name,
+                         const std::vector<const_value> &args);
+  std::pair<TypeID, const_value> &lookup(const std::string &name);
+
+public:
+  static const size_t FUEL, BUDGET, MAX_DEPTH;
+
+  // Global without a known initial value whose read ended the last
+  // evaluation, null if there was none
+  llvm::Value *missing;
+  // Value of the last executed return statement
+  const_value returnValue;
+  // RETURN, BREAK or CONTINUE, whichever ended the last executed block
+  Tag jump;
+
+  Interpreter();
+
+  // Returns the value of the expression or nullptr if it cannot be evaluated
+  llvm::Constant *fold(Expression &expr);
+
+  /**
+   * Returns the initial value of a global or nullptr if it has to be
+   * initialized at runtime. Initial values of other globals can be used only
+   * if readGlobals is set.
+   **/
+  llvm::Constant *initialize(llvm::GlobalVariable *global, Expression &init,
+                             TypeID type, bool readGlobals_);
+
+  // Consumes fuel for a single evaluation step
+  void step();
+
+  void push();
+  void pop();
+  void define(const std::string &name, TypeID type, const_value value);
+  void assign(const std::string &name, const_value value);
+  const_value get(const std::string &name);
+  const_value call(const std::string &name, std::vector<const_value> &args);
+
+  static TypeID typeOf(const const_value &value);
+  static TypeID maxType(TypeID a, TypeID b);
+  static const_value expand(const const_value &value, TypeID to);
+  static llvm::Constant *constant(const const_value &value);
+};
+
+#endif // INTERPRETER_H
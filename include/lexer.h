@@ -72,6 +72,9 @@ class Lexer {
   // Handle tokens starting with a letter or underscore
   Token alpha();
 
+  // Handle tokens starting with "@"
+  Token annotation();
+
 public:
   int line;
   Lexer(std::istream &stream_ = std::cin);
@@ -1,6 +1,7 @@
 #ifndef PARSE_TREE_H
 #define PARSE_TREE_H
 
+#include "ssa.h"
 #include "symbols.h"
 #include "llvm/ADT/APFloat.h"
 #include "llvm/ADT/STLExtras.h"
@@ -14,31 +15,58 @@
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
+#include <complex>
+#include <functional>
+#include <map>
 
 struct Expression;
 struct Statement;
 struct Identifier;
+struct FunctionDefinition;
+struct GenericFunction;
+struct StructDefinition;
 class SymbolTable;
+class Interpreter;
 
 using expr_ptr = std::unique_ptr<Expression>;
 using stmt_ptr = std::unique_ptr<Statement>;
 using id_ptr = std::unique_ptr<Identifier>;
-using global_tuple = std::tuple<llvm::GlobalVariable *, expr_ptr, TypeID>;
+// Global, its initializer, type and whether it was defined as constant
+using global_tuple =
+    std::tuple<llvm::GlobalVariable *, expr_ptr, TypeID, bool>;
+using const_value = std::variant<int64_t, double, std::complex<double>>;
 
 struct CodeGenError : std::runtime_error {
 public:
   CodeGenError(const std::string &err);
 };
 
+// Annotation preceding a definition, for example @unroll(4)
+struct Annotation {
+  Token token;
+  std::vector<int64_t> arguments;
+};
+
 struct Node {
   static llvm::LLVMContext context;
   static llvm::IRBuilder<> builder;
   static std::unique_ptr<llvm::Module> module;
   static SymbolTable symbols;
-  static llvm::StructType *complexStruct;
-  static llvm::Type *intType, *doubleType, *boolType, *stringType;
-  static llvm::Constant *TRUE, *FALSE, *MINUS_ONE_INT, *MINUS_ONE_DOUBLE,
-      *INT_ZERO, *DOUBLE_ZERO, *COMPLEX_ZERO, *STRING_ZERO;
+  static Interpreter interpreter;
+  static SSABuilder ssa;
+  // Fast-math flags of functions without the @fastmath annotation
+  static llvm::FastMathFlags fastMath;
+  static llvm::StructType *complexStruct, *complex32Struct;
+  static llvm::Type *intType, *int32Type, *doubleType, *floatType, *boolType,
+      *stringType;
+  /**
+   * Numeric types are integers, reals and complex numbers, in the order in
+   * which they are promoted. Each kind has a 64-bit type and a narrow one,
+   * of 32 bits or a pair of 32-bit floats. Vectors are of the real kind,
+   * a scalar operand is converted to the vector and broadcast to its lanes.
+   **/
+  enum Kind { INTEGER, REAL, COMPLEX };
+  static llvm::Constant *TRUE, *FALSE, *INT_ZERO, *DOUBLE_ZERO;
 
   Token token;
 
@@ -51,29 +79,145 @@ struct Node {
   Identifier *getSymbol(const std::string &name);
   llvm::Type *getType(TypeID type);
   llvm::Type *getMaxType(llvm::Type *a, llvm::Type *b);
+  // Common type of generated operands, in which literals do not count as
+  // wide if they fit the narrow type of the other operands
+  llvm::Type *getMaxType(
+      const std::vector<std::pair<Expression *, llvm::Value *>> &operands);
   llvm::Value *expand(llvm::Value *val, llvm::Type *to);
 
+  static Kind kind(llvm::Type *type);
+  static bool isNarrow(llvm::Type *type);
+  static llvm::Type *numeric(Kind kind, bool narrow);
+  // Declares a function of the runtime library, or of the C library
+  static llvm::Function *
+  runtime(const char *name, llvm::Type *result,
+          std::vector<llvm::Type *> params,
+          std::initializer_list<llvm::Attribute::AttrKind> attributes = {});
+
   static void initGlobals();
 };
 
 struct Expression : Node {
   Expression(Token token);
+
+  // Numeric literal, possibly negated or imaginary
+  virtual bool literal() const;
+  virtual const_value evaluate(Interpreter &interpreter);
 };
 
 struct Identifier : Expression {
   TypeID type;
+  // Local variables are not allocated - alloc is null or, for constants,
+  // their value. Values of other variables are kept by the SSA builder.
   llvm::Value *alloc;
-  Identifier(Token id, TypeID type_, llvm::Value *alloc_ = nullptr);
+  // Constant, or a @readonly view whose elements cannot be assigned to
+  bool constant;
+  // Local variable of the function enclosing a parallel loop
+  bool captured;
+  size_t variable;
+  // Number of elements of an array, null for other variables. The alloc of
+  // an array points to its first element.
+  llvm::Value *length;
+  /**
+   * Parameter which is a view of an array, passed as a pointer to the first
+   * element and the length. No other pointer accesses elements of a @noalias
+   * view while the function runs.
+   **/
+  bool view, noalias;
+  /**
+   * Struct of the elements of an array of structs, null for other variables.
+   * Arrays with the SoA layout have no alloc, columns point to the first
+   * element of the array of each field instead.
+   **/
+  StructDefinition *record;
+  std::vector<llvm::Value *> columns;
+  Identifier(Token id, TypeID type_, llvm::Value *alloc_ = nullptr,
+             bool constant_ = false);
 
   virtual llvm::Value *generate() override;
+  virtual const_value evaluate(Interpreter &interpreter) override;
 };
 
 struct FunctionCall : Expression {
   std::vector<expr_ptr> arguments;
+  // Instance of the generic function called, set when the call is generated
+  FunctionDefinition *instance;
   FunctionCall(Token name, std::vector<expr_ptr> &args);
 
+  /**
+   * Generates arguments of the parameters, an array or a view given to a
+   * view parameter becomes the pointer and the length. Non-null values are
+   * arguments which were already generated.
+   **/
+  std::vector<llvm::Value *>
+  generateArguments(const std::vector<id_ptr> &parameters,
+                    const std::vector<llvm::Value *> &values = {});
+  // Generates the arguments into values and returns the instance of the
+  // generic function for their types
+  FunctionDefinition *instantiate(GenericFunction &generic,
+                                  std::vector<llvm::Value *> &values);
+
   llvm::Value *Re(llvm::Value *val);
   llvm::Value *Im(llvm::Value *val);
+  llvm::Value *conj(llvm::Value *val);
+
+  virtual llvm::Value *generate() override;
+  virtual const_value evaluate(Interpreter &interpreter) override;
+};
+
+/**
+ * Call of a function from the built-in math library. Real functions are
+ * lowered to LLVM intrinsics where one exists, complex overloads are
+ * generated inline.
+ **/
+struct BuiltinCall : FunctionCall {
+  BuiltinCall(Token name, std::vector<expr_ptr> &args);
+
+  static bool isBuiltin(const std::string &name);
+  static size_t arity(const std::string &name);
+
+  llvm::Value *intrinsic(llvm::Intrinsic::ID id,
+                         std::vector<llvm::Value *> args);
+  llvm::Value *arg(llvm::Value *re, llvm::Value *im);
+  // hsum, hmin and hmax of the lanes of a vector
+  llvm::Value *horizontal(const std::string &name, llvm::Value *vector);
+  // shuffle(a, lanes...) or shuffle(a, b, lanes...), lanes of b follow a's
+  llvm::Value *shuffle();
+
+  virtual llvm::Value *generate() override;
+  virtual const_value evaluate(Interpreter &interpreter) override;
+};
+
+/**
+ * Element of an array, a[i], or a field of an element of an array of
+ * structs, p[i].x. The index is checked against the length of the array
+ * unless it is provably in bounds, because it is a constant or the counter
+ * of an enclosing for loop whose range fits the array.
+ **/
+struct Index : Expression {
+  expr_ptr index;
+  // Name of the field, empty for arrays of numbers
+  std::string field;
+  // Whether indices are checked at runtime, unless -fno-bounds-checks
+  static bool checked;
+  Index(Token name, expr_ptr index_, std::string field_ = "");
+
+  // Generates the index, checked against the length unless it is in bounds
+  llvm::Value *position(llvm::Value *length, const std::string &of);
+  // Type of the element or of its field
+  TypeID type(Identifier *array);
+  // Returns the address of the element or of its field
+  llvm::Value *address();
+
+  // Arrays are read through the address, lanes of vectors are extracted
+  virtual llvm::Value *generate() override;
+};
+
+// vec4d(x) broadcasts x to all lanes, vec4d(a, b, c, d) sets each of them
+struct Vector : Expression {
+  TypeID type;
+  std::vector<expr_ptr> lanes;
+  Vector(Token token, std::vector<expr_ptr> &lanes_);
 
   virtual llvm::Value *generate() override;
 };
@@ -83,15 +227,16 @@ struct AbsoluteValue : Expression {
   AbsoluteValue(Token token, expr_ptr val);
 
   virtual llvm::Value *generate() override;
+  virtual const_value evaluate(Interpreter &interpreter) override;
 };
 
 struct Complex : Expression {
   expr_ptr imaginary;
   Complex(expr_ptr imaginary_, Token token);
 
+  virtual bool literal() const override;
   virtual llvm::Value *generate() override;
-  static llvm::GetElementPtrInst *re(llvm::Value *complex);
-  static llvm::GetElementPtrInst *im(llvm::Value *complex);
+  virtual const_value evaluate(Interpreter &interpreter) override;
   static llvm::Value *get(llvm::Value *real_, llvm::Value *im_);
   static std::pair<llvm::Value *, llvm::Value *>
   mul(llvm::Value *re1, llvm::Value *im1, llvm::Value *re2, llvm::Value *im2);
@@ -111,21 +256,39 @@ struct BinaryOperation : Operation {
                                llvm::Value *re2, llvm::Value *im2);
   llvm::Value *divideComplex(llvm::Value *re1, llvm::Value *im1,
                              llvm::Value *re2, llvm::Value *im2);
+  llvm::Value *multiply(llvm::Value *L, llvm::Value *R);
+  llvm::Value *reciprocal(llvm::Value *val);
+  llvm::Value *power(llvm::Value *base, llvm::Value *exponent);
+  llvm::Function *powerFunction(llvm::Type *type);
+  const_value power(const const_value &base, const const_value &exponent);
+  bool constantExponent(int64_t &exponent);
+  /**
+   * Shortest chain of multiplications computing x^n, each pair gives indices
+   * of the earlier powers multiplied in the next step, x itself is at 0.
+   **/
+  static std::vector<std::pair<size_t, size_t>> chain(uint64_t n);
+  // Arithmetic on literals, like 0.5 - 0.25i, is a literal too
+  virtual bool literal() const override;
   virtual llvm::Value *generate() override;
+  virtual const_value evaluate(Interpreter &interpreter) override;
 };
 
 struct UnaryOperation : Operation {
   expr_ptr expression;
   UnaryOperation(Token operator_, expr_ptr expression_);
 
+  virtual bool literal() const override;
   virtual llvm::Value *generate() override;
+  virtual const_value evaluate(Interpreter &interpreter) override;
 };
 
 struct Constant : Expression {
   TypeID type;
   Constant(Token token, TypeID type_);
 
+  virtual bool literal() const override;
   virtual llvm::Value *generate() override;
+  virtual const_value evaluate(Interpreter &interpreter) override;
 };
 
 struct LogicalOperation : Expression {
@@ -137,12 +300,14 @@ struct Disjunction : LogicalOperation {
   Disjunction(expr_ptr lhs_, Token operator_, expr_ptr rhs_);
 
   virtual llvm::Value *generate() override;
+  virtual const_value evaluate(Interpreter &interpreter) override;
 };
 
 struct Conjunction : LogicalOperation {
   Conjunction(expr_ptr lhs_, Token operator_, expr_ptr rhs_);
 
   virtual llvm::Value *generate() override;
+  virtual const_value evaluate(Interpreter &interpreter) override;
 };
 
 struct Negation : Expression {
@@ -150,40 +315,165 @@ struct Negation : Expression {
   Negation(Token operator_, expr_ptr expression_);
 
   virtual llvm::Value *generate() override;
+  virtual const_value evaluate(Interpreter &interpreter) override;
 };
 
 struct Relation : LogicalOperation {
   Relation(expr_ptr lhs_, Token operator_, expr_ptr rhs_);
 
   virtual llvm::Value *generate() override;
+  virtual const_value evaluate(Interpreter &interpreter) override;
 };
 
+// Outcome of a condition wrapped in likely() or unlikely()
+enum class Expectation { NONE, LIKELY, UNLIKELY };
+
 struct Statement : Node {
   Statement(Token token);
+
+  // Checks that the variable can be assigned to, then assigns it
+  Identifier *assignable(const std::string &name);
+  void assign(Identifier *variable, llvm::Value *value);
+  // Branches on the condition, with branch weights of the expected outcome
+  llvm::BranchInst *branch(llvm::Value *cond, llvm::BasicBlock *then,
+                           llvm::BasicBlock *otherwise,
+                           Expectation expected);
+
+  // Returns true if a return, break or continue statement was executed
+  virtual bool execute(Interpreter &interpreter);
 };
 
 struct IfStatement : Statement {
   expr_ptr condition;
   stmt_ptr ifBlock, elseBlock;
+  Expectation expected;
   IfStatement(Token token, expr_ptr condition_, stmt_ptr ifBlock_,
               stmt_ptr elseBlock_);
 
   llvm::Value *generate() override;
+  bool execute(Interpreter &interpreter) override;
 };
 
-struct WhileStatement : Statement {
-  expr_ptr condition;
+/**
+ * match (x) { 1 => ... 2, 3 => ... 4 to 9 => ... _ => ... } runs the arm
+ * with a pattern equal to the integer x, or the _ arm if there is none.
+ * Patterns are constants which cannot overlap, so the arms are cases of a
+ * switch, which LLVM lowers to a jump table or a binary search.
+ **/
+struct MatchStatement : Statement {
+  // Patterns are values, with a null last value, or ranges of values
+  struct Arm {
+    std::vector<std::pair<expr_ptr, expr_ptr>> patterns;
+    stmt_ptr block;
+  };
+  // Ranges longer than this are compared with the value before the _ arm,
+  // instead of adding a case for each of their values
+  static const int64_t MAX_RANGE_CASES;
+
+  expr_ptr value;
+  std::vector<Arm> arms;
+  // The _ arm, null if there is none
+  stmt_ptr otherwise;
+  MatchStatement(Token token, expr_ptr value_, std::vector<Arm> &arms_,
+                 stmt_ptr otherwise_);
+
+  llvm::Value *generate() override;
+  bool execute(Interpreter &interpreter) override;
+};
+
+struct Loop : Statement {
   stmt_ptr block;
+  // @unroll(count) and @vectorize(width) hints for the optimizer
+  std::vector<Annotation> annotations;
+  // Targets of continue and break in the loop being generated
+  llvm::BasicBlock *latch, *exit;
+  // Iterations run on the thread pool of the runtime library
+  bool parallel;
+  // Loops enclosing the statement being generated, innermost last
+  static std::vector<Loop *> active;
+  Loop(Token token, stmt_ptr block_);
+
+  // Whether the statement being generated runs on multiple threads
+  static bool inParallel();
+
+  // Returns llvm.loop metadata of the annotations, null if there are none
+  llvm::MDNode *metadata();
+  // Generates the body, after which the latch is complete
+  llvm::Value *body();
+};
+
+struct WhileStatement : Loop {
+  expr_ptr condition;
+  Expectation expected;
+  // Profiler site, start cycle and slot counting iterations of the loop
+  // being generated, null if it is not instrumented
+  llvm::Constant *site;
+  llvm::Value *start;
+  llvm::AllocaInst *iterations;
   WhileStatement(Token token, expr_ptr condition_, stmt_ptr block_);
 
+  // Adds the run of the loop to its site, when it is left
+  void leave();
+
+  llvm::Value *generate() override;
+  bool execute(Interpreter &interpreter) override;
+};
+
+/**
+ * Counted loop over integers from start to end inclusive. The bounds are
+ * evaluated once before the loop and the counter cannot be assigned to, so
+ * the loop has a canonical induction variable.
+ **/
+struct ForStatement : Loop {
+  id_ptr counter;
+  expr_ptr start, end;
+  int64_t step;
+  // Bounds and counter of the loop being generated, which bound the values
+  // of indices based on the counter
+  llvm::Value *from, *to, *induction;
+  // Operator and variable of each reduction of a parallel loop
+  std::vector<std::pair<Token, id_ptr>> reductions;
+  ForStatement(Token token, id_ptr counter_, expr_ptr start_, expr_ptr end_,
+               int64_t step_, stmt_ptr block_);
+
+  /**
+   * Moves the body of a parallel loop to a new function, which runs a range
+   * of iterations. Local variables are passed to it by value and cannot be
+   * assigned to, except for reduction variables. Each range starts with
+   * private copies of those and combines them with the shared values at
+   * the end.
+   **/
+  llvm::Value *outline(llvm::Value *first, llvm::Value *last);
+  // Number of increments of the counter from first to last, if it runs
+  llvm::Value *tripCount(llvm::Value *first, llvm::Value *last);
+  llvm::Value *generate() override;
+  bool execute(Interpreter &interpreter) override;
+};
+
+// break or continue of the innermost loop
+struct JumpStatement : Statement {
+  JumpStatement(Token token);
+
   llvm::Value *generate() override;
+  bool execute(Interpreter &interpreter) override;
 };
 
+/**
+ * A returned call which nothing follows is a tail call, and a call of the
+ * function itself jumps back to its beginning instead. With the tailcall
+ * keyword in place of return, a call which cannot be made a tail call is
+ * an error.
+ **/
 struct ReturnStatement : Statement {
   expr_ptr return_;
   ReturnStatement(Token token, expr_ptr return__);
 
+  // Whether the call can be moved after everything the return generates
+  // and replace the frame of the function
+  bool tailPosition(llvm::CallInst *call);
+
   llvm::Value *generate() override;
+  bool execute(Interpreter &interpreter) override;
 };
 
 struct Assignment : Statement {
@@ -192,27 +482,201 @@ struct Assignment : Statement {
   Assignment(id_ptr identifier_, expr_ptr expression_);
 
   virtual llvm::Value *generate() override;
+  virtual bool execute(Interpreter &interpreter) override;
 };
 
 struct VariableDefinition : Assignment {
   VariableDefinition(id_ptr identifier_, expr_ptr expression_);
 
   virtual llvm::Value *generate() override;
+  virtual bool execute(Interpreter &interpreter) override;
+};
+
+/**
+ * Array of a constant or runtime length with every element set to the
+ * initial value. Global arrays are allocated statically and local arrays of
+ * constant length up to 64 KiB on the stack. Others are allocated on the heap
+ * and freed when the function returns, or when the definition is executed
+ * again.
+ **/
+struct ArrayDefinition : Statement {
+  id_ptr identifier;
+  expr_ptr length, expression;
+  // Struct of the elements, empty for arrays of numbers. The initial value
+  // is converted to each field.
+  std::string record;
+  // Pointers to heap arrays of the function being generated
+  static std::vector<llvm::AllocaInst *> heap;
+  ArrayDefinition(id_ptr identifier_, expr_ptr length_, expr_ptr expression_);
+
+  // Frees heap arrays of the function, before it returns
+  static void release();
+  // Stores the value in elements of the array from 0 to count - 1
+  void fill(llvm::Value *array, llvm::Value *count, llvm::Value *value);
+  /**
+   * Allocates count elements of the type set to init, which is a constant
+   * outside of functions, and returns the pointer to the first one.
+   **/
+  llvm::Value *storage(llvm::Type *type, llvm::Value *count,
+                       llvm::Value *init, const std::string &name);
+
+  virtual llvm::Value *generate() override;
+};
+
+/**
+ * struct Particle { x : double, v : double } defines the elements of arrays
+ * of structs. By default the fields of each element are next to each other
+ * (AoS). With @soa each field is kept in its own array (SoA), so loops
+ * reading one field do not load the others.
+ **/
+struct StructDefinition : Statement {
+  std::vector<id_ptr> fields;
+  bool soa;
+  // Type of elements of arrays with the AoS layout
+  llvm::StructType *type;
+  StructDefinition(Token name, std::vector<id_ptr> &fields_, bool soa_);
+
+  // Index of the field, or the number of fields if there is no such field
+  size_t field(const std::string &name) const;
+
+  virtual llvm::Value *generate() override;
+};
+
+// a[i] = expression; or p[i].x = expression;
+struct ElementAssignment : Statement {
+  std::unique_ptr<Index> element;
+  expr_ptr expression;
+  ElementAssignment(std::unique_ptr<Index> element_, expr_ptr expression_);
+
+  virtual llvm::Value *generate() override;
+};
+
+/**
+ * x = spawn f(...); runs the call as a task which idle threads can steal.
+ * The variable, defined by the statement if it has a type, is assigned the
+ * result at the next sync in the same block or at the end of the block and
+ * cannot be used before. return, break and continue wait for all tasks.
+ **/
+struct SpawnStatement : Statement {
+  id_ptr identifier;
+  std::unique_ptr<FunctionCall> call;
+  bool definition;
+
+  // A spawned call whose result is not yet assigned
+  struct Pending {
+    Identifier *symbol;
+    llvm::AllocaInst *result;
+  };
+  static std::vector<Pending> pending;
+  // Index in pending of the first spawn of the innermost block
+  static size_t scope;
+  // ps_frame of the function, allocated with its first spawn
+  static llvm::Value *frame;
+
+  SpawnStatement(id_ptr identifier_, std::unique_ptr<FunctionCall> call_,
+                 bool definition_);
+
+  static bool isPending(const Identifier *symbol);
+  // Waits for all tasks and assigns results of spawns from pending[first]
+  static void sync(size_t first);
+  // Function called by tasks, stores the result of the callee at a pointer
+  llvm::Function *task(llvm::Function *callee);
+
+  virtual llvm::Value *generate() override;
+  virtual bool execute(Interpreter &interpreter) override;
+};
+
+struct SyncStatement : Statement {
+  SyncStatement(Token token);
+
+  virtual llvm::Value *generate() override;
+  virtual bool execute(Interpreter &interpreter) override;
 };
 
 struct FunctionDeclaration : Statement {
   std::vector<id_ptr> parameters;
   TypeID returnType;
+  // Only main() and exported functions are visible outside of the module
+  bool exported;
+  std::vector<Annotation> annotations;
+  /**
+   * Complex parameters of external functions follow the x86-64 System V
+   * calling convention of double _Complex. Each is passed as two doubles if
+   * two SSE registers are still free, otherwise it is copied to the stack.
+   * Complex values are returned in two registers, as the aggregate is.
+   * A complex32 is a float _Complex, passed and returned packed in one
+   * register as a vector of two floats.
+   **/
+  std::vector<bool> inMemory;
+  static const unsigned SSE_REGISTERS;
+  static llvm::Type *complex32Vector();
   FunctionDeclaration(Token id_, TypeID returnType_,
-                      std::vector<id_ptr> &params);
+                      std::vector<id_ptr> &params, bool exported_ = false);
+
+  bool annotated(const std::string &name) const;
+  // Creates the function, with C calling convention if it is external
+  llvm::Function *declare(bool external);
+  // Checks the annotations and adds the attributes they stand for, such as
+  // hot or alwaysinline
+  void annotate(llvm::Function *func);
+  // Calls the external function with arguments of its parameters' types
+  llvm::Value *call(const std::vector<llvm::Value *> &args);
+  // Once the module is complete, redeclares a prototype which was not
+  // defined as an external function and lowers the calls of it
+  void lower();
 
   virtual llvm::Value *generate() override;
 };
 
 struct FunctionDefinition : FunctionDeclaration {
   stmt_ptr block;
+  // Set if the function returns a call of itself, which jumps to the header
+  // of the body with new values of the parameters
+  bool tailRecursive;
+  llvm::BasicBlock *header;
   FunctionDefinition(Token id_, TypeID returnType, stmt_ptr block_,
-                     std::vector<id_ptr> &params);
+                     std::vector<id_ptr> &params, bool exported_ = false);
+
+  /**
+   * A function annotated with @memo, or @memo(n) to keep only the n most
+   * recently used results, is called through a wrapper which looks its
+   * arguments up in a cache of the runtime library. The generated body is
+   * renamed to name.uncached and called on a miss.
+   **/
+  llvm::Function *memoize(llvm::Function *func);
+  // Rejects a memo function which reads or writes memory other than its
+  // own, once all functions it may call are generated
+  void checkPurity();
+
+  virtual llvm::Value *generate() override;
+};
+
+/**
+ * fun axpy<T> :T (a :T, x :T, y :T) {...} is generic over the type
+ * parameters in angle brackets. At each call a type parameter becomes the
+ * common type of the arguments of its parameters, or the element type of
+ * arrays passed to its views. The function is parsed again for every list
+ * of types with the type parameters replaced and generated as an ordinary
+ * function, named axpy<double>, the first time it is called with them.
+ **/
+struct GenericFunction : Statement {
+  std::vector<std::string> typeParameters;
+  // Type parameter in the type of each parameter, empty for other types
+  std::vector<std::string> bindings;
+  std::vector<Annotation> annotations;
+  // Parses the instance for the types, set by the parser
+  std::function<std::unique_ptr<FunctionDefinition>(
+      const std::vector<TypeID> &)>
+      parse;
+  // Instance for int, which is checked when the function is defined
+  std::unique_ptr<FunctionDefinition> definition;
+  std::map<std::vector<TypeID>, std::unique_ptr<FunctionDefinition>>
+      instances;
+  GenericFunction(Token name, std::vector<std::string> &typeParameters_);
+
+  // Returns the instance for the types, generating it between statements
+  // of the function being generated
+  FunctionDefinition *instantiate(const std::vector<TypeID> &types);
 
   virtual llvm::Value *generate() override;
 };
@@ -222,12 +686,21 @@ struct Sequence : Statement {
   Sequence(Token token, std::vector<stmt_ptr> &statements_);
 
   virtual llvm::Value *generate() override;
+  virtual bool execute(Interpreter &interpreter) override;
 };
 
 class SymbolTable {
   using Table = std::unordered_map<std::string, id_ptr>;
   std::vector<Table> tables;
-  static std::vector<global_tuple> globals_;
+  std::unordered_map<std::string, FunctionDefinition *> functions;
+  std::unordered_map<std::string, FunctionDeclaration *> externals;
+  std::vector<FunctionDeclaration *> prototypes_;
+  std::unordered_map<std::string, StructDefinition *> structs;
+  std::unordered_map<std::string, GenericFunction *> generics;
+  std::vector<FunctionDefinition *> memos_;
+  std::vector<global_tuple> globals_;
+  // Local scopes of functions whose generation is suspended, innermost last
+  std::vector<std::vector<Table>> suspended;
 
 public:
   std::unique_ptr<SymbolTable> prev;
@@ -235,15 +708,67 @@ public:
 
   void add(const std::string &token, id_ptr id);
   Identifier *get(const std::string &token) const;
+  // Visible local variables and constants, by name
+  std::vector<std::pair<std::string, Identifier *>> locals() const;
   void push();
   void pop();
+  // Hides local variables while another function is generated, and shows
+  // them again afterwards
+  void suspend();
+  void resume();
+
+  Identifier *getGlobal(const std::string &token) const;
+
+  void addGlobal(llvm::GlobalVariable *global, expr_ptr init, TypeID type,
+                 bool constant);
+  const std::vector<global_tuple> &globals() const;
+
+  void addFunction(const std::string &name, FunctionDefinition *function);
+  FunctionDefinition *getFunction(const std::string &name) const;
+
+  void addExternal(const std::string &name, FunctionDeclaration *function);
+  FunctionDeclaration *getExternal(const std::string &name) const;
+  // First prototype of each function, in the order of the module
+  const std::vector<FunctionDeclaration *> &prototypes() const;
+
+  void addStruct(const std::string &name, StructDefinition *record);
+  StructDefinition *getStruct(const std::string &name) const;
+
+  void addGeneric(const std::string &name, GenericFunction *function);
+  GenericFunction *getGeneric(const std::string &name) const;
+
+  void addMemo(FunctionDefinition *function);
+  const std::vector<FunctionDefinition *> &memos() const;
+};
 
-  static void addGlobal(llvm::GlobalVariable *global, expr_ptr init,
-                        TypeID type);
-  static const std::vector<global_tuple> &globals();
+/**
+ * With --instrument functions and while loops count their calls and
+ * iterations and the cycles spent in them in sites of the runtime library,
+ * which prints a flat profile and the hottest loops when the program exits.
+ **/
+struct Profiler {
+  static bool enabled;
+
+  // Site of the function, or of a while loop at the line of the function
+  static llvm::Constant *site(llvm::Function *func, int line, bool loop);
+  static void enter(llvm::Constant *site);
+  static void exit();
+  static llvm::Value *cycles();
+  static void loop(llvm::Constant *site, llvm::Value *iterations,
+                   llvm::Value *start);
 };
 
-llvm::AllocaInst *entryBlockAlloca(llvm::Function *func,
-                                   const std::string &name, llvm::Type *type);
+/**
+ * Marks defined functions readnone or readonly, nounwind, norecurse and
+ * willreturn where it can be proven from their bodies and callees.
+ **/
+void inferAttributes(llvm::Module &module);
+
+/**
+ * Whether the function and all functions it calls only access their own
+ * stack and constant globals, and call no external functions which access
+ * memory, so its result depends on its arguments alone.
+ **/
+bool isPure(llvm::Function *func);
 
 #endif
\ No newline at end of file
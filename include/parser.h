@@ -4,6 +4,7 @@
 #include "lexer.h"
 #include "parse_tree.h"
 #include <fstream>
+#include <unordered_set>
 
 struct ParserError : std::runtime_error {
 public:
@@ -15,6 +16,24 @@ class Parser {
   Token peek;
   int lineNumber;
 
+  // Parsed statements are kept for compile-time evaluation of functions
+  std::vector<stmt_ptr> program;
+  // Name of the function being parsed, and whether it returns a call of
+  // itself
+  std::string function;
+  bool tailRecursive;
+  // Names of structs, which begin definitions of arrays of structs
+  std::unordered_set<std::string> structs;
+  // Tokens of a generic function replayed for one of its instances, with
+  // the type parameters replaced by the types of typeArguments
+  std::vector<Token> tokens;
+  size_t replayed;
+  std::unordered_map<std::string, TypeID> typeArguments;
+
+  Parser(Lexer &lexer_, std::vector<Token> tokens_,
+         std::unordered_set<std::string> structs_,
+         std::unordered_map<std::string, TypeID> typeArguments_);
+
   void next();
   void error(const std::string &msg) const;
   void warning(const std::string &msg) const;
@@ -22,16 +41,34 @@ class Parser {
   void match(Tag tag, const std::string &errMsg);
 
   stmt_ptr variableDefiniton();
-  stmt_ptr functionDefinition();
+  std::vector<Annotation> annotationList();
+  stmt_ptr functionDefinition(bool exported,
+                              std::vector<Annotation> &annotations);
+  stmt_ptr genericFunction(Token name, std::vector<Annotation> &annotations);
+  stmt_ptr structDefinition(std::vector<Annotation> &annotations);
   stmt_ptr statement();
   stmt_ptr conditionalStatement();
+  stmt_ptr matchStatement();
+  stmt_ptr forStatement();
+  stmt_ptr annotatedLoop();
   stmt_ptr block();
   stmt_ptr assignment();
+  stmt_ptr spawnStatement(id_ptr target, bool definition);
   expr_ptr expression();
   expr_ptr term();
   expr_ptr factor();
+  expr_ptr power();
   expr_ptr unary();
+  // Arguments in brackets, separated by commas
+  std::vector<expr_ptr> arguments(const std::string &name);
+  // Whether a call of the name is built in, which it is not if a function
+  // of the program declared so far or being parsed has the name
+  bool builtin(const std::string &name) const;
   expr_ptr functionCall();
+  // Index of an array element in square brackets
+  expr_ptr index();
+  // Element of an array, followed by a field for arrays of structs
+  std::unique_ptr<Index> element(Token name);
   expr_ptr conditional();
   expr_ptr conjunction();
   expr_ptr negation();
@@ -39,7 +76,7 @@ class Parser {
 
 public:
   const static std::string NO_SEMICOLON, NO_COLON, NO_CLOSING_BRACKET,
-      NO_CURLY_BRACKET, NO_CLOSING_CURLY_BRACKET;
+      NO_CLOSING_SQUARE_BRACKET, NO_CURLY_BRACKET, NO_CLOSING_CURLY_BRACKET;
 
   Parser(Lexer &lexer_);
   stmt_ptr parseNext();
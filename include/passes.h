@@ -0,0 +1,52 @@
+#ifndef PASSES_H
+#define PASSES_H
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassManager.h"
+#include <stdexcept>
+
+/**
+ * Simplifies complex number arithmetic in the form generated by the parser.
+ * Rewrites that keep results bit for bit equal are always done, others only
+ * when fast-math flags of the instructions allow them:
+ *  - |z| < r with a constant r compares the sum of squares with a threshold
+ *    instead of taking the square root, for any other r the flag afn is
+ *    needed,
+ *  - division by a complex number widened from a real divides both parts by
+ *    the real number, needs reassoc,
+ *  - z * conj(z) computes the sum of squares and an imaginary part of zero,
+ *    which needs nnan and ninf,
+ *  - re * re + im * im becomes a fused multiply-add, needs contract.
+ **/
+struct ComplexAlgebraPass : llvm::PassInfoMixin<ComplexAlgebraPass> {
+  llvm::PreservedAnalyses run(llvm::Function &func,
+                              llvm::FunctionAnalysisManager &);
+};
+
+/**
+ * Profile-guided optimization. An instrumented program counts the calls of
+ * each function and how often each conditional branch runs and is taken,
+ * and adds the counts to the profile file when it exits. With the profile
+ * the same program gets function entry counts and branch weights, which
+ * guide inlining, block placement and splitting of cold code.
+ **/
+struct ProfileError : std::runtime_error {
+public:
+  ProfileError(const std::string &err);
+};
+
+void instrument(llvm::Module &module, const std::string &file);
+void useProfile(llvm::Module &module, const std::string &file);
+
+// Optimization pipeline run on the module before it is printed
+struct Optimizer {
+  unsigned level = 0;
+  bool complexAlgebra = true;
+  // Profile files written by the instrumented program and read back, empty
+  // if not given
+  std::string profileGenerate, profileUse;
+
+  void run(llvm::Module &module);
+};
+
+#endif // PASSES_H
@@ -0,0 +1,131 @@
+#ifndef RUNTIME_H
+#define RUNTIME_H
+
+#include <stdint.h>
+
+/**
+ * Runtime library linked with compiled programs which use parallel loops,
+ * spawn function calls, arrays or memo functions, and with programs
+ * instrumented for profiling or compiled with --instrument.
+ * Functions follow the C calling convention, so the program calls them like
+ * any other external function.
+ **/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Operators of reductions in parallel loops
+enum ps_reduction { PS_ADD, PS_MUL, PS_MIN, PS_MAX };
+
+// Body of a parallel loop, runs iterations from begin to end, exclusive
+typedef void (*ps_loop_body)(void *context, int64_t begin, int64_t end);
+
+/**
+ * Runs all iterations of the loop on the thread pool and returns when they
+ * are done. With a chunk of 0 iterations are split evenly between the
+ * threads, otherwise the threads take chunks of the given size in turn.
+ * Loops started from within a parallel loop, by a task which a worker stole
+ * or while another loop runs, run on the calling thread.
+ **/
+void ps_parallel_for(ps_loop_body body, void *context, int64_t iterations,
+                     int64_t chunk);
+
+// Combine a partial result with the shared value of a reduction variable
+void ps_reduce_int(int64_t *shared, int64_t value, int32_t op);
+void ps_reduce_double(double *shared, double value, int32_t op);
+void ps_reduce_complex(double *shared, double re, double im, int32_t op);
+
+/**
+ * Spawned calls of a function activation. Only the thread running it
+ * changes spawned, threads which stole its tasks count them in stolen.
+ **/
+typedef struct ps_frame {
+  int64_t spawned;
+  int64_t stolen;
+} ps_frame;
+
+// Call of a spawned function, kept by the compiled code until the sync
+typedef struct ps_task {
+  void (*run)(void *context);
+  void *context;
+  ps_frame *frame;
+} ps_task;
+
+/**
+ * Pushes the task on the calling thread's deque, from which idle threads
+ * steal the oldest tasks. Runs it right away if the deque is full.
+ **/
+void ps_spawn(ps_frame *frame, ps_task *task);
+
+// Returns when all tasks spawned in the frame are done, running them if
+// they were not stolen, and helping other threads in the meantime
+void ps_sync(ps_frame *frame);
+
+// Reports an index out of bounds of an array at a line and aborts
+void ps_bounds_error(int64_t index, int64_t length, int64_t line);
+
+/**
+ * Allocates an array of length elements of the given size, to be released
+ * with free. Reports a negative length or a failed allocation and aborts.
+ **/
+void *ps_alloc(int64_t length, int64_t size, int64_t line);
+
+/**
+ * Cache of results of a memo function, created by the first lookup in the
+ * slot of the function. A cache with a positive capacity keeps at most that
+ * many results, evicting the least recently used one, a capacity of 0 keeps
+ * all of them. Results are found by the bytes of the arguments.
+ **/
+typedef struct ps_memo ps_memo;
+
+// Copies the result for the key and returns 1, or returns 0 if it is missing
+int32_t ps_memo_lookup(ps_memo **cache, int64_t capacity, const void *key,
+                       int64_t key_size, void *result, int64_t result_size);
+
+// Stores the result for the key, after a lookup which did not find it
+void ps_memo_store(ps_memo **cache, int64_t capacity, const void *key,
+                   int64_t key_size, const void *result, int64_t result_size);
+
+/**
+ * Registers the counters of an instrumented program, which are added to the
+ * profile file when the program exits. The counters of each function follow
+ * those of the previous one, sizes holds their numbers.
+ **/
+void ps_profile_init(const char *file, const char *const *names,
+                     const int64_t *sizes, int64_t functions,
+                     int64_t *counters);
+
+/**
+ * Function or while loop of a program compiled with --instrument. It counts
+ * the calls of the function or the runs of the loop, the iterations of the
+ * loop and the cycles spent in it. Cycles of a function exclude calls of
+ * other instrumented functions, cycles of a loop include everything. Sites
+ * are registered the first time they are reached, and the profile of the
+ * registered sites is printed to standard error when the program exits.
+ **/
+typedef struct ps_site {
+  const char *function;
+  int64_t line;
+  int64_t loop;
+  int64_t count;
+  int64_t iterations;
+  int64_t cycles;
+  int64_t registered;
+} ps_site;
+
+// Time stamp counter, or nanoseconds where there is none
+int64_t ps_cycles(void);
+
+// Starts and ends a call of the function on the calling thread
+void ps_instrument_enter(ps_site *function);
+void ps_instrument_exit(void);
+
+// Adds a run of the loop, started at the given cycle
+void ps_instrument_loop(ps_site *loop, int64_t iterations, int64_t start);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RUNTIME_H
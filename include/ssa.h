@@ -0,0 +1,46 @@
+#ifndef SSA_H
+#define SSA_H
+
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/ValueHandle.h"
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * Builds SSA form of local variables while the code is generated, following
+ * "Simple and Efficient Construction of Static Single Assignment Form" by
+ * Braun et al. Each variable has a current value in every block which
+ * defines it. Reading a variable in a block without a definition looks the
+ * value up in predecessors, inserting phi nodes at join points.
+ * A block is sealed once all of its predecessors are known. Until then phi
+ * nodes in it are left incomplete and get their operands when it is sealed.
+ * Phi nodes with a single distinct operand are removed right away.
+ **/
+class SSABuilder {
+  using Definitions = std::unordered_map<size_t, llvm::WeakTrackingVH>;
+  std::unordered_map<llvm::BasicBlock *, Definitions> definitions;
+  std::unordered_map<llvm::BasicBlock *,
+                     std::vector<std::pair<size_t, llvm::PHINode *>>>
+      incomplete;
+  std::unordered_set<llvm::BasicBlock *> sealed;
+  std::vector<llvm::Type *> types;
+
+  llvm::Value *readRecursive(size_t variable, llvm::BasicBlock *block);
+  llvm::PHINode *createPhi(size_t variable, llvm::BasicBlock *block);
+  llvm::Value *addOperands(size_t variable, llvm::PHINode *phi);
+  llvm::Value *removeTrivial(llvm::PHINode *phi);
+
+public:
+  // Forgets all variables, should be called at the start of each function
+  void clear();
+
+  // Returns a new variable of the given type
+  size_t add(llvm::Type *type);
+
+  void write(size_t variable, llvm::BasicBlock *block, llvm::Value *value);
+  llvm::Value *read(size_t variable, llvm::BasicBlock *block);
+  void seal(llvm::BasicBlock *block);
+};
+
+#endif // SSA_H
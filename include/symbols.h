@@ -15,7 +15,9 @@ enum class Tag {
   I,
   STRING,
   ID,
+  ANNOTATION,
   ASSIGN,
+  ARROW,
   EQ,
   NEQ,
   LT,
@@ -23,28 +25,49 @@ enum class Tag {
   GE,
   GT,
   FUN,
+  EXPORT,
+  STRUCT,
+  CONST,
   MAIN,
   OR,
   AND,
   NOT,
+  LIKELY,
+  UNLIKELY,
   IF,
   ELSE,
   WHILE,
+  FOR,
+  TO,
+  STEP,
+  BREAK,
+  CONTINUE,
+  PARALLEL,
+  REDUCE,
+  SPAWN,
+  SYNC,
+  MATCH,
   RETURN,
+  TAILCALL,
   RE,
   IM,
+  CONJ,
   SEMICOLON,
   COLON,
   COMMA,
+  DOT,
   OPEN_CURLY,
   CLOSE_CURLY,
   OPEN_BRACKET,
   CLOSE_BRACKET,
+  OPEN_SQUARE,
+  CLOSE_SQUARE,
   VERTICAL,
   PLUS,
   MINUS,
   TIMES,
   DIVIDE,
+  POWER,
   END
 };
 
@@ -53,6 +76,7 @@ const static std::unordered_map<char, Tag> operators{{'+', Tag::PLUS},
                                                      {'-', Tag::MINUS},
                                                      {'*', Tag::TIMES},
                                                      {'/', Tag::DIVIDE},
+                                                     {'^', Tag::POWER},
                                                      {'=', Tag::ASSIGN},
                                                      {'<', Tag::LT},
                                                      {'>', Tag::GT},
@@ -62,11 +86,26 @@ const static std::unordered_map<char, Tag> operators{{'+', Tag::PLUS},
                                                      {'}', Tag::CLOSE_CURLY},
                                                      {'(', Tag::OPEN_BRACKET},
                                                      {')', Tag::CLOSE_BRACKET},
+                                                     {'[', Tag::OPEN_SQUARE},
+                                                     {']', Tag::CLOSE_SQUARE},
                                                      {'|', Tag::VERTICAL},
                                                      {',', Tag::COMMA},
+                                                     {'.', Tag::DOT},
                                                      {EOF, Tag::END}};
 
-enum class TypeID { INT, DOUBLE, COMPLEX, STRING, NONE };
+enum class TypeID {
+  INT,
+  DOUBLE,
+  COMPLEX,
+  INT32,
+  FLOAT,
+  COMPLEX32,
+  VEC2D,
+  VEC4D,
+  VEC8F,
+  STRING,
+  NONE
+};
 
 struct Token {
   Tag tag;
@@ -81,7 +120,7 @@ struct Token {
 
   int64_t getInt();
   double getDouble();
-  std::string getString();
+  std::string getString() const;
   TypeID getType();
 };
 
@@ -18,17 +18,40 @@ Lexer::Lexer(std::istream &stream_) : line(1), stream(stream_) {
   reserve({{"if", Tag::IF},
            {"else", Tag::ELSE},
            {"while", Tag::WHILE},
+           {"for", Tag::FOR},
+           {"to", Tag::TO},
+           {"step", Tag::STEP},
+           {"break", Tag::BREAK},
+           {"continue", Tag::CONTINUE},
+           {"parallel", Tag::PARALLEL},
+           {"reduce", Tag::REDUCE},
+           {"spawn", Tag::SPAWN},
+           {"sync", Tag::SYNC},
+           {"match", Tag::MATCH},
            {"fun", Tag::FUN},
+           {"export", Tag::EXPORT},
+           {"struct", Tag::STRUCT},
+           {"const", Tag::CONST},
            {"main", Tag::MAIN},
            {"return", Tag::RETURN},
+           {"tailcall", Tag::TAILCALL},
            {"Re", Tag::RE},
            {"Im", Tag::IM},
+           {"conj", Tag::CONJ},
            {"and", Tag::AND},
            {"or", Tag::OR},
-           {"not", Tag::NOT}});
+           {"not", Tag::NOT},
+           {"likely", Tag::LIKELY},
+           {"unlikely", Tag::UNLIKELY}});
   reserve({{"int", TypeID::INT},
            {"double", TypeID::DOUBLE},
            {"complex", TypeID::COMPLEX},
+           {"int32", TypeID::INT32},
+           {"float", TypeID::FLOAT},
+           {"complex32", TypeID::COMPLEX32},
+           {"vec2d", TypeID::VEC2D},
+           {"vec4d", TypeID::VEC4D},
+           {"vec8f", TypeID::VEC8F},
            {"string", TypeID::STRING}});
 
   readNext();
@@ -78,6 +101,9 @@ void Lexer::whitespace() {
 Token Lexer::equals() {
   if (readNext('=')) {
     return Token(Tag::EQ, line);
+  } else if (peek == '>') {
+    peek = 0;
+    return Token(Tag::ARROW, line);
   } else {
     return Token(Tag::ASSIGN, line);
   }
@@ -190,6 +216,18 @@ Token Lexer::alpha() {
   return Token(Tag::ID, word, line);
 }
 
+Token Lexer::annotation() {
+  if (!isalpha(peek) && peek != '_') {
+    error('@');
+  }
+  std::string name;
+  do {
+    name += peek;
+    readNext();
+  } while (isalnum(peek) || peek == '_');
+  return Token(Tag::ANNOTATION, name, line);
+}
+
 Token Lexer::getNextToken() {
   whitespace();
 
@@ -219,6 +257,10 @@ Token Lexer::getNextToken() {
   case '"':
     return ret(quotation());
 
+  case '@':
+    readNext();
+    return ret(annotation());
+
   default:
     if (operators.find(curr) != operators.end()) {
       return ret(operators.at(curr));
@@ -70,7 +70,8 @@ TEST(lexer_test, identifier) {
 
 TEST(lexer_test, keywords) {
   std::stringstream stream("\n\n\t   int double complex string fun \
-        main or and not if while return Re Im");
+        main or and not if while return Re Im conj const export for to step \
+        break continue parallel reduce spawn sync");
   Lexer lexer(stream);
 
   for (int i = 0; i < 4; ++i) {
@@ -87,6 +88,25 @@ TEST(lexer_test, keywords) {
   expectToken(lexer, Tag::RETURN);
   expectToken(lexer, Tag::RE);
   expectToken(lexer, Tag::IM);
+  expectToken(lexer, Tag::CONJ);
+  expectToken(lexer, Tag::CONST);
+  expectToken(lexer, Tag::EXPORT);
+  expectToken(lexer, Tag::FOR);
+  expectToken(lexer, Tag::TO);
+  expectToken(lexer, Tag::STEP);
+  expectToken(lexer, Tag::BREAK);
+  expectToken(lexer, Tag::CONTINUE);
+  expectToken(lexer, Tag::PARALLEL);
+  expectToken(lexer, Tag::REDUCE);
+  expectToken(lexer, Tag::SPAWN);
+  expectToken(lexer, Tag::SYNC);
+}
+
+TEST(lexer_test, annotation) {
+  Token token = firstToken("@fastmath");
+  EXPECT_EQ(token.tag, Tag::ANNOTATION);
+  EXPECT_EQ(token.getString(), "fastmath");
+  EXPECT_THROW(firstToken("@ fastmath"), LexerError);
 }
 
 TEST(lexer_test, assignment) {
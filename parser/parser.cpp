@@ -1,3 +1,4 @@
+#include "interpreter.h"
 #include "parser.h"
 
 ParserError::ParserError(const std::string &err) : std::runtime_error(err) {}
@@ -6,13 +7,28 @@ const std::string Parser::NO_SEMICOLON = "Missing semicolon ';'";
 const std::string Parser::NO_COLON = "Missing colon ':'";
 const std::string Parser::NO_CLOSING_BRACKET =
     "No match for opening bracket '('";
+const std::string Parser::NO_CLOSING_SQUARE_BRACKET =
+    "No match for opening bracket '['";
 const std::string Parser::NO_CURLY_BRACKET = "Missing curly bracket '{'";
 const std::string Parser::NO_CLOSING_CURLY_BRACKET =
     "No match for opening curly bracket '{'";
 
 void Parser::next() {
-  lineNumber = lexer.line;
-  peek = lexer.getNextToken();
+  if (tokens.empty()) {
+    lineNumber = lexer.line;
+    peek = lexer.getNextToken();
+  } else if (replayed < tokens.size()) {
+    lineNumber = tokens[replayed].line;
+    peek = tokens[replayed++];
+  } else {
+    peek = Token(Tag::END, lineNumber);
+  }
+  if (peek.tag == Tag::ID) {
+    auto argument = typeArguments.find(peek.getString());
+    if (argument != typeArguments.end()) {
+      peek = Token(argument->second, peek.line);
+    }
+  }
 }
 
 void Parser::error(const std::string &msg) const {
@@ -33,8 +49,29 @@ void Parser::match(Tag tag, const std::string &errMsg) {
 }
 
 stmt_ptr Parser::variableDefiniton() {
+  bool constant = peek.tag == Tag::CONST;
+  if (constant) {
+    next();
+  }
+  // The type of elements of an array of structs is the struct's name
+  const bool record = peek.tag == Tag::ID && structs.count(peek.getString());
+  if (peek.tag != Tag::TYPE && !record) {
+    error("Expected a type");
+  }
   Token type = std::move(peek);
   next();
+  if (record && peek.tag != Tag::OPEN_SQUARE) {
+    error("Structs can only be elements of arrays");
+  }
+  expr_ptr length;
+  if (peek.tag == Tag::OPEN_SQUARE) {
+    if (constant) {
+      error("Arrays cannot be constant");
+    }
+    next();
+    length = expression();
+    match(Tag::CLOSE_SQUARE, NO_CLOSING_SQUARE_BRACKET);
+  }
 
   if (peek.tag != Tag::ID) {
     error("Expected an identifier");
@@ -42,18 +79,76 @@ stmt_ptr Parser::variableDefiniton() {
   Token name = std::move(peek);
   next();
 
-  match(Tag::ASSIGN, "Variable " + name.getString() + " was not initialized");
+  match(Tag::ASSIGN, (length ? "Array " : "Variable ") + name.getString() +
+                         " was not initialized");
+  if (length) {
+    if (peek.tag == Tag::SPAWN) {
+      error("Arrays cannot be initialized with spawn");
+    }
+    expr_ptr expr = expression();
+    match(Tag::SEMICOLON, NO_SEMICOLON);
+    auto array = std::make_unique<ArrayDefinition>(
+        std::make_unique<Identifier>(
+            std::move(name), record ? TypeID::NONE : type.getType()),
+        std::move(length), std::move(expr));
+    if (record) {
+      array->record = type.getString();
+    }
+    return array;
+  }
+  if (peek.tag == Tag::SPAWN) {
+    if (constant) {
+      error("Constants cannot be initialized with spawn");
+    }
+    return spawnStatement(
+        std::make_unique<Identifier>(std::move(name), type.getType()), true);
+  }
   expr_ptr expr = expression();
 
-  id_ptr id = std::make_unique<Identifier>(std::move(name), type.getType());
+  id_ptr id = std::make_unique<Identifier>(std::move(name), type.getType(),
+                                           nullptr, constant);
   match(Tag::SEMICOLON, NO_SEMICOLON);
 
   return std::make_unique<VariableDefinition>(std::move(id), std::move(expr));
 }
 
-stmt_ptr Parser::functionDefinition() {
+std::vector<Annotation> Parser::annotationList() {
+  std::vector<Annotation> annotations;
+  while (peek.tag == Tag::ANNOTATION) {
+    Annotation annotation{std::move(peek), {}};
+    next();
+    if (peek.tag == Tag::OPEN_BRACKET) {
+      next();
+      while (peek.tag != Tag::CLOSE_BRACKET) {
+        if (peek.tag != Tag::INT) {
+          error("Expected an integer argument of annotation");
+        }
+        annotation.arguments.push_back(peek.getInt());
+        next();
+        if (peek.tag == Tag::COMMA) {
+          next();
+        }
+      }
+      next(); // ')'
+    }
+    annotations.push_back(std::move(annotation));
+  }
+  return annotations;
+}
+
+stmt_ptr Parser::functionDefinition(bool exported,
+                                    std::vector<Annotation> &annotations) {
   Token name = std::move(peek);
   next();
+  if (peek.tag == Tag::LT) {
+    if (exported) {
+      error("Generic function " + name.getString() + " cannot be exported");
+    }
+    if (name.tag == Tag::MAIN) {
+      error("Function main cannot be generic");
+    }
+    return genericFunction(std::move(name), annotations);
+  }
 
   match(Tag::COLON, NO_COLON);
   Token type = std::move(peek);
@@ -63,13 +158,38 @@ stmt_ptr Parser::functionDefinition() {
         "Expected parameter list for function " + name.getString());
   std::vector<id_ptr> params;
   while (peek.tag != Tag::CLOSE_BRACKET) {
+    std::vector<Annotation> qualifiers = annotationList();
     Token paramName = std::move(peek);
     next();
     match(Tag::COLON, NO_COLON);
 
+    // view<type> is a parameter type only, so view is not a keyword
+    bool view = peek.tag == Tag::ID && peek.getString() == "view";
+    if (view) {
+      next();
+      match(Tag::LT, "Expected '<' after view");
+    }
     params.push_back(
         std::make_unique<Identifier>(std::move(paramName), peek.getType()));
     next();
+    if (view) {
+      match(Tag::GT, "Expected '>' after the element type of view");
+    }
+    Identifier &param = *params.back();
+    param.view = view;
+    for (auto &qualifier : qualifiers) {
+      const std::string annotation = qualifier.token.getString();
+      if (!view || (annotation != "readonly" && annotation != "noalias") ||
+          !qualifier.arguments.empty()) {
+        error("Unknown annotation @" + annotation + " of parameter " +
+              param.token.getString());
+      }
+      if (annotation == "readonly") {
+        param.constant = true;
+      } else {
+        param.noalias = true;
+      }
+    }
     if (peek.tag == Tag::COMMA) {
       next();
       if (peek.tag == Tag::CLOSE_BRACKET) {
@@ -79,13 +199,188 @@ stmt_ptr Parser::functionDefinition() {
   }
   next(); // ')'
 
+  std::unique_ptr<FunctionDeclaration> func;
   if (peek.tag == Tag::SEMICOLON) {
     next();
-    return std::make_unique<FunctionDeclaration>(std::move(name),
-                                                 type.getType(), params);
+    func = std::make_unique<FunctionDeclaration>(
+        std::move(name), type.getType(), params, exported);
+  } else {
+    // Instances of generic functions are called by the generic name
+    function = name.getString().substr(0, name.getString().find('<'));
+    tailRecursive = false;
+    auto definition = std::make_unique<FunctionDefinition>(
+        std::move(name), type.getType(), block(), params, exported);
+    definition->tailRecursive = tailRecursive;
+    function.clear();
+    func = std::move(definition);
+  }
+  func->annotations = std::move(annotations);
+  return func;
+}
+
+namespace {
+const std::unordered_map<TypeID, std::string> typeNames{
+    {TypeID::INT, "int"},         {TypeID::DOUBLE, "double"},
+    {TypeID::COMPLEX, "complex"}, {TypeID::INT32, "int32"},
+    {TypeID::FLOAT, "float"},     {TypeID::COMPLEX32, "complex32"},
+    {TypeID::VEC2D, "vec2d"},     {TypeID::VEC4D, "vec4d"},
+    {TypeID::VEC8F, "vec8f"}};
+} // namespace
+
+stmt_ptr Parser::genericFunction(Token name,
+                                 std::vector<Annotation> &annotations) {
+  next(); // '<'
+  std::vector<std::string> typeParameters;
+  while (peek.tag != Tag::GT) {
+    if (peek.tag != Tag::ID) {
+      error("Expected a type parameter of " + name.getString());
+    }
+    const std::string parameter = peek.getString();
+    if (std::find(typeParameters.begin(), typeParameters.end(), parameter) !=
+        typeParameters.end()) {
+      error("Type parameter " + parameter + " of " + name.getString() +
+            " is repeated");
+    }
+    typeParameters.push_back(parameter);
+    next();
+    if (peek.tag == Tag::COMMA) {
+      next();
+    } else if (peek.tag != Tag::GT) {
+      error("Expected ',' or '>' after type parameter " + parameter);
+    }
+  }
+  next(); // '>'
+
+  // The rest of the definition is parsed again for each instance
+  std::vector<Token> definition;
+  while (peek.tag != Tag::OPEN_CURLY) {
+    if (peek.tag == Tag::SEMICOLON || peek.tag == Tag::END) {
+      error("Generic function " + name.getString() +
+            " must have a body in curly brackets");
+    }
+    definition.push_back(peek);
+    next();
+  }
+  int depth = 0;
+  do {
+    if (peek.tag == Tag::END) {
+      error(NO_CLOSING_CURLY_BRACKET);
+    }
+    depth += peek.tag == Tag::OPEN_CURLY    ? 1
+             : peek.tag == Tag::CLOSE_CURLY ? -1
+                                            : 0;
+    definition.push_back(peek);
+    next();
+  } while (depth > 0);
+
+  // A parameter is bound to the type parameter which follows its colon
+  std::vector<std::string> bindings;
+  auto token = std::find_if(definition.begin(), definition.end(),
+                            [](const Token &token) {
+                              return token.tag == Tag::OPEN_BRACKET;
+                            });
+  bool parameter = false, typed = false;
+  while (token != definition.end() && ++token != definition.end() &&
+         (depth > 0 || token->tag != Tag::CLOSE_BRACKET)) {
+    if (depth == 0 && token->tag == Tag::COMMA) {
+      parameter = false;
+      continue;
+    }
+    if (!parameter) {
+      bindings.emplace_back();
+      parameter = true;
+      typed = false;
+    }
+    if (token->tag == Tag::OPEN_BRACKET) {
+      ++depth;
+    } else if (token->tag == Tag::CLOSE_BRACKET) {
+      --depth;
+    } else if (token->tag == Tag::COLON && depth == 0) {
+      typed = true;
+    } else if (typed && token->tag == Tag::ID &&
+               std::find(typeParameters.begin(), typeParameters.end(),
+                         token->getString()) != typeParameters.end()) {
+      bindings.back() = token->getString();
+    }
   }
-  return std::make_unique<FunctionDefinition>(std::move(name), type.getType(),
-                                              block(), params);
+  const std::string base = name.getString();
+  const int line = name.line;
+  auto generic = std::make_unique<GenericFunction>(std::move(name),
+                                                   typeParameters);
+  generic->bindings = std::move(bindings);
+  generic->annotations = std::move(annotations);
+  generic->parse = [&lexer = lexer, definition, structs = structs, base, line,
+                    typeParameters = generic->typeParameters](
+                       const std::vector<TypeID> &types) {
+    std::unordered_map<std::string, TypeID> arguments;
+    std::string instance = base + "<";
+    for (size_t i = 0; i < types.size(); ++i) {
+      arguments[typeParameters[i]] = types[i];
+      instance += (i ? "," : "") + typeNames.at(types[i]);
+    }
+    std::vector<Token> tokens{Token(Tag::ID, instance + ">", line)};
+    tokens.insert(tokens.end(), definition.begin(), definition.end());
+    Parser parser(lexer, std::move(tokens), structs, std::move(arguments));
+    std::vector<Annotation> none;
+    stmt_ptr function = parser.functionDefinition(false, none);
+    return std::unique_ptr<FunctionDefinition>(
+        static_cast<FunctionDefinition *>(function.release()));
+  };
+  // Errors in the definition are found before it is called
+  generic->definition = generic->parse(
+      std::vector<TypeID>(generic->typeParameters.size(), TypeID::INT));
+  for (const std::string &typeParameter : generic->typeParameters) {
+    if (std::find(generic->bindings.begin(), generic->bindings.end(),
+                  typeParameter) == generic->bindings.end()) {
+      error("Type parameter " + typeParameter + " of " + base +
+            " is not the type of a parameter");
+    }
+  }
+  return generic;
+}
+
+stmt_ptr Parser::structDefinition(std::vector<Annotation> &annotations) {
+  next(); // struct
+  if (peek.tag != Tag::ID) {
+    error("Expected a name of struct");
+  }
+  Token name = std::move(peek);
+  next();
+  bool soa = false;
+  for (auto &annotation : annotations) {
+    if (annotation.token.getString() != "soa" ||
+        !annotation.arguments.empty()) {
+      error("Unknown annotation @" + annotation.token.getString() +
+            " of struct " + name.getString());
+    }
+    soa = true;
+  }
+
+  match(Tag::OPEN_CURLY, NO_CURLY_BRACKET);
+  std::vector<id_ptr> fields;
+  while (peek.tag != Tag::CLOSE_CURLY) {
+    if (peek.tag != Tag::ID) {
+      error("Expected a field of struct " + name.getString());
+    }
+    Token field = std::move(peek);
+    next();
+    match(Tag::COLON, NO_COLON);
+    if (peek.tag != Tag::TYPE) {
+      error("Expected a type of field " + field.getString());
+    }
+    fields.push_back(
+        std::make_unique<Identifier>(std::move(field), peek.getType()));
+    next();
+    if (peek.tag == Tag::COMMA) {
+      next();
+    } else if (peek.tag != Tag::CLOSE_CURLY) {
+      error("Expected ',' or '}' after field " +
+            fields.back()->token.getString());
+    }
+  }
+  next(); // '}'
+  structs.insert(name.getString());
+  return std::make_unique<StructDefinition>(std::move(name), fields, soa);
 }
 
 stmt_ptr Parser::statement() {
@@ -94,18 +389,50 @@ stmt_ptr Parser::statement() {
   Token token = peek;
   switch (peek.tag) {
   case Tag::RETURN:
+  case Tag::TAILCALL: {
     next();
     expr = expression();
     match(Tag::SEMICOLON, NO_SEMICOLON);
+    auto call = dynamic_cast<FunctionCall *>(expr.get());
+    if (call && dynamic_cast<BuiltinCall *>(call)) {
+      call = nullptr;
+    }
+    if (token.tag == Tag::TAILCALL && !call) {
+      error("Expected a call of a function after tailcall");
+    }
+    if (call && call->token.getString() == function) {
+      tailRecursive = true;
+    }
     result =
         std::make_unique<ReturnStatement>(std::move(token), std::move(expr));
     return result;
+  }
   case Tag::IF:
   case Tag::WHILE:
     return conditionalStatement();
+  case Tag::MATCH:
+    return matchStatement();
+  case Tag::FOR:
+  case Tag::PARALLEL:
+    return forStatement();
+  case Tag::ANNOTATION:
+    return annotatedLoop();
+  case Tag::BREAK:
+  case Tag::CONTINUE:
+    next();
+    match(Tag::SEMICOLON, NO_SEMICOLON);
+    return std::make_unique<JumpStatement>(std::move(token));
+  case Tag::SYNC:
+    next();
+    match(Tag::SEMICOLON, NO_SEMICOLON);
+    return std::make_unique<SyncStatement>(std::move(token));
+  case Tag::CONST:
   case Tag::TYPE:
     return variableDefiniton();
   case Tag::ID:
+    if (structs.count(peek.getString())) {
+      return variableDefiniton();
+    }
     return assignment();
   default:
     error("Expected a statement");
@@ -118,7 +445,18 @@ stmt_ptr Parser::conditionalStatement() {
   Token token = peek;
   next();
   match(Tag::OPEN_BRACKET, "Expected a conditional in brackets");
+  // The whole condition can be wrapped in likely() or unlikely()
+  Expectation expected = Expectation::NONE;
+  if (peek.tag == Tag::LIKELY || peek.tag == Tag::UNLIKELY) {
+    expected = peek.tag == Tag::LIKELY ? Expectation::LIKELY
+                                       : Expectation::UNLIKELY;
+    next();
+    match(Tag::OPEN_BRACKET, "Expected a conditional in brackets");
+  }
   expr_ptr condition = conditional();
+  if (expected != Expectation::NONE) {
+    match(Tag::CLOSE_BRACKET, NO_CLOSING_BRACKET);
+  }
   match(Tag::CLOSE_BRACKET, NO_CLOSING_BRACKET);
   stmt_ptr body = block();
   if (if_) {
@@ -127,16 +465,159 @@ stmt_ptr Parser::conditionalStatement() {
       next();
       elseBlock = block();
     }
-    return std::make_unique<IfStatement>(std::move(token), std::move(condition),
-                                         std::move(body), std::move(elseBlock));
+    auto statement = std::make_unique<IfStatement>(
+        std::move(token), std::move(condition), std::move(body),
+        std::move(elseBlock));
+    statement->expected = expected;
+    return statement;
   }
-  return std::make_unique<WhileStatement>(
+  auto loop = std::make_unique<WhileStatement>(
       std::move(token), std::move(condition), std::move(body));
+  loop->expected = expected;
+  return loop;
+}
+
+stmt_ptr Parser::matchStatement() {
+  Token token = peek;
+  next(); // match
+  match(Tag::OPEN_BRACKET, "Expected a value in brackets after match");
+  expr_ptr value = expression();
+  match(Tag::CLOSE_BRACKET, NO_CLOSING_BRACKET);
+  match(Tag::OPEN_CURLY, NO_CURLY_BRACKET);
+
+  std::vector<MatchStatement::Arm> arms;
+  stmt_ptr otherwise;
+  while (peek.tag != Tag::CLOSE_CURLY) {
+    if (peek.tag == Tag::END) {
+      error(NO_CLOSING_CURLY_BRACKET);
+    }
+    if (otherwise) {
+      error("Arm _ must be the last arm of match");
+    }
+    if (peek.tag == Tag::ID && peek.getString() == "_") {
+      next();
+      match(Tag::ARROW, "Expected '=>' after _");
+      otherwise = block();
+      continue;
+    }
+    MatchStatement::Arm arm;
+    do {
+      if (!arm.patterns.empty()) {
+        next(); // ','
+      }
+      expr_ptr first = expression(), last;
+      if (peek.tag == Tag::TO) {
+        next();
+        last = expression();
+      }
+      arm.patterns.emplace_back(std::move(first), std::move(last));
+    } while (peek.tag == Tag::COMMA);
+    match(Tag::ARROW, "Expected '=>' after patterns");
+    arm.block = block();
+    arms.push_back(std::move(arm));
+  }
+  next(); // '}'
+  return std::make_unique<MatchStatement>(std::move(token), std::move(value),
+                                          arms, std::move(otherwise));
+}
+
+stmt_ptr Parser::forStatement() {
+  bool parallel = peek.tag == Tag::PARALLEL;
+  if (parallel) {
+    next();
+    if (peek.tag != Tag::FOR) {
+      error("Expected a for loop after 'parallel'");
+    }
+  }
+  Token token = std::move(peek);
+  next();
+  if (peek.tag != Tag::ID) {
+    error("Expected a loop counter");
+  }
+  id_ptr counter =
+      std::make_unique<Identifier>(std::move(peek), TypeID::INT, nullptr, true);
+  next();
+  match(Tag::ASSIGN, "Expected an assignment of the loop counter");
+  expr_ptr start = expression();
+  match(Tag::TO, "Expected 'to' after the start of the loop");
+  expr_ptr end = expression();
+
+  int64_t step = 1;
+  if (peek.tag == Tag::STEP) {
+    next();
+    bool negative = peek.tag == Tag::MINUS;
+    if (negative) {
+      next();
+    }
+    if (peek.tag != Tag::INT || peek.getInt() == 0) {
+      error("Loop step must be a nonzero integer");
+    }
+    step = negative ? -peek.getInt() : peek.getInt();
+    next();
+  }
+
+  std::vector<std::pair<Token, id_ptr>> reductions;
+  if (parallel && peek.tag == Tag::REDUCE) {
+    next();
+    match(Tag::OPEN_BRACKET, "Expected '(' after 'reduce'");
+    while (peek.tag != Tag::CLOSE_BRACKET) {
+      if (peek.tag != Tag::PLUS && peek.tag != Tag::TIMES &&
+          (peek.tag != Tag::ID ||
+           (peek.getString() != "min" && peek.getString() != "max"))) {
+        error("Expected one of +, *, min or max as a reduction operator");
+      }
+      Token op = std::move(peek);
+      next();
+      match(Tag::COLON, NO_COLON);
+      if (peek.tag != Tag::ID) {
+        error("Expected a reduction variable");
+      }
+      id_ptr variable =
+          std::make_unique<Identifier>(std::move(peek), TypeID::NONE);
+      reductions.emplace_back(std::move(op), std::move(variable));
+      next();
+      if (peek.tag == Tag::COMMA) {
+        next();
+      }
+    }
+    next(); // ')'
+    if (reductions.empty()) {
+      error("Expected a reduction");
+    }
+  }
+  auto loop = std::make_unique<ForStatement>(
+      std::move(token), std::move(counter), std::move(start), std::move(end),
+      step, block());
+  loop->parallel = parallel;
+  loop->reductions = std::move(reductions);
+  return loop;
+}
+
+stmt_ptr Parser::annotatedLoop() {
+  std::vector<Annotation> annotations = annotationList();
+  stmt_ptr loop;
+  if (peek.tag == Tag::FOR || peek.tag == Tag::PARALLEL) {
+    loop = forStatement();
+  } else if (peek.tag == Tag::WHILE) {
+    loop = conditionalStatement();
+  } else {
+    error("Expected a loop after annotations");
+  }
+  static_cast<Loop *>(loop.get())->annotations = std::move(annotations);
+  return loop;
 }
 
 stmt_ptr Parser::block() {
   if (peek.tag != Tag::OPEN_CURLY) {
-    return statement();
+    Token token = peek;
+    stmt_ptr single = statement();
+    // A spawned call is synced at the end of its block
+    if (dynamic_cast<SpawnStatement *>(single.get())) {
+      std::vector<stmt_ptr> block;
+      block.push_back(std::move(single));
+      return std::make_unique<Sequence>(std::move(token), block);
+    }
+    return single;
   }
 
   Token token = peek;
@@ -152,12 +633,44 @@ stmt_ptr Parser::block() {
 stmt_ptr Parser::assignment() {
   id_ptr name = std::make_unique<Identifier>(std::move(peek), TypeID::NONE);
   next();
+  if (peek.tag == Tag::OPEN_SQUARE) {
+    std::unique_ptr<Index> target = element(std::move(name->token));
+    match(Tag::ASSIGN, "Expected an assignment");
+    expr_ptr expr = expression();
+    match(Tag::SEMICOLON, NO_SEMICOLON);
+    return std::make_unique<ElementAssignment>(std::move(target),
+                                               std::move(expr));
+  }
   match(Tag::ASSIGN, "Expected an assignment");
+  if (peek.tag == Tag::SPAWN) {
+    return spawnStatement(std::move(name), false);
+  }
   expr_ptr expr = expression();
   match(Tag::SEMICOLON, NO_SEMICOLON);
   return std::make_unique<Assignment>(std::move(name), std::move(expr));
 }
 
+stmt_ptr Parser::spawnStatement(id_ptr target, bool definition) {
+  next(); // spawn
+  if (peek.tag != Tag::ID) {
+    error("Expected a function call after 'spawn'");
+  }
+  const std::string name = peek.getString();
+  if (builtin(name)) {
+    error("Built-in function " + name + "() cannot be spawned");
+  }
+  expr_ptr call = functionCall();
+  if (!dynamic_cast<FunctionCall *>(call.get())) {
+    error("Expected a function call after 'spawn'");
+  }
+  match(Tag::SEMICOLON, NO_SEMICOLON);
+  return std::make_unique<SpawnStatement>(
+      std::move(target),
+      std::unique_ptr<FunctionCall>(
+          static_cast<FunctionCall *>(call.release())),
+      definition);
+}
+
 expr_ptr Parser::expression() {
   expr_ptr lhs = term();
   while (peek.tag == Tag::PLUS || peek.tag == Tag::MINUS) {
@@ -184,9 +697,21 @@ expr_ptr Parser::factor() {
   if (peek.tag == Tag::MINUS || peek.tag == Tag::PLUS) {
     Token op = std::move(peek);
     next();
-    return std::make_unique<UnaryOperation>(std::move(op), unary());
+    return std::make_unique<UnaryOperation>(std::move(op), power());
   }
-  return unary();
+  return power();
+}
+
+// Exponent is a factor, so the operator is right-associative
+expr_ptr Parser::power() {
+  expr_ptr base = unary();
+  if (peek.tag != Tag::POWER) {
+    return base;
+  }
+  Token op = std::move(peek);
+  next();
+  return std::make_unique<BinaryOperation>(std::move(base), std::move(op),
+                                           factor());
 }
 
 expr_ptr Parser::unary() {
@@ -210,6 +735,7 @@ expr_ptr Parser::unary() {
   case Tag::I:
   case Tag::RE:
   case Tag::IM:
+  case Tag::CONJ:
     expr = functionCall();
     break;
   case Tag::OPEN_BRACKET:
@@ -217,6 +743,18 @@ expr_ptr Parser::unary() {
     expr = expression();
     match(Tag::CLOSE_BRACKET, NO_CLOSING_BRACKET);
     break;
+  case Tag::TYPE: {
+    const TypeID type = token.getType();
+    next();
+    if ((type != TypeID::VEC2D && type != TypeID::VEC4D &&
+         type != TypeID::VEC8F) ||
+        peek.tag != Tag::OPEN_BRACKET) {
+      error("Unexpected syntax");
+    }
+    std::vector<expr_ptr> lanes = arguments("vector");
+    expr = std::make_unique<Vector>(std::move(token), lanes);
+    break;
+  }
   case Tag::VERTICAL:
     next();
     expr = expression();
@@ -233,28 +771,65 @@ expr_ptr Parser::unary() {
   return expr;
 }
 
-expr_ptr Parser::functionCall() {
-  id_ptr res = std::make_unique<Identifier>(std::move(peek), TypeID::NONE);
-  next();
-  if (peek.tag != Tag::OPEN_BRACKET) {
-    return res;
-  }
-  next();
+std::vector<expr_ptr> Parser::arguments(const std::string &name) {
+  next(); // '('
   std::vector<expr_ptr> args;
   while (peek.tag != Tag::CLOSE_BRACKET) {
     args.push_back(expression());
     if (peek.tag == Tag::COMMA) {
       next();
       if (peek.tag == Tag::CLOSE_BRACKET) {
-        warning("Comma with no argument after in call to " +
-                res->token.getString());
+        warning("Comma with no argument after in call to " + name);
       }
     }
   }
   next(); // ')'
+  return args;
+}
+
+bool Parser::builtin(const std::string &name) const {
+  return BuiltinCall::isBuiltin(name) && name != function &&
+         !Node::module->getFunction(name) && !Node::symbols.getGeneric(name);
+}
+
+expr_ptr Parser::functionCall() {
+  id_ptr res = std::make_unique<Identifier>(std::move(peek), TypeID::NONE);
+  next();
+  if (peek.tag == Tag::OPEN_SQUARE) {
+    return element(std::move(res->token));
+  }
+  if (peek.tag != Tag::OPEN_BRACKET) {
+    return res;
+  }
+  std::vector<expr_ptr> args = arguments(res->token.getString());
+  if (builtin(res->token.getString())) {
+    return std::make_unique<BuiltinCall>(std::move(res->token), args);
+  }
   return std::make_unique<FunctionCall>(std::move(res->token), args);
 }
 
+expr_ptr Parser::index() {
+  next(); // '['
+  expr_ptr expr = expression();
+  match(Tag::CLOSE_SQUARE, NO_CLOSING_SQUARE_BRACKET);
+  return expr;
+}
+
+std::unique_ptr<Index> Parser::element(Token name) {
+  expr_ptr i = index();
+  std::string field;
+  if (peek.tag == Tag::DOT) {
+    next();
+    if (peek.tag != Tag::ID) {
+      error("Expected a field after '.'");
+    }
+    field = peek.getString();
+    next();
+  }
+  return std::make_unique<Index>(std::move(name), std::move(i),
+                                 std::move(field));
+}
+
 expr_ptr Parser::conditional() {
   expr_ptr lhs = conjunction();
   while (peek.tag == Tag::OR) {
@@ -301,19 +876,54 @@ expr_ptr Parser::relation() {
                                     std::move(rhs));
 }
 
-Parser::Parser(Lexer &lexer_) : lexer(lexer_), peek(Tag::END, -1) {
+Parser::Parser(Lexer &lexer_)
+    : lexer(lexer_), peek(Tag::END, -1), tailRecursive(false), replayed(0) {
+  // Code generation which failed might have left the builder in a function
+  Node::builder.ClearInsertionPoint();
   Node::module = std::make_unique<llvm::Module>("", Node::context);
   Node::symbols = SymbolTable();
+  Node::interpreter = Interpreter();
+  next();
+}
+
+Parser::Parser(Lexer &lexer_, std::vector<Token> tokens_,
+               std::unordered_set<std::string> structs_,
+               std::unordered_map<std::string, TypeID> typeArguments_)
+    : lexer(lexer_), peek(Tag::END, -1), tailRecursive(false),
+      structs(std::move(structs_)), tokens(std::move(tokens_)), replayed(0),
+      typeArguments(std::move(typeArguments_)) {
   next();
 }
 
 stmt_ptr Parser::parseNext() {
+  std::vector<Annotation> annotations = annotationList();
+  if (!annotations.empty() && peek.tag != Tag::EXPORT &&
+      peek.tag != Tag::FUN && peek.tag != Tag::STRUCT) {
+    error("Expected a function or a struct after annotations");
+  }
+
   switch (peek.tag) {
+  case Tag::STRUCT:
+    return structDefinition(annotations);
+  case Tag::ID:
+    if (structs.count(peek.getString())) {
+      return variableDefiniton();
+    }
+    error("Expected variable or function definition");
+    break;
+  case Tag::CONST:
   case Tag::TYPE:
     return variableDefiniton();
+  case Tag::EXPORT:
+    next();
+    if (peek.tag != Tag::FUN) {
+      error("Expected a function after export");
+    }
+    next();
+    return functionDefinition(true, annotations);
   case Tag::FUN:
     next();
-    return functionDefinition();
+    return functionDefinition(false, annotations);
   default:
     error("Expected variable or function definition");
   }
@@ -322,8 +932,17 @@ stmt_ptr Parser::parseNext() {
 
 void Parser::parse() {
   while (peek.tag != Tag::END) {
-    stmt_ptr stmt = parseNext();
-    stmt->generate();
+    program.push_back(parseNext());
+    program.back()->generate();
+  }
+  // Prototypes which were not defined are functions of other modules
+  for (FunctionDeclaration *prototype : Node::symbols.prototypes()) {
+    prototype->lower();
+  }
+  // Memo functions may call functions defined after them
+  for (FunctionDefinition *memo : Node::symbols.memos()) {
+    memo->checkPurity();
   }
   Node::initGlobals();
+  inferAttributes(*Node::module);
 }
\ No newline at end of file
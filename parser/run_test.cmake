@@ -1,4 +1,7 @@
-execute_process(COMMAND ${COMPILER_BIN} ${TESTS_DIR}/${TEST} -o test.ll RESULT_VARIABLE COMPILER_RESULT)
+separate_arguments(FLAGS UNIX_COMMAND "${FLAGS}")
+# Profiles of earlier runs would add up with the one of this run
+file(REMOVE test.profile)
+execute_process(COMMAND ${COMPILER_BIN} ${TESTS_DIR}/${TEST} ${FLAGS} -o test.ll RESULT_VARIABLE COMPILER_RESULT)
 if (COMPILER_RESULT)
     message(FATAL_ERROR "compiler error!")
 endif()
@@ -8,10 +11,17 @@ if (LLC_RESULT)
     message(FATAL_ERROR "llc error!")
 endif()
 
-execute_process(COMMAND ${COMPILER} ${TESTS_DIR}/print.c test.s -o test.exe -no-pie
+execute_process(COMMAND ${COMPILER} ${TESTS_DIR}/print.c test.s ${RUNTIME} -o test.exe -no-pie
+    -lstdc++ -lpthread -lm
     RESULT_VARIABLE COMPILATION_RESULT)
 if (COMPILATION_RESULT)
     message(FATAL_ERROR "compilation error!")
 endif()
 
-execute_process(COMMAND ${CMAKE_BINARY_DIR}/test.exe)
\ No newline at end of file
+execute_process(COMMAND ${CMAKE_BINARY_DIR}/test.exe)
+
+# The profile is checked along with the output of the program
+if (EXISTS test.profile)
+    file(READ test.profile PROFILE)
+    message("${PROFILE}")
+endif()
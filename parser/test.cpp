@@ -1,5 +1,6 @@
 #include "parser.h"
 #include "gtest/gtest.h"
+#include "llvm/IR/InstIterator.h"
 
 stmt_ptr parse(const std::string &input) {
   std::stringstream ss(input);
@@ -9,6 +10,14 @@ stmt_ptr parse(const std::string &input) {
   return parser.parseNext();
 }
 
+// Parses and generates a whole program
+void parseProgram(const std::string &input) {
+  std::stringstream ss(input);
+  Lexer lexer(ss);
+  Parser parser(lexer);
+  parser.parse();
+}
+
 TEST(parser_test, arithmetic) {
   std::string in = "fun main : int() { \
     int a = -1 + 2 * 3; \
@@ -201,4 +210,1356 @@ TEST(codegen_test, undeclared_function) {
   }");
   stmt_ptr stmt = parse(in);
   EXPECT_THROW(stmt->generate(), CodeGenError);
-}
\ No newline at end of file
+}
+
+TEST(codegen_test, constant_evaluation) {
+  parseProgram("fun fib :int (n :int) {\
+    if (n < 2) { return n; }\
+    return fib(n - 1) + fib(n - 2);\
+  }\
+  fun main :int () {\
+    return fib(20);\
+  }");
+
+  llvm::Function *main = Node::module->getFunction("main");
+  auto ret = llvm::dyn_cast<llvm::ReturnInst>(
+      main->getEntryBlock().getTerminator());
+  ASSERT_NE(ret, nullptr);
+
+  auto value = llvm::dyn_cast<llvm::ConstantInt>(ret->getReturnValue());
+  ASSERT_NE(value, nullptr);
+  EXPECT_EQ(value->getSExtValue(), 6765);
+}
+
+TEST(codegen_test, constant_evaluation_budget) {
+  // Each call site alone could use up the fuel of an evaluation
+  std::string in = "fun spin :int (n :int) {\
+    while (n > 0) { n = n + 1; }\
+    return n;\
+  }\
+  fun main :int () { int res = 0;";
+  for (int i = 0; i < 100; ++i) {
+    in += "res = res + spin(" + std::to_string(i % 50 + 1) + ");";
+  }
+  in += "return res; }";
+  parseProgram(in);
+
+  size_t calls = 0;
+  for (auto &inst : llvm::instructions(Node::module->getFunction("main"))) {
+    calls += llvm::isa<llvm::CallInst>(&inst);
+  }
+  EXPECT_EQ(calls, 100);
+}
+
+TEST(codegen_test, static_initializers) {
+  parseProgram("int a = 2 * 21;\
+  fun f :int () { a = a + 1; return a; }\
+  int b = f();\
+  fun main :int () { return a + b; }");
+
+  auto a = llvm::dyn_cast<llvm::ConstantInt>(
+      Node::module->getGlobalVariable("a", true)->getInitializer());
+  ASSERT_NE(a, nullptr);
+  EXPECT_EQ(a->getSExtValue(), 42);
+  EXPECT_NE(Node::module->getFunction("globals.init"), nullptr);
+}
+
+TEST(codegen_test, forward_initializers) {
+  parseProgram("int a = b + 1;\
+  int b = c + 1;\
+  int c = d + 1;\
+  int d = 1;\
+  fun main :int () { return a; }");
+
+  // Each global is evaluated after the ones it refers to
+  for (auto expected : {std::make_pair("a", 4), std::make_pair("b", 3),
+                        std::make_pair("c", 2)}) {
+    auto init = llvm::dyn_cast<llvm::ConstantInt>(
+        Node::module->getGlobalVariable(expected.first, true)
+            ->getInitializer());
+    ASSERT_NE(init, nullptr) << expected.first;
+    EXPECT_EQ(init->getSExtValue(), expected.second) << expected.first;
+  }
+  EXPECT_EQ(Node::module->getFunction("globals.init"), nullptr);
+}
+
+TEST(codegen_test, initializer_order) {
+  parseProgram("int seed = 0;\
+  fun next :int () { seed = seed + 1; return seed; }\
+  int a = b * 2;\
+  int b = next();\
+  int c = twice();\
+  int d = next();\
+  fun twice :int () { return d * 2; }\
+  fun main :int () { return 0; }");
+
+  // Globals read by an initializer, also through calls, are set before it
+  std::vector<std::string> order;
+  llvm::Function *init = Node::module->getFunction("globals.init");
+  ASSERT_NE(init, nullptr);
+  for (auto &inst : init->front()) {
+    if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+      order.push_back(call->getCalledFunction()->getName().str());
+    }
+  }
+  EXPECT_EQ(order, (std::vector<std::string>{"b.init", "a.init", "d.init",
+                                             "c.init"}));
+
+  // Initializers which depend on each other run in definition order, and
+  // one reading its own global through a call does not depend on itself
+  auto initOrder = [](const char *in) {
+    parseProgram(in);
+    std::vector<std::string> order;
+    for (auto &inst : Node::module->getFunction("globals.init")->front()) {
+      if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+        order.push_back(call->getCalledFunction()->getName().str());
+      }
+    }
+    return order;
+  };
+  EXPECT_EQ(initOrder("fun next :int () { return 1; }\
+                       int a = b + next(); int b = a + next();\
+                       fun main :int () { return 0; }"),
+            (std::vector<std::string>{"a.init", "b.init"}));
+  EXPECT_EQ(initOrder("fun next :int () { return 1; }\
+                       int a = a + next();\
+                       fun main :int () { return 0; }"),
+            (std::vector<std::string>{"a.init"}));
+
+  // An initializer writing a global is not moved before an earlier one
+  // reading it
+  EXPECT_EQ(initOrder("int counter = 10;\
+                       fun next :int () { counter = counter + 1; return 1; }\
+                       int a = b + 1;\
+                       int r = counter;\
+                       int b = next();\
+                       fun main :int () { return 0; }"),
+            (std::vector<std::string>{"r.init", "b.init", "a.init"}));
+}
+
+TEST(codegen_test, constant_assignment) {
+  std::string in("fun main :int () {\
+    const int a = 1;\
+    a = 2;\
+    return a;\
+  }");
+  stmt_ptr stmt = parse(in);
+  EXPECT_THROW(stmt->generate(), CodeGenError);
+}
+
+TEST(codegen_test, constant_global) {
+  parseProgram("const int a = 6 * 7;\
+  fun main :int () { return a; }");
+
+  llvm::GlobalVariable *a = Node::module->getGlobalVariable("a", true);
+  EXPECT_TRUE(a->isConstant());
+  auto init = llvm::dyn_cast<llvm::ConstantInt>(a->getInitializer());
+  ASSERT_NE(init, nullptr);
+  EXPECT_EQ(init->getSExtValue(), 42);
+}
+
+TEST(codegen_test, function_attributes) {
+  parseProgram("fun printi :int (i :int);\
+  int calls = 0;\
+  fun square :int (n :int) { return n * n; }\
+  fun fib :int (n :int) {\
+    if (n < 2) { return n; }\
+    return fib(n - 1) + fib(n - 2);\
+  }\
+  fun count :int () { return calls; }\
+  export fun print :int (n :int) { return printi(square(n)); }\
+  fun main :int () { return print(fib(count())); }");
+
+  llvm::Function *square = Node::module->getFunction("square"),
+                 *fib = Node::module->getFunction("fib"),
+                 *count = Node::module->getFunction("count"),
+                 *print = Node::module->getFunction("print"),
+                 *main = Node::module->getFunction("main");
+
+  EXPECT_TRUE(square->hasInternalLinkage());
+  EXPECT_TRUE(print->hasExternalLinkage());
+  EXPECT_TRUE(main->hasExternalLinkage());
+
+  EXPECT_TRUE(square->doesNotAccessMemory());
+  EXPECT_TRUE(square->doesNotRecurse());
+  EXPECT_TRUE(square->willReturn());
+
+  EXPECT_TRUE(fib->doesNotAccessMemory());
+  EXPECT_TRUE(fib->doesNotThrow());
+  EXPECT_FALSE(fib->doesNotRecurse());
+  EXPECT_FALSE(fib->willReturn());
+
+  EXPECT_TRUE(count->onlyReadsMemory());
+  EXPECT_FALSE(count->doesNotAccessMemory());
+
+  EXPECT_FALSE(print->onlyReadsMemory());
+  EXPECT_FALSE(print->doesNotThrow());
+}
+
+TEST(codegen_test, exported_prototype) {
+  parseProgram("export fun f :int (n :int);\
+  fun g :int (n :int);\
+  fun f :int (n :int) { return n + 1; }\
+  export fun g :int (n :int) { return n + 2; }\
+  fun main :int () { return 0; }");
+
+  EXPECT_TRUE(Node::module->getFunction("f")->hasExternalLinkage());
+  EXPECT_TRUE(Node::module->getFunction("g")->hasExternalLinkage());
+}
+
+TEST(codegen_test, fast_math) {
+  parseProgram("@fastmath fun fast :double (a :double, b :double) {\
+    return a * b + a;\
+  }\
+  fun strict :double (a :double, b :double) { return a * b + a; }\
+  fun main :int () { return 0; }");
+
+  auto ret = [](const char *name) {
+    llvm::Function *func = Node::module->getFunction(name);
+    auto ret = llvm::cast<llvm::ReturnInst>(func->back().getTerminator());
+    return llvm::cast<llvm::Instruction>(ret->getReturnValue());
+  };
+  EXPECT_TRUE(ret("fast")->isFast());
+  EXPECT_FALSE(ret("strict")->getFastMathFlags().any());
+}
+
+TEST(parser_test, unknown_annotation) {
+  std::string in("@fast fun main :int () { return 0; }");
+  stmt_ptr stmt = parse(in);
+  EXPECT_THROW(stmt->generate(), CodeGenError);
+}
+
+TEST(codegen_test, ssa_construction) {
+  parseProgram("fun sum :int (n :int) {\
+    int i = 0;\
+    int s = 0;\
+    while (i < n) {\
+      if (i > 2) { s = s + i; }\
+      i = i + 1;\
+    }\
+    return s;\
+  }\
+  fun main :int () { return 0; }");
+
+  int phis = 0;
+  for (auto &block : *Node::module->getFunction("sum")) {
+    for (auto &inst : block) {
+      EXPECT_FALSE(llvm::isa<llvm::AllocaInst>(inst));
+      EXPECT_FALSE(llvm::isa<llvm::LoadInst>(inst));
+      phis += llvm::isa<llvm::PHINode>(inst);
+    }
+  }
+  // i and s in the loop header and s after the if statement
+  EXPECT_EQ(phis, 3);
+}
+
+TEST(codegen_test, ssa_trivial_phis) {
+  // Removing the phis of a in the nested loop headers cascades outwards
+  parseProgram("fun untouched :int (n :int) {\
+    int a = 7;\
+    while (n < 3) {\
+      while (n < 2) {\
+        while (n < 1) { n = n + 1; }\
+        if (n > 2) { break; }\
+      }\
+    }\
+    return a;\
+  }\
+  fun main :int () { return 0; }");
+
+  llvm::Function *untouched = Node::module->getFunction("untouched");
+  ASSERT_NE(untouched, nullptr);
+  EXPECT_FALSE(llvm::verifyFunction(*untouched, &llvm::errs()));
+  auto ret = llvm::cast<llvm::ReturnInst>(untouched->back().getTerminator());
+  auto value = llvm::dyn_cast<llvm::ConstantInt>(ret->getReturnValue());
+  ASSERT_NE(value, nullptr);
+  EXPECT_EQ(value->getSExtValue(), 7);
+}
+
+TEST(codegen_test, math_builtins) {
+  parseProgram("fun real :double (x :double) {\
+    return sqrt(x) + exp(x) + sin(x) + cos(x) + pow(x, 3) + fma(x, x, 1) +\
+      min(x, 1) + max(x, 2);\
+  }\
+  fun cplx :complex (z :complex) { return sqrt(z) + exp(z) + arg(z); }\
+  fun main :int () { return 0; }");
+
+  for (const char *name : {"sqrt", "exp", "sin", "cos", "pow", "fma",
+                           "minnum", "maxnum"}) {
+    EXPECT_NE(Node::module->getFunction(std::string("llvm.") + name + ".f64"),
+              nullptr);
+    EXPECT_EQ(Node::module->getFunction(name), nullptr);
+  }
+
+  // Complex overloads are inlined, only atan2 has no intrinsic
+  for (auto &block : *Node::module->getFunction("cplx")) {
+    for (auto &inst : block) {
+      if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+        llvm::Function *callee = call->getCalledFunction();
+        EXPECT_TRUE(callee->isIntrinsic() || callee->getName() == "atan2");
+      }
+    }
+  }
+  EXPECT_TRUE(Node::module->getFunction("atan2")->doesNotAccessMemory());
+}
+
+TEST(codegen_test, builtin_shadowing) {
+  parseProgram("fun root :double (x :double) { return sqrt(x); }\
+  fun sqrt :double (x :double);\
+  fun len<T> :T (x :T) { return x; }\
+  fun f :int (n :int) { double r = sqrt(2.0) + root(n); return len(n); }\
+  fun main :int () { return 0; }");
+
+  // Calls before a function of the program with the name stay built in
+  std::vector<std::string> callees;
+  for (const char *name : {"root", "f"}) {
+    for (auto &inst : llvm::instructions(Node::module->getFunction(name))) {
+      if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+        callees.push_back(call->getCalledFunction()->getName().str());
+      }
+    }
+  }
+  EXPECT_EQ(callees, (std::vector<std::string>{"llvm.sqrt.f64", "sqrt", "root",
+                                               "len<int>"}));
+}
+
+TEST(codegen_test, complex_c_abi) {
+  parseProgram("fun cexp :complex (z :complex);\
+  fun spill :int (a :double, b :double, c :double, d :double, e :double,\
+    f :double, g :double, z :complex, h :double);\
+  fun main :int () { return 0; }");
+
+  llvm::Function *cexp = Node::module->getFunction("cexp");
+  EXPECT_EQ(cexp->arg_size(), 2);
+  EXPECT_EQ(cexp->getArg(0)->getType(), Node::doubleType);
+  EXPECT_EQ(cexp->getReturnType(), Node::complexStruct);
+
+  llvm::Function *spill = Node::module->getFunction("spill");
+  EXPECT_EQ(spill->arg_size(), 9);
+  EXPECT_TRUE(spill->getArg(7)->hasByValAttr());
+  EXPECT_EQ(spill->getArg(8)->getType(), Node::doubleType);
+}
+
+TEST(codegen_test, forward_complex_declaration) {
+  parseProgram("fun twice :double (z :complex);\
+  fun cabs :double (z :complex);\
+  fun sum :double (z :complex) { return twice(z) + cabs(z); }\
+  fun twice :double (z :complex) { return Re(z) * 2; }\
+  fun main :int () { return 0; }");
+
+  // Only the prototype without a definition follows the C ABI
+  llvm::Function *twice = Node::module->getFunction("twice");
+  EXPECT_FALSE(twice->isDeclaration());
+  EXPECT_TRUE(twice->hasInternalLinkage());
+  EXPECT_EQ(twice->arg_size(), 1);
+  EXPECT_EQ(twice->getArg(0)->getType(), Node::complexStruct);
+
+  llvm::Function *cabs = Node::module->getFunction("cabs");
+  EXPECT_TRUE(cabs->isDeclaration());
+  EXPECT_EQ(cabs->arg_size(), 2);
+  for (auto &block : *Node::module->getFunction("sum")) {
+    for (auto &inst : block) {
+      if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+        EXPECT_EQ(call->arg_size(), call->getCalledFunction()->arg_size());
+      }
+    }
+  }
+  EXPECT_FALSE(llvm::verifyModule(*Node::module, &llvm::errs()));
+}
+
+TEST(parser_test, power) {
+  std::string in("int a = -2 ^ 3 ^ 2;");
+  stmt_ptr parseTree = parse(in);
+  auto a = dynamic_cast<VariableDefinition *>(parseTree.get());
+  ASSERT_NE(a, nullptr);
+
+  // Exponentiation binds tighter than the sign and groups to the right
+  auto sign = dynamic_cast<UnaryOperation *>(a->expression.get());
+  ASSERT_NE(sign, nullptr);
+  auto top = dynamic_cast<BinaryOperation *>(sign->expression.get());
+  ASSERT_NE(top, nullptr);
+  EXPECT_EQ(top->token.tag, Tag::POWER);
+  EXPECT_NE(dynamic_cast<Constant *>(top->lhs.get()), nullptr);
+  auto right = dynamic_cast<BinaryOperation *>(top->rhs.get());
+  ASSERT_NE(right, nullptr);
+  EXPECT_EQ(right->token.tag, Tag::POWER);
+}
+
+TEST(codegen_test, power) {
+  EXPECT_EQ(BinaryOperation::chain(1).size(), 0);
+  EXPECT_EQ(BinaryOperation::chain(15).size(), 5);
+  EXPECT_EQ(BinaryOperation::chain(127).size(), 10);
+  EXPECT_EQ(BinaryOperation::chain(1000).size(), 14);
+  EXPECT_EQ(BinaryOperation::chain(1u << 20).size(), 20);
+
+  parseProgram("fun constant :double (x :double) { return x ^ 15; }\
+  fun runtime :int (x :int, n :int) { return x ^ n; }\
+  fun real :double (x :double, y :double) { return x ^ y; }\
+  fun main :int () { return 0; }");
+
+  unsigned multiplications = 0;
+  for (auto &inst : Node::module->getFunction("constant")->getEntryBlock()) {
+    multiplications += inst.getOpcode() == llvm::Instruction::FMul;
+  }
+  EXPECT_EQ(multiplications, 5);
+  llvm::Function *helper = Node::module->getFunction("power.int");
+  ASSERT_NE(helper, nullptr);
+  EXPECT_TRUE(helper->hasInternalLinkage());
+  EXPECT_NE(Node::module->getFunction("llvm.pow.f64"), nullptr);
+}
+
+TEST(parser_test, for_loop) {
+  std::string in("fun f :int () {\
+    @unroll(2) for i = 10 to 1 step -2 { continue; }\
+    return 0;\
+  }");
+  stmt_ptr parseTree = parse(in);
+  auto func = dynamic_cast<FunctionDefinition *>(parseTree.get());
+  ASSERT_NE(func, nullptr);
+  auto block = dynamic_cast<Sequence *>(func->block.get());
+  auto loop = dynamic_cast<ForStatement *>(block->statements[0].get());
+  ASSERT_NE(loop, nullptr);
+  EXPECT_EQ(loop->counter->token.getString(), "i");
+  EXPECT_EQ(loop->step, -2);
+  ASSERT_EQ(loop->annotations.size(), 1);
+  EXPECT_EQ(loop->annotations[0].arguments, std::vector<int64_t>{2});
+
+  EXPECT_THROW(parse("fun f :int () { for i = 1 to 2 step 0 { } return 0; }"),
+               ParserError);
+}
+
+TEST(codegen_test, loops) {
+  for (const char *in :
+       {"fun outside :int () { break; return 0; }",
+        "fun counter :int () { for i = 1 to 2 { i = 0; } return 0; }",
+        "fun count :int () { @unroll for i = 1 to 2 { } return 0; }",
+        "fun fast :int () { @fastmath while (1 == 1) { } return 0; }"}) {
+    stmt_ptr stmt = parse(in);
+    EXPECT_THROW(stmt->generate(), CodeGenError);
+  }
+
+  parseProgram("fun f :double (n :int) {\
+    double sum = 0;\
+    @unroll(4) @vectorize(8) for i = 1 to n step 2 {\
+      if (i > 100) { break; }\
+      sum = sum + 1.0 / i;\
+    }\
+    return sum;\
+  }\
+  fun main :int () { return 0; }");
+
+  std::vector<llvm::MDNode *> loops;
+  for (auto &block : *Node::module->getFunction("f")) {
+    if (auto loop = block.getTerminator()->getMetadata("llvm.loop")) {
+      loops.push_back(loop);
+    }
+  }
+  ASSERT_EQ(loops.size(), 1);
+  EXPECT_EQ(loops[0]->getOperand(0), loops[0]);
+  std::vector<std::string> hints;
+  for (unsigned i = 1; i < loops[0]->getNumOperands(); ++i) {
+    auto hint = llvm::cast<llvm::MDNode>(loops[0]->getOperand(i));
+    hints.push_back(llvm::cast<llvm::MDString>(hint->getOperand(0))
+                        ->getString()
+                        .str());
+  }
+  EXPECT_EQ(hints,
+            (std::vector<std::string>{"llvm.loop.unroll.count",
+                                      "llvm.loop.vectorize.width",
+                                      "llvm.loop.vectorize.enable"}));
+}
+
+TEST(parser_test, parallel_for) {
+  stmt_ptr parseTree = parse("fun f :int (n :int) {\
+    int s = 0; int m = 0;\
+    @dynamic(8) parallel for i = 1 to n reduce(+: s, max: m) { }\
+    return s;\
+  }");
+  auto func = dynamic_cast<FunctionDefinition *>(parseTree.get());
+  ASSERT_NE(func, nullptr);
+  auto block = dynamic_cast<Sequence *>(func->block.get());
+  auto loop = dynamic_cast<ForStatement *>(block->statements[2].get());
+  ASSERT_NE(loop, nullptr);
+  EXPECT_TRUE(loop->parallel);
+  ASSERT_EQ(loop->reductions.size(), 2);
+  EXPECT_EQ(loop->reductions[0].first.tag, Tag::PLUS);
+  EXPECT_EQ(loop->reductions[1].first.getString(), "max");
+  EXPECT_EQ(loop->reductions[1].second->token.getString(), "m");
+
+  for (const char *in :
+       {"fun f :int () { parallel while (1 == 1) { } return 0; }",
+        "fun f :int () { for i = 1 to 2 reduce(+: s) { } return 0; }",
+        "fun f :int () { parallel for i = 1 to 2 reduce() { } return 0; }",
+        "fun f :int () { parallel for i = 1 to 2 reduce(-: s) { }\
+           return 0; }"}) {
+    EXPECT_THROW(parse(in), ParserError);
+  }
+}
+
+TEST(codegen_test, parallel_for) {
+  for (const char *in : {
+           "fun assigned :int () {\
+              int s = 0; parallel for i = 1 to 9 { s = i; } return s; }",
+           "fun broken :int () {\
+              parallel for i = 1 to 9 { break; } return 0; }",
+           "fun returned :int () {\
+              parallel for i = 1 to 9 { return i; } return 0; }",
+           "fun complexMin :int () { complex z = 0;\
+              parallel for i = 1 to 9 reduce(min: z) { } return 0; }",
+           "fun reducedTwice :int () { int s = 0;\
+              parallel for i = 1 to 9 reduce(+: s, *: s) { } return 0; }",
+           "fun chunk :int () {\
+              @dynamic(0) parallel for i = 1 to 9 { } return 0; }"}) {
+    stmt_ptr stmt = parse(in);
+    EXPECT_THROW(stmt->generate(), CodeGenError);
+  }
+
+  parseProgram("fun f :int (n :int) {\
+    int s = 0;\
+    parallel for i = 1 to n reduce(+: s) { s = s + i * n; }\
+    return s;\
+  }\
+  fun main :int () { return 0; }");
+
+  llvm::Function *body = Node::module->getFunction("f.parallel");
+  ASSERT_NE(body, nullptr);
+  EXPECT_TRUE(body->hasInternalLinkage());
+  EXPECT_EQ(body->arg_size(), 3);
+  EXPECT_NE(Node::module->getFunction("ps_parallel_for"), nullptr);
+  EXPECT_NE(Node::module->getFunction("ps_reduce_int"), nullptr);
+}
+
+TEST(codegen_test, parallel_for_global) {
+  // Globals are shared by the threads, only reductions are private
+  for (const char *in : {
+           "int counter = 0;\
+            fun main :int () {\
+              parallel for i = 1 to 9 { counter = counter + 1; } return 0; }",
+           "int counter = 0;\
+            fun f :int (n :int) { return n; }\
+            fun main :int () {\
+              parallel for i = 1 to 9 {\
+                for j = 1 to 2 { counter = spawn f(j); sync; }\
+              }\
+              return 0;\
+            }"}) {
+    EXPECT_THROW(parseProgram(in), CodeGenError) << in;
+  }
+
+  EXPECT_NO_THROW(parseProgram("int counter = 0;\
+  fun main :int () {\
+    int total = 0;\
+    parallel for i = 1 to 9 reduce(+: total) { total = total + counter; }\
+    counter = total;\
+    return 0;\
+  }"));
+}
+
+TEST(parser_test, spawn) {
+  stmt_ptr parseTree = parse("fun f :int (n :int) {\
+    int a = spawn f(n - 1);\
+    a = spawn f(n - 2);\
+    sync;\
+    return a;\
+  }");
+  auto func = dynamic_cast<FunctionDefinition *>(parseTree.get());
+  ASSERT_NE(func, nullptr);
+  auto block = dynamic_cast<Sequence *>(func->block.get());
+  auto definition = dynamic_cast<SpawnStatement *>(block->statements[0].get());
+  ASSERT_NE(definition, nullptr);
+  EXPECT_TRUE(definition->definition);
+  EXPECT_EQ(definition->identifier->type, TypeID::INT);
+  EXPECT_EQ(definition->call->token.getString(), "f");
+  auto assignment = dynamic_cast<SpawnStatement *>(block->statements[1].get());
+  ASSERT_NE(assignment, nullptr);
+  EXPECT_FALSE(assignment->definition);
+  EXPECT_NE(dynamic_cast<SyncStatement *>(block->statements[2].get()),
+            nullptr);
+
+  for (const char *in : {"fun f :int () { const int a = spawn f(); }",
+                         "fun f :int () { int a = spawn sqrt(2); }",
+                         "fun f :int () { int a = spawn 1 + f(); }",
+                         "fun f :int () { int a = spawn f; }"}) {
+    EXPECT_THROW(parse(in), ParserError);
+  }
+}
+
+TEST(codegen_test, spawn) {
+  for (const char *in : {
+           "fun readBeforeSync :int (n :int) {\
+              int a = spawn readBeforeSync(n); return a; }",
+           "fun assignedBeforeSync :int (n :int) {\
+              int a = spawn assignedBeforeSync(n); a = 1; sync; return a; }",
+           "fun wrongType :int (n :int) {\
+              double a = spawn wrongType(n); sync; return 0; }",
+           "fun external :int (n :int) {\
+              int a = spawn printi(n); sync; return 0; }",
+           "fun parallelBeforeSync :int (n :int) {\
+              int a = spawn parallelBeforeSync(n);\
+              parallel for i = 1 to n { } sync; return a; }"}) {
+    stmt_ptr stmt = parse(in);
+    EXPECT_THROW(stmt->generate(), CodeGenError);
+  }
+
+  parseProgram("fun f :int (n :int) {\
+    if (n < 2) { return n; }\
+    int a = spawn f(n - 1);\
+    int b = spawn f(n - 2);\
+    sync;\
+    return a + b;\
+  }\
+  fun main :int () { return 0; }");
+
+  // Both calls are tasks, their results are read after the sync
+  llvm::Function *func = Node::module->getFunction("f");
+  std::vector<std::string> calls;
+  for (auto &block : *func) {
+    for (auto &inst : block) {
+      if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+        calls.push_back(call->getCalledFunction()->getName().str());
+      }
+    }
+  }
+  EXPECT_EQ(calls,
+            (std::vector<std::string>{"ps_spawn", "ps_spawn", "ps_sync"}));
+  EXPECT_NE(Node::module->getFunction("f.task"), nullptr);
+}
+
+TEST(parser_test, arrays) {
+  stmt_ptr parseTree = parse("fun f :int (n :int) {\
+    double[n + 1] a = 0;\
+    a[n] = a[0] + 1;\
+    return 0;\
+  }");
+  auto func = dynamic_cast<FunctionDefinition *>(parseTree.get());
+  ASSERT_NE(func, nullptr);
+  auto block = dynamic_cast<Sequence *>(func->block.get());
+  auto definition =
+      dynamic_cast<ArrayDefinition *>(block->statements[0].get());
+  ASSERT_NE(definition, nullptr);
+  EXPECT_EQ(definition->identifier->type, TypeID::DOUBLE);
+  EXPECT_NE(dynamic_cast<BinaryOperation *>(definition->length.get()),
+            nullptr);
+  auto assignment =
+      dynamic_cast<ElementAssignment *>(block->statements[1].get());
+  ASSERT_NE(assignment, nullptr);
+  EXPECT_EQ(assignment->element->token.getString(), "a");
+  auto sum = dynamic_cast<BinaryOperation *>(assignment->expression.get());
+  ASSERT_NE(sum, nullptr);
+  EXPECT_NE(dynamic_cast<Index *>(sum->lhs.get()), nullptr);
+
+  for (const char *in : {"fun f :int () { const int[2] a = 0; }",
+                         "fun f :int () { int[2 a = 0; }",
+                         "fun f :int () { int[2] a; }",
+                         "fun f :int () { int[2] a = 0; a[1 = 2; }",
+                         "fun f :int () { int[2] a = spawn f(); }"}) {
+    EXPECT_THROW(parse(in), ParserError);
+  }
+}
+
+TEST(codegen_test, arrays) {
+  for (const char *in : {
+           "fun f :int () { int[2] a = 0; return a[2]; }",
+           "fun f :int () { int[2] a = 0; return a[-1]; }",
+           "fun f :int () { int[2] a = 0; return a[0.5]; }",
+           "fun f :int () { int[-1] a = 0; return 0; }",
+           "fun f :int () { string[2] a = \"\"; return 0; }",
+           "fun f :int () { int[2] a = 0; return a; }",
+           "fun f :int () { int[2] a = 0; a = 1; return 0; }",
+           "fun f :int () { int a = 0; return a[0]; }",
+           "fun f :int (n :int) { int[2] a = 0; return f(a); }",
+           "int[printi(2)] a = 0;", "double[2] a = printd(1);"}) {
+    std::stringstream ss(std::string("fun printi :int (i :int);\
+      fun printd :int (d :double);") + in);
+    Lexer lexer(ss);
+    Parser parser(lexer);
+    EXPECT_THROW(
+        {
+          parser.parseNext()->generate();
+          parser.parseNext()->generate();
+          parser.parseNext()->generate();
+        },
+        CodeGenError);
+  }
+
+  parseProgram("fun checked :int (n :int, k :int) {\
+    int[n] a = 0;\
+    return a[k];\
+  }\
+  fun inBounds :int (n :int) {\
+    int[n] a = 0;\
+    for i = 1 to n - 1 { a[i] = a[i - 1] + i; }\
+    int[8] b = 0;\
+    for i = 7 to 0 step -1 { b[i] = i; }\
+    return b[0] + b[7];\
+  }\
+  fun pastEnd :int (n :int) {\
+    int[n] a = 0;\
+    for i = 0 to n { a[i] = i; }\
+    return 0;\
+  }\
+  fun main :int () { return 0; }");
+
+  auto checks = [](const char *name) {
+    unsigned result = 0;
+    for (auto &block : *Node::module->getFunction(name)) {
+      for (auto &inst : block) {
+        auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+        result += call && call->getCalledFunction()->getName() ==
+                              "ps_bounds_error";
+      }
+    }
+    return result;
+  };
+  EXPECT_EQ(checks("checked"), 1);
+  EXPECT_EQ(checks("inBounds"), 0);
+  EXPECT_EQ(checks("pastEnd"), 1);
+}
+
+TEST(parser_test, views) {
+  stmt_ptr parseTree = parse("fun f :int (@readonly @noalias x :view<double>,\
+    n :int, y :view<complex>);");
+  auto func = dynamic_cast<FunctionDeclaration *>(parseTree.get());
+  ASSERT_NE(func, nullptr);
+  ASSERT_EQ(func->parameters.size(), 3);
+  Identifier &x = *func->parameters[0], &n = *func->parameters[1],
+             &y = *func->parameters[2];
+  EXPECT_TRUE(x.view && x.noalias && x.constant);
+  EXPECT_EQ(x.type, TypeID::DOUBLE);
+  EXPECT_FALSE(n.view);
+  EXPECT_TRUE(y.view);
+  EXPECT_FALSE(y.noalias || y.constant);
+  EXPECT_EQ(y.type, TypeID::COMPLEX);
+
+  for (const char *in : {"fun f :int (@readonly n :int);",
+                         "fun f :int (@inline x :view<int>);",
+                         "fun f :int (@noalias(1) x :view<int>);",
+                         "fun f :int (x :view<int);",
+                         "fun f :int (x :view int);"}) {
+    EXPECT_THROW(parse(in), ParserError);
+  }
+}
+
+TEST(codegen_test, views) {
+  for (const char *in : {
+           "fun f :int (@readonly x :view<int>) { x[0] = 1; return 0; }",
+           "fun f :int (x :view<int>) { return x; }",
+           "fun f :int (x :view<string>) { return 0; }",
+           "fun f :int (x :int) { return len(x); }",
+           "fun f :int (x :view<int>) { return f(1); }",
+           "fun f :int (x :view<int>) { double[2] a = 0; return f(a); }",
+           "fun f :int (x :view<int>) { int[2] a = 0; return f(a + 1); }",
+           "fun f :int (@readonly x :view<int>, y :view<int>) {\
+              return f(x, x); }",
+           "fun f :int (@noalias x :view<int>, y :view<int>) {\
+              int[2] a = 0; return f(a, a); }"}) {
+    stmt_ptr stmt = parse(in);
+    EXPECT_THROW(stmt->generate(), CodeGenError);
+  }
+
+  parseProgram("fun sum :double (@readonly x :view<double>);\
+  export fun scale :int (a :double, @noalias x :view<double>,\
+                         @readonly @noalias y :view<double>) {\
+    for i = 0 to len(x) - 1 { x[i] = a * y[i]; }\
+    double total = sum(y);\
+    return len(x);\
+  }\
+  fun main :int () {\
+    double[4] a = 1;\
+    double[4] b = 2;\
+    return scale(2, a, b);\
+  }");
+
+  // Each view is a pointer and a length, as in C
+  llvm::Function *scale = Node::module->getFunction("scale");
+  ASSERT_EQ(scale->arg_size(), 5);
+  EXPECT_TRUE(scale->getArg(1)->getType()->isPointerTy());
+  EXPECT_EQ(scale->getArg(2)->getType(), Node::intType);
+  EXPECT_TRUE(scale->hasParamAttribute(1, llvm::Attribute::NoAlias));
+  EXPECT_FALSE(scale->hasParamAttribute(1, llvm::Attribute::ReadOnly));
+  EXPECT_TRUE(scale->hasParamAttribute(3, llvm::Attribute::NoAlias));
+  EXPECT_TRUE(scale->hasParamAttribute(3, llvm::Attribute::ReadOnly));
+  EXPECT_EQ(Node::module->getFunction("sum")->arg_size(), 2);
+}
+
+TEST(parser_test, narrow_types) {
+  stmt_ptr parseTree =
+      parse("fun f :complex32 (k :int32, x :float, y :view<float>);");
+  auto func = dynamic_cast<FunctionDeclaration *>(parseTree.get());
+  ASSERT_NE(func, nullptr);
+  EXPECT_EQ(func->returnType, TypeID::COMPLEX32);
+  ASSERT_EQ(func->parameters.size(), 3);
+  EXPECT_EQ(func->parameters[0]->type, TypeID::INT32);
+  EXPECT_EQ(func->parameters[1]->type, TypeID::FLOAT);
+  EXPECT_EQ(func->parameters[2]->type, TypeID::FLOAT);
+}
+
+TEST(codegen_test, narrow_types) {
+  for (const char *in : {"fun f :int (x :float) { int k = x; return k; }",
+                         "fun f :int32 (x :double) { return x; }",
+                         "fun f :float (z :complex32) { return z; }"}) {
+    stmt_ptr stmt = parse(in);
+    EXPECT_THROW(stmt->generate(), CodeGenError);
+  }
+
+  parseProgram("fun cexpf :complex32 (z :complex32);\
+  fun narrow :float (x :float, k :int32) { return x * k * 0.5 + 1; }\
+  fun wide :float (x :float, n :int) { return x * n; }\
+  fun overflow :float (x :float) {\
+    return x * 1000000000000000000000000000000000000000.0;\
+  }\
+  fun rotate :complex32 (z :complex32) { return z * (0.5 - 0.5i); }\
+  fun main :int () { return 0; }");
+
+  // Literals take the width of the other operands
+  auto count = [](const char *function, unsigned opcode) {
+    unsigned result = 0;
+    for (auto &block : *Node::module->getFunction(function)) {
+      for (auto &inst : block) {
+        result += inst.getOpcode() == opcode;
+      }
+    }
+    return result;
+  };
+  EXPECT_EQ(count("narrow", llvm::Instruction::FPExt), 0);
+  EXPECT_EQ(count("rotate", llvm::Instruction::FPExt), 0);
+  EXPECT_EQ(count("wide", llvm::Instruction::FPExt), 1);
+  EXPECT_EQ(count("wide", llvm::Instruction::FPTrunc), 1);
+  EXPECT_EQ(count("overflow", llvm::Instruction::FPExt), 1);
+
+  // A float _Complex is passed and returned as a vector of two floats
+  llvm::Function *cexpf = Node::module->getFunction("cexpf");
+  ASSERT_EQ(cexpf->arg_size(), 1);
+  EXPECT_TRUE(cexpf->getArg(0)->getType()->isVectorTy());
+  EXPECT_TRUE(cexpf->getReturnType()->isVectorTy());
+}
+
+TEST(parser_test, vectors) {
+  stmt_ptr parseTree = parse("fun f :vec4d (x :vec8f) { return vec4d(1); }");
+  auto func = dynamic_cast<FunctionDeclaration *>(parseTree.get());
+  ASSERT_NE(func, nullptr);
+  EXPECT_EQ(func->returnType, TypeID::VEC4D);
+  ASSERT_EQ(func->parameters.size(), 1);
+  EXPECT_EQ(func->parameters[0]->type, TypeID::VEC8F);
+  EXPECT_THROW(parse("fun f :int () { return vec4d; }"), ParserError);
+}
+
+TEST(codegen_test, vectors) {
+  for (const char *in :
+       {"fun f :int (a :vec2d) { if (a < a) { return 1; } return 0; }",
+        "fun f :vec4d (a :vec4d, b :vec2d) { return a + b; }",
+        "fun f :double (a :vec2d) { return a[2]; }",
+        "fun f :vec2d (a :vec2d, k :int) { return shuffle(a, k, 0); }",
+        "fun f :vec2d (a :vec2d) { return shuffle(a, 0); }",
+        "fun f :double (x :double) { return hsum(x); }",
+        "fun f :vec2d (z :complex) { return vec2d(z); }",
+        "fun f :vec4d () { return vec4d(1, 2); }"}) {
+    stmt_ptr stmt = parse(in);
+    EXPECT_THROW(stmt->generate(), CodeGenError) << in;
+  }
+
+  parseProgram("fun dot :double (a :vec4d, b :vec4d) {\
+    return hsum(a * b);\
+  }\
+  fun swap :vec2d (a :vec2d) { return shuffle(a, 1, 0); }\
+  fun main :int () { return 0; }");
+
+  // Each operation is one instruction on whole vectors
+  llvm::BasicBlock &dot = Node::module->getFunction("dot")->getEntryBlock();
+  ASSERT_EQ(dot.size(), 3);
+  auto mul = llvm::dyn_cast<llvm::BinaryOperator>(&dot.front());
+  ASSERT_NE(mul, nullptr);
+  EXPECT_EQ(mul->getOpcode(), llvm::Instruction::FMul);
+  EXPECT_TRUE(mul->getType()->isVectorTy());
+  auto sum = llvm::dyn_cast<llvm::CallInst>(mul->getNextNode());
+  ASSERT_NE(sum, nullptr);
+  EXPECT_EQ(sum->getCalledFunction()->getIntrinsicID(),
+            llvm::Intrinsic::vector_reduce_fadd);
+
+  llvm::BasicBlock &swap = Node::module->getFunction("swap")->getEntryBlock();
+  ASSERT_EQ(swap.size(), 2);
+  EXPECT_TRUE(llvm::isa<llvm::ShuffleVectorInst>(swap.front()));
+}
+
+TEST(parser_test, structs) {
+  std::stringstream ss("@soa struct P { x :double, m :float }\
+  fun f :int (n :int) {\
+    P[n] p = 0;\
+    p[0].x = p[1].m;\
+    return 0;\
+  }");
+  Lexer lexer(ss);
+  Parser parser(lexer);
+  stmt_ptr parseTree = parser.parseNext();
+  auto record = dynamic_cast<StructDefinition *>(parseTree.get());
+  ASSERT_NE(record, nullptr);
+  EXPECT_TRUE(record->soa);
+  ASSERT_EQ(record->fields.size(), 2);
+  EXPECT_EQ(record->fields[1]->token.getString(), "m");
+  EXPECT_EQ(record->fields[1]->type, TypeID::FLOAT);
+
+  parseTree = parser.parseNext();
+  auto func = dynamic_cast<FunctionDefinition *>(parseTree.get());
+  ASSERT_NE(func, nullptr);
+  auto block = dynamic_cast<Sequence *>(func->block.get());
+  auto definition =
+      dynamic_cast<ArrayDefinition *>(block->statements[0].get());
+  ASSERT_NE(definition, nullptr);
+  EXPECT_EQ(definition->record, "P");
+  auto assignment =
+      dynamic_cast<ElementAssignment *>(block->statements[1].get());
+  ASSERT_NE(assignment, nullptr);
+  EXPECT_EQ(assignment->element->field, "x");
+  auto element = dynamic_cast<Index *>(assignment->expression.get());
+  ASSERT_NE(element, nullptr);
+  EXPECT_EQ(element->field, "m");
+
+  for (const char *in : {"@aos struct P { x :double }",
+                         "@soa(2) struct P { x :double }",
+                         "struct P { x :double y :double }",
+                         "struct P { x double }",
+                         "struct P { x :double } P p = 0;",
+                         "struct P { x :double } fun f :int () { P p = 0; }",
+                         "fun f :int () { int[2] a = 0; return a[0].; }"}) {
+    std::stringstream ss(in);
+    Lexer lexer(ss);
+    Parser parser(lexer);
+    EXPECT_THROW(
+        {
+          parser.parseNext();
+          parser.parseNext();
+        },
+        ParserError);
+  }
+}
+
+TEST(codegen_test, structs) {
+  for (const char *in : {
+           "fun f :int () { int[2] a = 0; return a[0].x; }",
+           "fun f :int () { P[2] p = 0; return p[0]; }",
+           "fun f :int () { P[2] p = 0; return p[0].y; }",
+           "fun f :int () { P[2] p = 0; p[0] = 1; return 0; }",
+           "fun f :int () { P[2] p = 0; return p[2].x; }",
+           "fun f :int () { P[2] p = 0; return p; }",
+           "fun f :int () { P[2] p = 0; return g(p); }",
+           "struct P { x :int }", "struct Q { x :int, x :double }",
+           "struct Q { s :string }"}) {
+    std::stringstream ss(std::string("struct P { x :int, v :double }\
+      fun g :int (x :view<int>);") + in);
+    Lexer lexer(ss);
+    Parser parser(lexer);
+    // Arrays refer to the definition of their struct
+    std::vector<stmt_ptr> program;
+    EXPECT_THROW(
+        for (int i = 0; i < 3; ++i) {
+          program.push_back(parser.parseNext());
+          program.back()->generate();
+        },
+        CodeGenError)
+        << in;
+  }
+
+  parseProgram("struct A { x :double, v :double }\
+  @soa struct S { x :double, v :double }\
+  A[8] a = 1;\
+  S[8] s = 1;\
+  fun main :int () {\
+    a[1].v = a[0].x;\
+    s[1].v = s[0].x;\
+    return 0;\
+  }");
+
+  // Fields of the AoS array are interleaved, the SoA array is split
+  auto a = Node::module->getNamedGlobal("a");
+  ASSERT_NE(a, nullptr);
+  EXPECT_TRUE(a->getValueType()->getArrayElementType()->isStructTy());
+  EXPECT_EQ(Node::module->getNamedGlobal("s"), nullptr);
+  for (const char *column : {"s.x", "s.v"}) {
+    auto global = Node::module->getNamedGlobal(column);
+    ASSERT_NE(global, nullptr);
+    EXPECT_EQ(global->getValueType()->getArrayElementType(),
+              Node::doubleType);
+  }
+}
+
+TEST(parser_test, generics) {
+  stmt_ptr parseTree =
+      parse("fun f<T, U> :T (@readonly a :view<T>, k :U, n :int) {\
+        return a[n] * k;\
+      }");
+  auto generic = dynamic_cast<GenericFunction *>(parseTree.get());
+  ASSERT_NE(generic, nullptr);
+  EXPECT_EQ(generic->typeParameters, std::vector<std::string>({"T", "U"}));
+  EXPECT_EQ(generic->bindings, std::vector<std::string>({"T", "U", ""}));
+  // Type parameters are checked as int when the function is defined
+  ASSERT_NE(generic->definition, nullptr);
+  EXPECT_EQ(generic->definition->token.getString(), "f<int,int>");
+  ASSERT_EQ(generic->definition->parameters.size(), 3);
+  EXPECT_TRUE(generic->definition->parameters[0]->view);
+  EXPECT_EQ(generic->definition->parameters[1]->type, TypeID::INT);
+
+  for (const char *in : {"fun f<T> :T (x :T);",
+                         "fun f<T> :T (x :T) return x;",
+                         "fun f<T> :T (x :int) { return x; }",
+                         "fun f<T, T> :T (x :T) { return x; }",
+                         "fun f<int> :int (x :int) { return x; }",
+                         "fun f<T :T (x :T) { return x; }",
+                         "fun f<T> :T (x :T) { return x }",
+                         "fun f<T> :T (x :T) { return x;",
+                         "export fun f<T> :T (x :T) { return x; }",
+                         "fun main<T> :int (x :T) { return 0; }"}) {
+    EXPECT_THROW(parse(in), ParserError) << in;
+  }
+}
+
+TEST(codegen_test, generics) {
+  for (const char *in : {"fun f :int () { return id(1, 2); }",
+                         "fun f :int () { return id(\"s\"); }",
+                         "fun f :int () { return id(1.5); }",
+                         "fun f :int () { int[2] a = 0; return first(a); }",
+                         "fun f :int () { return first(1); }",
+                         "fun f :int () { int[2] a = 0; double[2] b = 0;\
+                            return pick(a, b); }",
+                         "fun id :int (x :int) { return x; }",
+                         "fun id<U> :U (x :U) { return x; }"}) {
+    std::stringstream ss(std::string("fun id<T> :T (x :T) { return x; }\
+      fun first<T> :T (a :view<T>) { return a[0] / 2.0; }\
+      fun pick<T> :T (a :view<T>, b :view<T>) { return a[0]; }") +
+                         in);
+    Lexer lexer(ss);
+    Parser parser(lexer);
+    std::vector<stmt_ptr> program;
+    EXPECT_THROW(
+        while (true) {
+          program.push_back(parser.parseNext());
+          program.back()->generate();
+        },
+        CodeGenError)
+        << in;
+  }
+
+  std::stringstream ss("fun axpy<T> :T (a :T, x :T, y :T) {\
+    return a * x + y;\
+  }\
+  fun f :int (n :int, m :int) { return axpy(n, m, 1) + axpy(m, n, 2); }\
+  fun g :double (x :double) { return axpy(x, x, 1); }\
+  fun main :int () { return 0; }");
+  Lexer lexer(ss);
+  Parser parser(lexer);
+  stmt_ptr axpy = parser.parseNext();
+  axpy->generate();
+  while (true) {
+    stmt_ptr statement = parser.parseNext();
+    statement->generate();
+    if (statement->token.tag == Tag::MAIN) {
+      break;
+    }
+  }
+
+  // One instance per type, with native arithmetic of the type
+  auto generic = dynamic_cast<GenericFunction *>(axpy.get());
+  ASSERT_NE(generic, nullptr);
+  EXPECT_EQ(generic->instances.size(), 2);
+  EXPECT_EQ(Node::module->getFunction("axpy"), nullptr);
+  for (auto [name, opcode] :
+       {std::pair{"axpy<int>", llvm::Instruction::Mul},
+        std::pair{"axpy<double>", llvm::Instruction::FMul}}) {
+    llvm::Function *instance = Node::module->getFunction(name);
+    ASSERT_NE(instance, nullptr) << name;
+    llvm::Instruction &first = instance->getEntryBlock().front();
+    auto mul = llvm::dyn_cast<llvm::BinaryOperator>(&first);
+    ASSERT_NE(mul, nullptr) << name;
+    EXPECT_EQ(mul->getOpcode(), opcode) << name;
+  }
+}
+
+TEST(parser_test, match) {
+  stmt_ptr parseTree = parse("fun f :int (x :int) {\
+    match (x) {\
+      1 => return 1;\
+      2, 4 to 6 => { x = 0; }\
+      _ => x = 1;\
+    }\
+    return x;\
+  }");
+  auto func = dynamic_cast<FunctionDefinition *>(parseTree.get());
+  ASSERT_NE(func, nullptr);
+  auto block = dynamic_cast<Sequence *>(func->block.get());
+  auto match = dynamic_cast<MatchStatement *>(block->statements[0].get());
+  ASSERT_NE(match, nullptr);
+  ASSERT_EQ(match->arms.size(), 2);
+  EXPECT_EQ(match->arms[0].patterns.size(), 1);
+  ASSERT_EQ(match->arms[1].patterns.size(), 2);
+  EXPECT_EQ(match->arms[1].patterns[0].second, nullptr);
+  EXPECT_NE(match->arms[1].patterns[1].second, nullptr);
+  EXPECT_NE(match->otherwise, nullptr);
+
+  for (const char *in :
+       {"fun f :int (x :int) { match x { 1 => return 1; } return 0; }",
+        "fun f :int (x :int) { match (x) { 1 return 1; } return 0; }",
+        "fun f :int (x :int) { match (x) { 1, => return 1; } return 0; }",
+        "fun f :int (x :int) { match (x) { _ => x = 0; 1 => x = 1; } }",
+        "fun f :int (x :int) { match (x) { 1 => return 1; "}) {
+    EXPECT_THROW(parse(in), ParserError) << in;
+  }
+}
+
+TEST(codegen_test, match) {
+  for (const char *in :
+       {"fun f :int (x :double) { match (x) { 1 => x = 0; } return 0; }",
+        "fun f :int (x :int, y :int) { match (x) { y => x = 0; } return 0; }",
+        "fun f :int (x :int) { match (x) { 1.5 => x = 0; } return 0; }",
+        "fun f :int (x :int) { match (x) { 1, 1 => x = 0; } return 0; }",
+        "fun f :int (x :int) { match (x) { 1 to 3 => x = 0; 3 => x = 1; }\
+           return 0; }",
+        "fun f :int (x :int) { match (x) { 3 to 1 => x = 0; } return 0; }",
+        "fun f :int (x :int32) { match (x) { 3000000000 => x = 0; }\
+           return 0; }"}) {
+    stmt_ptr stmt = parse(in);
+    EXPECT_THROW(stmt->generate(), CodeGenError) << in;
+  }
+
+  parseProgram("const int C = 7;\
+  fun f :int (x :int) {\
+    match (x) {\
+      1, 3 to 5 => return 1;\
+      C => return 2;\
+      100 to 1000 => return 3;\
+    }\
+    return 0;\
+  }\
+  fun main :int () { return 0; }");
+
+  // Values are cases of one switch, the wide range is a single comparison
+  llvm::BasicBlock &entry = Node::module->getFunction("f")->getEntryBlock();
+  auto switch_ = llvm::dyn_cast<llvm::SwitchInst>(entry.getTerminator());
+  ASSERT_NE(switch_, nullptr);
+  EXPECT_EQ(switch_->getNumCases(), 5);
+  EXPECT_EQ(switch_->getDefaultDest()->size(), 3);
+}
+
+TEST(parser_test, tail_calls) {
+  stmt_ptr parseTree = parse("fun f :int (n :int) {\
+    if (n == 0) { return 0; }\
+    tailcall f(n - 1);\
+  }");
+  auto func = dynamic_cast<FunctionDefinition *>(parseTree.get());
+  ASSERT_NE(func, nullptr);
+  EXPECT_TRUE(func->tailRecursive);
+  parseTree = parse("fun f :int (n :int) { return f(n - 1) + 1; }");
+  func = dynamic_cast<FunctionDefinition *>(parseTree.get());
+  ASSERT_NE(func, nullptr);
+  EXPECT_FALSE(func->tailRecursive);
+
+  for (const char *in : {"fun f :int (n :int) { tailcall n; }",
+                         "fun f :int (n :int) { tailcall f(n) + 1; }",
+                         "fun f :double (x :double) { tailcall sqrt(x); }"}) {
+    EXPECT_THROW(parse(in), ParserError) << in;
+  }
+}
+
+TEST(codegen_test, tail_calls) {
+  for (const char *in :
+       {"fun f :int (n :int) { tailcall g(n, 1); }",
+        "fun f :double (n :int) { tailcall h(n); }",
+        "fun f :int (n :int) { int[4] a = 0; tailcall v(a); }",
+        "fun f :int (n :int) { int[n] a = 0; tailcall v(a); }"}) {
+    std::stringstream ss(std::string("fun g :int (a :int, b :int);\
+      fun h :int (n :int);\
+      fun v :int (a :view<int>);") +
+                         in);
+    Lexer lexer(ss);
+    Parser parser(lexer);
+    std::vector<stmt_ptr> program;
+    EXPECT_THROW(
+        for (int i = 0; i < 4; ++i) {
+          program.push_back(parser.parseNext());
+          program.back()->generate();
+        },
+        CodeGenError)
+        << in;
+  }
+
+  parseProgram("int[8] g = 0;\
+  fun h :int (n :int);\
+  fun v :int (a :view<int>);\
+  fun sum :int (n :int, acc :int) {\
+    if (n == 0) { return acc; }\
+    return sum(n - 1, acc + n);\
+  }\
+  fun f :int (n :int) { return h(n + 1); }\
+  fun global :int () { return v(g); }\
+  fun local :int () { int[8] a = 0; return v(a); }\
+  fun main :int () { return 0; }");
+
+  // Self recursion is a loop, other returned calls are tail calls unless
+  // they are passed arrays of the caller
+  for (llvm::BasicBlock &block : *Node::module->getFunction("sum")) {
+    for (llvm::Instruction &inst : block) {
+      EXPECT_FALSE(llvm::isa<llvm::CallInst>(inst));
+    }
+  }
+  for (auto [name, tail] : {std::pair{"f", true}, std::pair{"global", true},
+                            std::pair{"local", false}}) {
+    llvm::Function *func = Node::module->getFunction(name);
+    auto ret = llvm::cast<llvm::ReturnInst>(func->back().getTerminator());
+    auto call = llvm::dyn_cast<llvm::CallInst>(ret->getReturnValue());
+    ASSERT_NE(call, nullptr) << name;
+    EXPECT_EQ(call->isTailCall(), tail) << name;
+  }
+}
+
+TEST(codegen_test, memo) {
+  for (const char *in :
+       {"int g = 1;\
+        @memo fun f :int (n :int) { return n + g; }",
+        "@memo fun f :int (n :int) { return e(n); }",
+        "@memo fun f :int (n :int) { return i(n); }",
+        "@memo(0) fun f :int (n :int) { return n; }",
+        "@memo(1, 2) fun f :int (n :int) { return n; }",
+        "@memo fun f :int (v :view<int>) { return 0; }",
+        "@memo fun f :string (n :int) { return \"f\"; }",
+        "@memo fun f :int (n :int);"}) {
+    EXPECT_THROW(parseProgram(std::string("fun e :int (n :int);\
+      fun i :int (n :int);") +
+                         in + "fun i :int (n :int) { return e(n); }\
+      fun main :int () { return 0; }"), CodeGenError) << in;
+  }
+
+  parseProgram("const int g = 2;\
+  @memo fun f :int (n :int) { if (n < 2) { return n; }\
+    return f(n - 1) + f(n - 2) * g; }\
+  @memo(4) fun h :double (x :double, n :int32) { int[4] a = n;\
+    return x * a[0]; }\
+  fun main :int () { return 0; }");
+
+  // Calls, including recursive ones, go through the cache
+  llvm::Function *f = Node::module->getFunction("f");
+  llvm::Function *uncached = Node::module->getFunction("f.uncached");
+  ASSERT_NE(f, nullptr);
+  ASSERT_NE(uncached, nullptr);
+  EXPECT_NE(Node::module->getNamedGlobal("f.cache"), nullptr);
+  for (llvm::BasicBlock &block : *uncached) {
+    for (llvm::Instruction &inst : block) {
+      if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+        EXPECT_EQ(call->getCalledFunction(), f);
+      }
+    }
+  }
+  llvm::Function *lookup = Node::module->getFunction("ps_memo_lookup");
+  ASSERT_NE(lookup, nullptr);
+  for (llvm::User *user : lookup->users()) {
+    auto call = llvm::cast<llvm::CallInst>(user);
+    auto capacity = llvm::cast<llvm::ConstantInt>(call->getArgOperand(1));
+    EXPECT_EQ(capacity->getSExtValue(),
+              call->getFunction()->getName() == "h" ? 4 : 0);
+  }
+}
+
+TEST(parser_test, hints) {
+  stmt_ptr parseTree = parse("fun f :int (n :int) {\
+    if (likely(n > 0 and n < 10)) { n = 0; }\
+    while (unlikely((n > 5))) { n = n - 1; }\
+    if (n > 0) { n = 1; }\
+    return n;\
+  }");
+  auto func = dynamic_cast<FunctionDefinition *>(parseTree.get());
+  ASSERT_NE(func, nullptr);
+  auto block = dynamic_cast<Sequence *>(func->block.get());
+  ASSERT_NE(block, nullptr);
+  auto first = dynamic_cast<IfStatement *>(block->statements[0].get());
+  auto loop = dynamic_cast<WhileStatement *>(block->statements[1].get());
+  auto last = dynamic_cast<IfStatement *>(block->statements[2].get());
+  ASSERT_NE(first, nullptr);
+  ASSERT_NE(loop, nullptr);
+  ASSERT_NE(last, nullptr);
+  EXPECT_EQ(first->expected, Expectation::LIKELY);
+  EXPECT_NE(dynamic_cast<Conjunction *>(first->condition.get()), nullptr);
+  EXPECT_EQ(loop->expected, Expectation::UNLIKELY);
+  EXPECT_EQ(last->expected, Expectation::NONE);
+
+  for (const char *in :
+       {"fun f :int (n :int) { if (likely(n > 0) and n < 5) { n = 0; }\
+          return n; }",
+        "fun f :int (n :int) { if (likely n > 0) { n = 0; } return n; }"}) {
+    EXPECT_THROW(parse(in), ParserError) << in;
+  }
+}
+
+TEST(codegen_test, hints) {
+  for (const char *in : {"@hot @cold fun f :int () { return 0; }",
+                         "@inline @noinline fun f :int () { return 0; }",
+                         "@inline @minsize fun f :int () { return 0; }",
+                         "@hot(1) fun f :int () { return 0; }"}) {
+    EXPECT_THROW(parseProgram(in), CodeGenError) << in;
+  }
+
+  parseProgram("@cold fun e :int (n :int);\
+  @hot @noinline fun f :int (n :int) {\
+    if (unlikely(n < 0)) { return e(n); }\
+    while (likely(n > 1)) { n = n - 2; }\
+    return n;\
+  }\
+  @inline fun g :int (n :int) { return n; }\
+  @minsize fun h :int (n :int) { return n; }\
+  fun main :int () { return 0; }");
+
+  llvm::Function *e = Node::module->getFunction("e");
+  llvm::Function *f = Node::module->getFunction("f");
+  llvm::Function *g = Node::module->getFunction("g");
+  llvm::Function *h = Node::module->getFunction("h");
+  EXPECT_TRUE(e->hasFnAttribute(llvm::Attribute::Cold));
+  EXPECT_TRUE(f->hasFnAttribute(llvm::Attribute::Hot));
+  EXPECT_TRUE(f->hasFnAttribute(llvm::Attribute::NoInline));
+  EXPECT_TRUE(g->hasFnAttribute(llvm::Attribute::AlwaysInline));
+  EXPECT_TRUE(h->hasFnAttribute(llvm::Attribute::MinSize));
+  EXPECT_TRUE(h->hasFnAttribute(llvm::Attribute::OptimizeForSize));
+
+  // The branch to the unlikely return has a low weight and the branch into
+  // the likely loop body a high one
+  std::vector<std::pair<uint64_t, uint64_t>> weights;
+  for (llvm::BasicBlock &block : *f) {
+    auto branch = llvm::dyn_cast<llvm::BranchInst>(block.getTerminator());
+    uint64_t taken, untaken;
+    if (branch && branch->extractProfMetadata(taken, untaken)) {
+      weights.emplace_back(taken, untaken);
+    }
+  }
+  ASSERT_EQ(weights.size(), 2u);
+  EXPECT_LT(weights[0].first, weights[0].second);
+  EXPECT_GT(weights[1].first, weights[1].second);
+}
+
+TEST(codegen_test, instrument) {
+  Profiler::enabled = true;
+  parseProgram("fun f :int (n :int) {\
+    while (n > 0) {\
+      if (n == 5) { return n; }\
+      n = n - 1;\
+    }\
+    return 0;\
+  }\
+  fun main :int () { return 0; }");
+  Profiler::enabled = false;
+
+  // Each return ends the call, the one inside the loop ends its run first
+  auto callees = [](const char *name) {
+    std::vector<std::string> called;
+    for (llvm::BasicBlock &block : *Node::module->getFunction(name)) {
+      for (llvm::Instruction &inst : block) {
+        if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+          called.push_back(call->getCalledFunction()->getName().str());
+        }
+      }
+    }
+    return called;
+  };
+  EXPECT_EQ(callees("f"), (std::vector<std::string>{
+                              "ps_instrument_enter", "ps_cycles",
+                              "ps_instrument_loop", "ps_instrument_exit",
+                              "ps_instrument_loop", "ps_instrument_exit"}));
+  EXPECT_EQ(callees("main"), (std::vector<std::string>{
+                                 "ps_instrument_enter", "ps_instrument_exit"}));
+  EXPECT_NE(Node::module->getNamedGlobal("f.site"), nullptr);
+  EXPECT_NE(Node::module->getNamedGlobal("f.loop"), nullptr);
+}
@@ -1,3 +1,4 @@
+#include "complex.h"
 #include "stdio.h"
 
 long printi(long i) {
@@ -6,4 +7,34 @@ long printi(long i) {
 
 long printd(double d) {
     return printf("%g\n", d);
-}
\ No newline at end of file
+}
+
+// Complex arguments after the seventh double are passed on the stack
+double weigh(double a, double b, double c, double d, double e, double f,
+             double g, double _Complex z, double h, double _Complex w) {
+    return a + b + c + d + e + f + g + h + 10 * creal(z) + 100 * cimag(z) +
+           1000 * creal(w) + 10000 * cimag(w);
+}
+
+// Views are passed as a pointer to the first element and the length
+double sumView(const double *data, long length) {
+    double sum = 0;
+    for (long i = 0; i < length; ++i) {
+        sum += data[i];
+    }
+    return sum;
+}
+
+long ramp(double *data, long length) {
+    for (long i = 0; i < length; ++i) {
+        data[i] = i;
+    }
+    return length;
+}
+
+long conjugate(double _Complex *data, long length) {
+    for (long i = 0; i < length; ++i) {
+        data[i] = conj(data[i]);
+    }
+    return length;
+}
@@ -0,0 +1,384 @@
+#include "passes.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Intrinsics.h"
+#include "llvm/IR/PatternMatch.h"
+#include "llvm/Transforms/Utils/Local.h"
+#include <cmath>
+
+using namespace llvm::PatternMatch;
+
+namespace {
+// Follows a part of a complex number through insertions and extractions
+llvm::Value *part(llvm::Value *val) {
+  while (auto extract = llvm::dyn_cast<llvm::ExtractValueInst>(val)) {
+    if (extract->getNumIndices() != 1) {
+      break;
+    }
+    unsigned index = extract->getIndices()[0];
+    llvm::Value *agg = extract->getAggregateOperand();
+    auto insert = llvm::dyn_cast<llvm::InsertValueInst>(agg);
+    while (insert && insert->getNumIndices() == 1 &&
+           insert->getIndices()[0] != index) {
+      agg = insert->getAggregateOperand();
+      insert = llvm::dyn_cast<llvm::InsertValueInst>(agg);
+    }
+    if (insert && insert->getNumIndices() == 1) {
+      val = insert->getInsertedValueOperand();
+    } else if (auto constant = llvm::dyn_cast<llvm::Constant>(agg)) {
+      return constant->getAggregateElement(index);
+    } else {
+      break;
+    }
+  }
+  return val;
+}
+
+// Parts extracted separately from the same complex number are equal as well
+bool same(llvm::Value *a, llvm::Value *b) {
+  a = part(a);
+  b = part(b);
+  if (a == b) {
+    return true;
+  }
+  auto extractA = llvm::dyn_cast<llvm::ExtractValueInst>(a);
+  auto extractB = llvm::dyn_cast<llvm::ExtractValueInst>(b);
+  return extractA && extractB && extractA->isIdenticalTo(extractB);
+}
+
+bool isZero(llvm::Value *val) {
+  auto constant = llvm::dyn_cast_or_null<llvm::ConstantFP>(part(val));
+  return constant && constant->isZero();
+}
+
+// Matches -x, written either as a negation or a multiplication by -1
+bool isNegation(llvm::Value *val, llvm::Value *&of) {
+  val = part(val);
+  return match(val, m_FNeg(m_Value(of))) ||
+         match(val, m_c_FMul(m_Value(of), m_SpecificFP(-1.0)));
+}
+
+// Matches a * b in any order
+bool isProduct(llvm::Value *val, llvm::Value *a, llvm::Value *b) {
+  llvm::Value *x, *y;
+  if (!match(part(val), m_FMul(m_Value(x), m_Value(y)))) {
+    return false;
+  }
+  return (same(x, a) && same(y, b)) || (same(x, b) && same(y, a));
+}
+
+bool isSquare(llvm::Value *val, llvm::Value *&of) {
+  llvm::Value *x, *y;
+  if (match(part(val), m_FMul(m_Value(x), m_Value(y))) && same(x, y)) {
+    of = x;
+    return true;
+  }
+  return false;
+}
+
+// Matches re * re + im * im, which is never negative
+bool isSumOfSquares(llvm::Value *val) {
+  llvm::Value *a, *b, *x, *y, *z;
+  val = part(val);
+  if (match(val, m_FAdd(m_Value(a), m_Value(b)))) {
+    return isSquare(a, x) && isSquare(b, y);
+  }
+  return match(val, m_Intrinsic<llvm::Intrinsic::fmuladd>(
+                        m_Value(x), m_Value(y), m_Value(z))) &&
+         same(x, y) && isSquare(z, x);
+}
+
+// Matches x * c where c is zero or the conjugate of zero
+bool isZeroTerm(llvm::Value *val, llvm::Value *&other) {
+  llvm::Value *x, *y, *of;
+  if (!match(part(val), m_FMul(m_Value(x), m_Value(y)))) {
+    return false;
+  }
+  if (isZero(x) || (isNegation(x, of) && isZero(of))) {
+    std::swap(x, y);
+  }
+  other = x;
+  return isZero(y) || (isNegation(y, of) && isZero(of));
+}
+
+// Whether the denominator is the one of division by re + 0i
+bool isRealDenominator(llvm::Value *denominator, llvm::Value *re) {
+  llvm::Value *square, *rest, *other;
+  denominator = part(denominator);
+  if (auto constant = llvm::dyn_cast<llvm::ConstantFP>(denominator)) {
+    auto value = llvm::dyn_cast<llvm::ConstantFP>(part(re));
+    if (!value) {
+      return false;
+    }
+    double x = value->getValueAPF().convertToDouble();
+    return constant->getValueAPF().convertToDouble() == x * x;
+  }
+  // The zero term may already be added instead of subtracted by normReal
+  if (match(denominator, m_FSub(m_Value(square), m_Value(rest))) ||
+      match(denominator, m_FAdd(m_Value(square), m_Value(rest)))) {
+    if (!isZero(rest) && !isZeroTerm(rest, other)) {
+      return false;
+    }
+    denominator = square;
+  }
+  return isProduct(denominator, re, re);
+}
+
+/**
+ * Smallest sum of squares whose square root is not less than r, or greater
+ * than r if above is set, in the precision of the sum.
+ **/
+template <typename T> T threshold(T r, bool above) {
+  if (above) {
+    r = std::nextafter(r, T(INFINITY));
+  }
+  if (r <= 0) {
+    return 0;
+  }
+  T t = r * r;
+  while (t > 0 && std::sqrt(std::nextafter(t, T(0))) >= r) {
+    t = std::nextafter(t, T(0));
+  }
+  while (std::sqrt(t) < r) {
+    t = std::nextafter(t, T(INFINITY));
+  }
+  return t;
+}
+
+class ComplexAlgebra {
+  llvm::Function &func;
+  llvm::IRBuilder<> builder;
+  llvm::SmallVector<llvm::WeakTrackingVH, 16> dead;
+
+  void replace(llvm::Instruction &inst, llvm::Value *with) {
+    if (llvm::isa<llvm::Instruction>(with)) {
+      with->takeName(&inst);
+    }
+    inst.replaceAllUsesWith(with);
+    dead.push_back(&inst);
+  }
+
+  bool modulus(llvm::FCmpInst &cmp);
+  bool division(llvm::BinaryOperator &div);
+  bool normReal(llvm::BinaryOperator &sub);
+  bool normImaginary(llvm::BinaryOperator &add);
+  bool fuse(llvm::BinaryOperator &add);
+
+public:
+  ComplexAlgebra(llvm::Function &func_)
+      : func(func_), builder(func_.getContext()) {}
+
+  bool run();
+};
+
+// |z| < r becomes re * re + im * im < r * r
+bool ComplexAlgebra::modulus(llvm::FCmpInst &cmp) {
+  llvm::CmpInst::Predicate predicate = cmp.getPredicate();
+  llvm::Value *sqrt = cmp.getOperand(0), *r = cmp.getOperand(1), *sum;
+  if (!match(sqrt, m_Intrinsic<llvm::Intrinsic::sqrt>(m_Value(sum)))) {
+    std::swap(sqrt, r);
+    predicate = cmp.getSwappedPredicate();
+  }
+  if (!match(sqrt, m_Intrinsic<llvm::Intrinsic::sqrt>(m_Value(sum))) ||
+      !isSumOfSquares(sum)) {
+    return false;
+  }
+
+  builder.SetInsertPoint(&cmp);
+  builder.setFastMathFlags(cmp.getFastMathFlags());
+  if (auto constant = llvm::dyn_cast<llvm::ConstantFP>(r)) {
+    /**
+     * The square root is rounded, so sqrt(s) < r exactly when s is less than
+     * the smallest s whose rounded square root is not less than r.
+     * sqrt(s) <= r is the same as sqrt(s) < r', where r' follows r.
+     **/
+    double radius = constant->getValueAPF().convertToDouble();
+    if (!std::isfinite(radius)) {
+      return false;
+    }
+    bool above = predicate == llvm::CmpInst::FCMP_OLE ||
+                 predicate == llvm::CmpInst::FCMP_OGT;
+    llvm::Value *bound = llvm::ConstantFP::get(
+        sum->getType(), sum->getType()->isFloatTy()
+                            ? threshold(static_cast<float>(radius), above)
+                            : threshold(radius, above));
+    switch (predicate) {
+    case llvm::CmpInst::FCMP_OLT:
+    case llvm::CmpInst::FCMP_OLE:
+      replace(cmp, builder.CreateFCmpOLT(sum, bound));
+      return true;
+    case llvm::CmpInst::FCMP_OGT:
+    case llvm::CmpInst::FCMP_OGE:
+      replace(cmp, builder.CreateFCmpOGE(sum, bound));
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  // Squaring r is not exact, so the result may change in the last place
+  if (!llvm::cast<llvm::Instruction>(sqrt)->hasApproxFunc() ||
+      (predicate != llvm::CmpInst::FCMP_OLT &&
+       predicate != llvm::CmpInst::FCMP_OLE)) {
+    return false;
+  }
+  llvm::Value *positive =
+      builder.CreateFCmpOGE(r, llvm::ConstantFP::get(r->getType(), 0.0));
+  llvm::Value *square = builder.CreateFMul(r, r);
+  replace(cmp, builder.CreateAnd(positive,
+                                 builder.CreateFCmp(predicate, sum, square)));
+  return true;
+}
+
+/**
+ * z / (x + 0i) multiplies both z and x + 0i by x - 0i. Terms multiplied by
+ * zero vanish and x cancels out, leaving Re(z) / x and Im(z) / x.
+ **/
+bool ComplexAlgebra::division(llvm::BinaryOperator &div) {
+  if (!div.hasAllowReassoc()) {
+    return false;
+  }
+  llvm::Value *numerator = part(div.getOperand(0)),
+              *denominator = div.getOperand(1), *left, *right, *other, *x, *y;
+  llvm::Value *product = nullptr;
+  if (match(numerator, m_FSub(m_Value(left), m_Value(right)))) {
+    if (isZeroTerm(right, other)) {
+      product = left;
+    }
+  } else if (match(numerator, m_FAdd(m_Value(left), m_Value(right)))) {
+    if (isZeroTerm(left, other)) {
+      product = right;
+    } else if (isZeroTerm(right, other)) {
+      product = left;
+    }
+  }
+  if (!product || !match(part(product), m_FMul(m_Value(x), m_Value(y)))) {
+    return false;
+  }
+  if (!isRealDenominator(denominator, y)) {
+    std::swap(x, y);
+    if (!isRealDenominator(denominator, y)) {
+      return false;
+    }
+  }
+
+  builder.SetInsertPoint(&div);
+  builder.setFastMathFlags(div.getFastMathFlags());
+  replace(div, builder.CreateFDiv(part(x), part(y)));
+  return true;
+}
+
+// Re(z * conj(z)) is re * re - im * -im, or simply re * re + im * im
+bool ComplexAlgebra::normReal(llvm::BinaryOperator &sub) {
+  llvm::Value *re, *im, *negated, *of;
+  if (!isSquare(sub.getOperand(0), re) ||
+      !match(part(sub.getOperand(1)), m_FMul(m_Value(im), m_Value(negated)))) {
+    return false;
+  }
+  if (!isNegation(negated, of) || !same(of, im)) {
+    std::swap(im, negated);
+    if (!isNegation(negated, of) || !same(of, im)) {
+      return false;
+    }
+  }
+
+  builder.SetInsertPoint(&sub);
+  builder.setFastMathFlags(sub.getFastMathFlags());
+  re = part(re);
+  im = part(im);
+  llvm::Value *sum = builder.CreateFAdd(builder.CreateFMul(re, re),
+                                        builder.CreateFMul(im, im));
+  replace(sub, sum);
+  if (auto add = llvm::dyn_cast<llvm::BinaryOperator>(sum)) {
+    fuse(*add);
+  }
+  return true;
+}
+
+// Im(z * conj(z)) is re * -im + im * re, which is zero unless it overflows
+bool ComplexAlgebra::normImaginary(llvm::BinaryOperator &add) {
+  if (!add.hasNoNaNs() || !add.hasNoInfs()) {
+    return false;
+  }
+  for (unsigned i = 0; i < 2; ++i) {
+    llvm::Value *x, *y, *of;
+    if (!match(part(add.getOperand(i)), m_FMul(m_Value(x), m_Value(y)))) {
+      continue;
+    }
+    if (!isNegation(y, of)) {
+      std::swap(x, y);
+      if (!isNegation(y, of)) {
+        continue;
+      }
+    }
+    if (isProduct(add.getOperand(1 - i), x, of)) {
+      replace(add, llvm::ConstantFP::get(add.getType(), 0.0));
+      return true;
+    }
+  }
+  return false;
+}
+
+// re * re + im * im becomes a fused multiply-add where the target has one
+bool ComplexAlgebra::fuse(llvm::BinaryOperator &add) {
+  llvm::Value *re, *im;
+  auto mul = llvm::dyn_cast<llvm::Instruction>(add.getOperand(0));
+  if (!add.hasAllowContract() || !mul || !mul->hasAllowContract() ||
+      !mul->hasOneUse() || !isSquare(mul, re) ||
+      !isSquare(add.getOperand(1), im)) {
+    return false;
+  }
+
+  builder.SetInsertPoint(&add);
+  builder.setFastMathFlags(add.getFastMathFlags());
+  llvm::Function *fmuladd = llvm::Intrinsic::getDeclaration(
+      func.getParent(), llvm::Intrinsic::fmuladd, {add.getType()});
+  replace(add, builder.CreateCall(fmuladd, {mul->getOperand(0),
+                                            mul->getOperand(1),
+                                            add.getOperand(1)}));
+  return true;
+}
+
+bool ComplexAlgebra::run() {
+  bool changed = false;
+  for (auto &block : func) {
+    for (auto &inst : block) {
+      if (inst.use_empty()) {
+        if (llvm::isInstructionTriviallyDead(&inst)) {
+          dead.push_back(&inst);
+        }
+        continue;
+      }
+      if (auto cmp = llvm::dyn_cast<llvm::FCmpInst>(&inst)) {
+        changed |= modulus(*cmp);
+      } else if (auto op = llvm::dyn_cast<llvm::BinaryOperator>(&inst)) {
+        switch (op->getOpcode()) {
+        case llvm::Instruction::FDiv:
+          changed |= division(*op);
+          break;
+        case llvm::Instruction::FSub:
+          changed |= normReal(*op);
+          break;
+        case llvm::Instruction::FAdd:
+          changed |= normImaginary(*op) || fuse(*op);
+          break;
+        default:
+          break;
+        }
+      }
+    }
+  }
+  changed |= !dead.empty();
+  llvm::RecursivelyDeleteTriviallyDeadInstructions(dead);
+  return changed;
+}
+} // namespace
+
+llvm::PreservedAnalyses
+ComplexAlgebraPass::run(llvm::Function &func, llvm::FunctionAnalysisManager &) {
+  if (!ComplexAlgebra(func).run()) {
+    return llvm::PreservedAnalyses::all();
+  }
+  llvm::PreservedAnalyses preserved;
+  preserved.preserveSet<llvm::CFGAnalyses>();
+  return preserved;
+}
@@ -0,0 +1,68 @@
+#include "passes.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/Host.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Target/TargetMachine.h"
+
+void Optimizer::run(llvm::Module &module) {
+  // Cost models of the optimizations are those of the host
+  llvm::InitializeNativeTarget();
+  std::string triple = llvm::sys::getDefaultTargetTriple(), err;
+  const llvm::Target *target = llvm::TargetRegistry::lookupTarget(triple, err);
+  std::unique_ptr<llvm::TargetMachine> machine;
+  if (target) {
+    machine.reset(target->createTargetMachine(triple, "generic", "",
+                                              llvm::TargetOptions(), {}));
+    module.setTargetTriple(triple);
+    module.setDataLayout(machine->createDataLayout());
+  }
+
+  // Counters are placed in the module as generated, where the profile is
+  // applied to the same branches
+  if (!profileGenerate.empty()) {
+    instrument(module, profileGenerate);
+  }
+  if (!profileUse.empty()) {
+    useProfile(module, profileUse);
+  }
+
+  llvm::LoopAnalysisManager loops;
+  llvm::FunctionAnalysisManager functions;
+  llvm::CGSCCAnalysisManager cgscc;
+  llvm::ModuleAnalysisManager modules;
+  // Call graph profiles of profiled programs are left out, since not every
+  // assembler accepts the .cg_profile directives emitted for them
+  llvm::PipelineTuningOptions tuning;
+  tuning.CallGraphProfile = false;
+  llvm::PassBuilder builder(machine.get(), tuning);
+  builder.registerModuleAnalyses(modules);
+  builder.registerCGSCCAnalyses(cgscc);
+  builder.registerFunctionAnalyses(functions);
+  builder.registerLoopAnalyses(loops);
+  builder.crossRegisterProxies(loops, functions, cgscc, modules);
+
+  /**
+   * Complex arithmetic is simplified first, while it is still in the form
+   * generated by the parser, and again after other passes simplify it.
+   **/
+  if (complexAlgebra) {
+    builder.registerPipelineStartEPCallback(
+        [](llvm::ModulePassManager &passes, llvm::OptimizationLevel) {
+          passes.addPass(
+              llvm::createModuleToFunctionPassAdaptor(ComplexAlgebraPass()));
+        });
+    builder.registerPeepholeEPCallback(
+        [](llvm::FunctionPassManager &passes, llvm::OptimizationLevel) {
+          passes.addPass(ComplexAlgebraPass());
+        });
+  }
+
+  llvm::OptimizationLevel levels[] = {
+      llvm::OptimizationLevel::O0, llvm::OptimizationLevel::O1,
+      llvm::OptimizationLevel::O2, llvm::OptimizationLevel::O3};
+  llvm::ModulePassManager passes =
+      level == 0 ? builder.buildO0DefaultPipeline(levels[0])
+                 : builder.buildPerModuleDefaultPipeline(levels[level]);
+  passes.run(module, modules);
+}
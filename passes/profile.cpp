@@ -0,0 +1,220 @@
+#include "passes.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/MDBuilder.h"
+#include "llvm/IR/ProfileSummary.h"
+#include "llvm/ProfileData/ProfileCommon.h"
+#include "llvm/Transforms/Utils/ModuleUtils.h"
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+namespace {
+/**
+ * Functions which are profiled, with their conditional branches. Both are
+ * in the order of the module, which is the same in every compilation of
+ * the same program with the same options.
+ **/
+std::vector<std::pair<llvm::Function *, std::vector<llvm::BranchInst *>>>
+branches(llvm::Module &module) {
+  std::vector<std::pair<llvm::Function *, std::vector<llvm::BranchInst *>>>
+      functions;
+  for (auto &func : module) {
+    if (func.isDeclaration()) {
+      continue;
+    }
+    functions.emplace_back(&func, std::vector<llvm::BranchInst *>());
+    for (auto &block : func) {
+      auto branch = llvm::dyn_cast<llvm::BranchInst>(block.getTerminator());
+      if (branch && branch->isConditional()) {
+        functions.back().second.push_back(branch);
+      }
+    }
+  }
+  return functions;
+}
+
+// Adds one or the condition to a counter, from any number of threads
+void increment(llvm::IRBuilder<> &builder, llvm::GlobalVariable *counters,
+               uint64_t counter, llvm::Value *value) {
+  llvm::Value *ptr = builder.CreateConstInBoundsGEP2_64(
+      counters->getValueType(), counters, 0, counter);
+  builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, ptr, value,
+                          llvm::MaybeAlign(8),
+                          llvm::AtomicOrdering::Monotonic);
+}
+
+/**
+ * Summary of the counts, from which passes tell hot and cold code apart.
+ * The detailed summary holds for each cutoff the smallest count of the
+ * largest counts which add up to that part of the total.
+ **/
+llvm::ProfileSummary summary(std::vector<uint64_t> counts,
+                             uint64_t maxFunctionCount, uint32_t functions) {
+  std::sort(counts.begin(), counts.end(), std::greater<uint64_t>());
+  uint64_t total = 0;
+  for (uint64_t count : counts) {
+    total += count;
+  }
+  llvm::SummaryEntryVector detailed;
+  uint64_t sum = 0;
+  size_t taken = 0;
+  for (uint32_t cutoff : llvm::ProfileSummaryBuilder::DefaultCutoffs) {
+    const long double part = static_cast<long double>(total) * cutoff /
+                             llvm::ProfileSummary::Scale;
+    while (taken < counts.size() && sum < part) {
+      sum += counts[taken++];
+    }
+    detailed.push_back({cutoff, taken ? counts[taken - 1] : 0, taken});
+  }
+  const uint64_t max = counts.empty() ? 0 : counts.front();
+  return llvm::ProfileSummary(llvm::ProfileSummary::PSK_Instr, detailed,
+                              total, max, max, maxFunctionCount,
+                              counts.size(), functions);
+}
+} // namespace
+
+ProfileError::ProfileError(const std::string &err) : std::runtime_error(err) {}
+
+void instrument(llvm::Module &module, const std::string &file) {
+  auto functions = branches(module);
+  llvm::LLVMContext &context = module.getContext();
+  llvm::IRBuilder<> builder(context);
+  llvm::Type *intType = builder.getInt64Ty();
+
+  uint64_t size = 0;
+  for (const auto &function : functions) {
+    size += 1 + 2 * function.second.size();
+  }
+  auto counterType = llvm::ArrayType::get(intType, size);
+  auto counters = new llvm::GlobalVariable(
+      module, counterType, false, llvm::GlobalValue::InternalLinkage,
+      llvm::ConstantAggregateZero::get(counterType), "ps.profile.counters");
+
+  // Calls of the function, then executions and taken edges of each branch
+  uint64_t counter = 0;
+  std::vector<llvm::Constant *> sizes;
+  for (const auto &function : functions) {
+    // Attributes were inferred without the counters, and would let calls
+    // be hoisted or removed along with their increments
+    for (auto kind :
+         {llvm::Attribute::ReadNone, llvm::Attribute::ReadOnly,
+          llvm::Attribute::WriteOnly, llvm::Attribute::ArgMemOnly,
+          llvm::Attribute::InaccessibleMemOnly,
+          llvm::Attribute::InaccessibleMemOrArgMemOnly,
+          llvm::Attribute::NoSync, llvm::Attribute::WillReturn}) {
+      function.first->removeFnAttr(kind);
+    }
+    llvm::BasicBlock &entry = function.first->getEntryBlock();
+    builder.SetInsertPoint(&entry, entry.getFirstInsertionPt());
+    increment(builder, counters, counter++, builder.getInt64(1));
+    for (llvm::BranchInst *branch : function.second) {
+      builder.SetInsertPoint(branch);
+      increment(builder, counters, counter++, builder.getInt64(1));
+      increment(builder, counters, counter++,
+                builder.CreateZExt(branch->getCondition(), intType));
+    }
+    sizes.push_back(builder.getInt64(1 + 2 * function.second.size()));
+  }
+
+  // The runtime library writes the counters to the file at exit
+  llvm::Function *init = llvm::Function::Create(
+      llvm::FunctionType::get(builder.getVoidTy(), false),
+      llvm::Function::InternalLinkage, "ps.profile.init", module);
+  builder.SetInsertPoint(llvm::BasicBlock::Create(context, "", init));
+  std::vector<llvm::Constant *> names;
+  for (const auto &function : functions) {
+    names.push_back(
+        builder.CreateGlobalStringPtr(function.first->getName()));
+  }
+  auto namesType =
+      llvm::ArrayType::get(builder.getInt8PtrTy(), functions.size());
+  auto namesArray = new llvm::GlobalVariable(
+      module, namesType, true, llvm::GlobalValue::InternalLinkage,
+      llvm::ConstantArray::get(namesType, names), "ps.profile.names");
+  auto sizesType = llvm::ArrayType::get(intType, functions.size());
+  auto sizesArray = new llvm::GlobalVariable(
+      module, sizesType, true, llvm::GlobalValue::InternalLinkage,
+      llvm::ConstantArray::get(sizesType, sizes), "ps.profile.sizes");
+
+  llvm::FunctionCallee callee = module.getOrInsertFunction(
+      "ps_profile_init", builder.getVoidTy(), builder.getInt8PtrTy(),
+      builder.getInt8PtrTy()->getPointerTo(), intType->getPointerTo(),
+      intType, intType->getPointerTo());
+  builder.CreateCall(
+      callee,
+      {builder.CreateGlobalStringPtr(file),
+       builder.CreateConstInBoundsGEP2_64(namesType, namesArray, 0, 0),
+       builder.CreateConstInBoundsGEP2_64(sizesType, sizesArray, 0, 0),
+       builder.getInt64(functions.size()),
+       builder.CreateConstInBoundsGEP2_64(counterType, counters, 0, 0)});
+  builder.CreateRetVoid();
+  llvm::appendToGlobalCtors(module, init, 65535);
+}
+
+void useProfile(llvm::Module &module, const std::string &file) {
+  std::ifstream in(file);
+  if (!in) {
+    throw ProfileError("Cannot read profile file " + file);
+  }
+  std::unordered_map<std::string, std::vector<uint64_t>> profile;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string name;
+    if (!(fields >> name)) {
+      continue;
+    }
+    std::vector<uint64_t> &values = profile[name];
+    for (uint64_t value; fields >> value;) {
+      values.push_back(value);
+    }
+    if (!fields.eof()) {
+      throw ProfileError("Invalid counters of " + name + " in profile file " +
+                         file);
+    }
+  }
+
+  llvm::MDBuilder metadata(module.getContext());
+  std::vector<uint64_t> counts;
+  uint64_t maxFunctionCount = 0;
+  uint32_t profiled = 0;
+  for (const auto &function : branches(module)) {
+    llvm::Function *func = function.first;
+    // Functions not in the profile were added after it was made
+    auto found = profile.find(func->getName().str());
+    if (found == profile.end()) {
+      continue;
+    }
+    const std::vector<uint64_t> &values = found->second;
+    if (values.size() != 1 + 2 * function.second.size()) {
+      throw ProfileError("Profile of " + func->getName().str() +
+                         " does not match the program");
+    }
+    func->setEntryCount(
+        llvm::Function::ProfileCount(values[0], llvm::Function::PCT_Real));
+    counts.push_back(values[0]);
+    maxFunctionCount = std::max(maxFunctionCount, values[0]);
+    ++profiled;
+
+    for (size_t i = 0; i < function.second.size(); ++i) {
+      const uint64_t executed = values[1 + 2 * i], taken = values[2 + 2 * i];
+      if (taken > executed) {
+        throw ProfileError("Profile of " + func->getName().str() +
+                           " does not match the program");
+      }
+      counts.push_back(executed);
+      if (executed == 0) {
+        continue;
+      }
+      // Weights are 32-bit, larger counts keep their ratio
+      const uint64_t scale = executed / UINT32_MAX + 1;
+      function.second[i]->setMetadata(
+          llvm::LLVMContext::MD_prof,
+          metadata.createBranchWeights(taken / scale,
+                                       (executed - taken) / scale));
+    }
+  }
+  module.setProfileSummary(
+      summary(counts, maxFunctionCount, profiled).getMD(module.getContext()),
+      llvm::ProfileSummary::PSK_Instr);
+}
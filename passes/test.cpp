@@ -0,0 +1,176 @@
+#include "parser.h"
+#include "passes.h"
+#include "gtest/gtest.h"
+
+void compile(const std::string &input) {
+  std::stringstream ss(input);
+  Lexer lexer(ss);
+  Parser parser(lexer);
+  parser.parse();
+  Optimizer().run(*Node::module);
+}
+
+unsigned instructions(const char *function, unsigned opcode) {
+  unsigned result = 0;
+  for (auto &block : *Node::module->getFunction(function)) {
+    for (auto &inst : block) {
+      result += inst.getOpcode() == opcode;
+    }
+  }
+  return result;
+}
+
+bool calls(const char *function, llvm::Intrinsic::ID id) {
+  for (auto &block : *Node::module->getFunction(function)) {
+    for (auto &inst : block) {
+      auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+      if (call && call->getCalledFunction() &&
+          call->getCalledFunction()->getIntrinsicID() == id) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+TEST(complex_algebra_test, modulus) {
+  compile("fun inside :int (z :complex) {\
+    if (|z| < 2) { return 1; }\
+    return 0;\
+  }\
+  fun outside :int (z :complex, r :double) {\
+    if (|z| > r) { return 1; }\
+    return 0;\
+  }\
+  @fastmath fun fastInside :int (z :complex, r :double) {\
+    if (|z| <= r) { return 1; }\
+    return 0;\
+  }\
+  fun main :int () { return 0; }");
+
+  EXPECT_FALSE(calls("inside", llvm::Intrinsic::sqrt));
+  llvm::FCmpInst *cmp = nullptr;
+  for (auto &inst : Node::module->getFunction("inside")->getEntryBlock()) {
+    if (auto fcmp = llvm::dyn_cast<llvm::FCmpInst>(&inst)) {
+      cmp = fcmp;
+    }
+  }
+  ASSERT_NE(cmp, nullptr);
+  EXPECT_EQ(cmp->getPredicate(), llvm::CmpInst::FCMP_OLT);
+  auto bound = llvm::dyn_cast<llvm::ConstantFP>(cmp->getOperand(1));
+  ASSERT_NE(bound, nullptr);
+  EXPECT_EQ(bound->getValueAPF().convertToDouble(), 4.0);
+
+  // Comparing with a variable squares it, which is not exact
+  EXPECT_TRUE(calls("outside", llvm::Intrinsic::sqrt));
+  EXPECT_FALSE(calls("fastInside", llvm::Intrinsic::sqrt));
+}
+
+TEST(complex_algebra_test, real_division) {
+  compile("@fastmath fun fast :complex (z :complex, x :double) {\
+    return z / x;\
+  }\
+  fun strict :complex (z :complex, x :double) { return z / x; }\
+  fun main :int () { return 0; }");
+
+  EXPECT_EQ(instructions("fast", llvm::Instruction::FDiv), 2);
+  EXPECT_EQ(instructions("fast", llvm::Instruction::FMul), 0);
+  EXPECT_EQ(instructions("strict", llvm::Instruction::FDiv), 2);
+  EXPECT_NE(instructions("strict", llvm::Instruction::FMul), 0);
+}
+
+TEST(complex_algebra_test, norm) {
+  compile("@fastmath fun fast :complex (z :complex) {\
+    return z * conj(z);\
+  }\
+  fun strict :complex (z :complex) { return z * conj(z); }\
+  fun main :int () { return 0; }");
+
+  // The real part is computed exactly the same way, just without negation
+  EXPECT_EQ(instructions("strict", llvm::Instruction::FSub), 0);
+  EXPECT_EQ(instructions("strict", llvm::Instruction::FAdd), 2);
+  EXPECT_EQ(instructions("fast", llvm::Instruction::FAdd), 0);
+  EXPECT_EQ(instructions("fast", llvm::Instruction::FNeg), 0);
+  EXPECT_TRUE(calls("fast", llvm::Intrinsic::fmuladd));
+}
+
+TEST(complex_algebra_test, fused_squares) {
+  compile("@fastmath fun fast :double (a :double, b :double) {\
+    return a * a + b * b;\
+  }\
+  fun strict :double (a :double, b :double) { return a * a + b * b; }\
+  fun main :int () { return 0; }");
+
+  EXPECT_TRUE(calls("fast", llvm::Intrinsic::fmuladd));
+  EXPECT_EQ(instructions("fast", llvm::Instruction::FAdd), 0);
+  EXPECT_FALSE(calls("strict", llvm::Intrinsic::fmuladd));
+}
+
+TEST(profile_test, instrument) {
+  std::stringstream ss("fun f :int (n :int) {\
+    while (n > 1) { if (n > 10) { n = n - 10; } n = n - 1; }\
+    return n;\
+  }\
+  fun main :int () { return 0; }");
+  Lexer lexer(ss);
+  Parser parser(lexer);
+  parser.parse();
+  Optimizer optimizer;
+  optimizer.profileGenerate = "test.profile";
+  optimizer.run(*Node::module);
+
+  // One counter for the calls of f, two for each branch and one for main
+  auto counters = Node::module->getNamedGlobal("ps.profile.counters");
+  ASSERT_NE(counters, nullptr);
+  EXPECT_EQ(counters->getValueType()->getArrayNumElements(), 6u);
+  EXPECT_EQ(instructions("f", llvm::Instruction::AtomicRMW), 5u);
+  // f was inferred to read no memory before the counters were added
+  llvm::Function *f = Node::module->getFunction("f");
+  EXPECT_FALSE(f->onlyReadsMemory());
+  EXPECT_FALSE(f->hasNoSync());
+  EXPECT_NE(Node::module->getFunction("ps_profile_init"), nullptr);
+  EXPECT_NE(Node::module->getNamedGlobal("llvm.global_ctors"), nullptr);
+}
+
+TEST(profile_test, use) {
+  const char *program = "fun f :int (n :int) {\
+    while (n > 1) { if (n > 10) { n = n - 10; } n = n - 1; }\
+    return n;\
+  }\
+  fun main :int () { return 0; }";
+  const std::string file = "profile_test.profile";
+  // Only the first profile matches the program
+  for (auto [profile, matches] :
+       {std::pair{"f 5 100 95 95 3\nmain 1\n", true},
+        {"f 5 100 95\nmain 1\n", false},
+        {"f 5 100 95 x 3\nmain 1\n", false},
+        {"f 5 10 95 95 3\nmain 1\n", false}}) {
+    std::ofstream(file) << profile;
+    std::stringstream ss(program);
+    Lexer lexer(ss);
+    Parser parser(lexer);
+    parser.parse();
+    Optimizer optimizer;
+    optimizer.profileUse = file;
+    if (!matches) {
+      EXPECT_THROW(optimizer.run(*Node::module), ProfileError) << profile;
+      continue;
+    }
+    optimizer.run(*Node::module);
+
+    llvm::Function *f = Node::module->getFunction("f");
+    EXPECT_EQ(f->getEntryCount()->getCount(), 5u);
+    std::vector<std::pair<uint64_t, uint64_t>> weights;
+    for (llvm::BasicBlock &block : *f) {
+      auto branch = llvm::dyn_cast<llvm::BranchInst>(block.getTerminator());
+      uint64_t taken, untaken;
+      if (branch && branch->extractProfMetadata(taken, untaken)) {
+        weights.emplace_back(taken, untaken);
+      }
+    }
+    EXPECT_EQ(weights, (std::vector<std::pair<uint64_t, uint64_t>>{
+                           {95, 5}, {3, 92}}));
+    EXPECT_NE(Node::module->getProfileSummary(false), nullptr);
+  }
+  std::remove(file.c_str());
+}
@@ -0,0 +1,37 @@
+#include "runtime.h"
+#include <cstdio>
+#include <cstdlib>
+
+// Errors flush the output of the program first, which abort would discard
+
+void ps_bounds_error(int64_t index, int64_t length, int64_t line) {
+  std::fflush(stdout);
+  std::fprintf(stderr,
+               "[ERROR] Index %lld is out of bounds of array of length %lld "
+               "at line %lld\n",
+               static_cast<long long>(index), static_cast<long long>(length),
+               static_cast<long long>(line));
+  std::abort();
+}
+
+void *ps_alloc(int64_t length, int64_t size, int64_t line) {
+  if (length < 0) {
+    std::fflush(stdout);
+    std::fprintf(stderr, "[ERROR] Negative array length %lld at line %lld\n",
+                 static_cast<long long>(length),
+                 static_cast<long long>(line));
+    std::abort();
+  }
+  // malloc(0) may return null, which is not a failure
+  void *data = nullptr;
+  if (length > 0 && (length > INT64_MAX / size ||
+                     !(data = std::malloc(length * size)))) {
+    std::fflush(stdout);
+    std::fprintf(stderr,
+                 "[ERROR] Cannot allocate array of length %lld at line %lld\n",
+                 static_cast<long long>(length),
+                 static_cast<long long>(line));
+    std::abort();
+  }
+  return data;
+}
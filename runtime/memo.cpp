@@ -0,0 +1,76 @@
+#include "runtime.h"
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+/**
+ * Results by the bytes of the arguments. Entries are kept in the order of
+ * their last use, most recent first, when the capacity is bounded.
+ **/
+struct ps_memo {
+  using Entry = std::pair<std::string, std::string>;
+
+  std::mutex mutex;
+  int64_t capacity;
+  std::list<Entry> entries;
+  std::unordered_map<std::string, std::list<Entry>::iterator> index;
+
+  explicit ps_memo(int64_t capacity_) : capacity(capacity_) {}
+};
+
+namespace {
+// Creates the cache of a function when it is first called
+ps_memo *get(ps_memo **cache, int64_t capacity) {
+  static std::mutex creation;
+  ps_memo *memo = __atomic_load_n(cache, __ATOMIC_ACQUIRE);
+  if (!memo) {
+    std::lock_guard<std::mutex> lock(creation);
+    memo = *cache;
+    if (!memo) {
+      memo = new ps_memo(capacity);
+      __atomic_store_n(cache, memo, __ATOMIC_RELEASE);
+    }
+  }
+  return memo;
+}
+} // namespace
+
+int32_t ps_memo_lookup(ps_memo **cache, int64_t capacity, const void *key,
+                       int64_t key_size, void *result, int64_t result_size) {
+  ps_memo *memo = get(cache, capacity);
+  std::lock_guard<std::mutex> lock(memo->mutex);
+  auto entry = memo->index.find(
+      std::string(static_cast<const char *>(key), key_size));
+  if (entry == memo->index.end()) {
+    return 0;
+  }
+  if (memo->capacity > 0) {
+    memo->entries.splice(memo->entries.begin(), memo->entries, entry->second);
+  }
+  std::memcpy(result, entry->second->second.data(), result_size);
+  return 1;
+}
+
+void ps_memo_store(ps_memo **cache, int64_t capacity, const void *key,
+                   int64_t key_size, const void *result,
+                   int64_t result_size) {
+  ps_memo *memo = get(cache, capacity);
+  std::lock_guard<std::mutex> lock(memo->mutex);
+  std::string bytes(static_cast<const char *>(key), key_size);
+  std::string value(static_cast<const char *>(result), result_size);
+  // Another thread may have computed the same result in the meantime
+  auto entry = memo->index.find(bytes);
+  if (entry != memo->index.end()) {
+    entry->second->second = std::move(value);
+    return;
+  }
+  memo->entries.emplace_front(bytes, std::move(value));
+  memo->index.emplace(std::move(bytes), memo->entries.begin());
+  if (memo->capacity > 0 &&
+      memo->entries.size() > static_cast<uint64_t>(memo->capacity)) {
+    memo->index.erase(memo->entries.back().first);
+    memo->entries.pop_back();
+  }
+}
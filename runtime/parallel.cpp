@@ -0,0 +1,200 @@
+#include "runtime.h"
+#include "threads.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Set in threads running a parallel loop, nested loops run serially there
+thread_local bool ps_serial_loops = false;
+
+namespace {
+/**
+ * Threads are started with the first parallel loop and wait for the next
+ * one in between. The thread starting a loop takes part in it as worker 0.
+ * PS_THREADS sets the number of threads, by default there is one per core.
+ **/
+class ThreadPool {
+  std::vector<std::thread> threads;
+  std::mutex mutex, running;
+  std::condition_variable started, finished;
+  uint64_t generation = 0;
+  size_t active = 0;
+  bool stopped = false;
+
+  // The loop being run
+  ps_loop_body body = nullptr;
+  void *context = nullptr;
+  int64_t iterations = 0, chunk = 0;
+  std::atomic<int64_t> next{0};
+
+  void work(size_t worker) {
+    if (chunk == 0) {
+      // Worker w gets iterations / n, the first iterations % n one more
+      const int64_t n = size(), share = iterations / n,
+                    rest = iterations % n, w = worker;
+      int64_t begin = w * share + std::min(w, rest);
+      int64_t end = begin + share + (w < rest);
+      if (begin < end) {
+        body(context, begin, end);
+      }
+      return;
+    }
+    for (int64_t begin = next.fetch_add(chunk); begin < iterations;
+         begin = next.fetch_add(chunk)) {
+      body(context, begin, std::min(begin + chunk, iterations));
+    }
+  }
+
+  void loop(size_t worker) {
+    ps_serial_loops = true;
+    uint64_t seen = 0;
+    while (true) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        started.wait(lock, [&] { return stopped || generation != seen; });
+        if (stopped) {
+          return;
+        }
+        seen = generation;
+      }
+      work(worker);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--active == 0) {
+        finished.notify_one();
+      }
+    }
+  }
+
+public:
+  ThreadPool() {
+    size_t count = std::thread::hardware_concurrency();
+    if (const char *env = std::getenv("PS_THREADS")) {
+      count = std::strtoul(env, nullptr, 10);
+    }
+    for (size_t worker = 1; worker < count; ++worker) {
+      threads.emplace_back(&ThreadPool::loop, this, worker);
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopped = true;
+    }
+    started.notify_all();
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  static ThreadPool &get() {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  size_t size() const { return threads.size() + 1; }
+
+  /**
+   * Returns false without running the loop if another one is running. Its
+   * threads may wait in a sync for a task of the calling thread, which would
+   * never finish if it waited for the pool in turn.
+   **/
+  bool run(ps_loop_body body_, void *context_, int64_t iterations_,
+           int64_t chunk_) {
+    std::unique_lock<std::mutex> turn(running, std::try_to_lock);
+    if (!turn) {
+      return false;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      body = body_;
+      context = context_;
+      iterations = iterations_;
+      chunk = chunk_;
+      next = 0;
+      active = threads.size();
+      ++generation;
+    }
+    started.notify_all();
+
+    ps_serial_loops = true;
+    work(0);
+    ps_serial_loops = false;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [&] { return active == 0; });
+    return true;
+  }
+};
+
+std::mutex reduction;
+
+// Overflow wraps around instead of being undefined
+int64_t combine(int64_t a, int64_t b, int32_t op) {
+  switch (op) {
+  case PS_ADD:
+    return (int64_t)((uint64_t)a + (uint64_t)b);
+  case PS_MUL:
+    return (int64_t)((uint64_t)a * (uint64_t)b);
+  case PS_MIN:
+    return std::min(a, b);
+  default:
+    return std::max(a, b);
+  }
+}
+
+// Minimum and maximum ignore NaN, as the built-in min() and max() do
+double combine(double a, double b, int32_t op) {
+  switch (op) {
+  case PS_ADD:
+    return a + b;
+  case PS_MUL:
+    return a * b;
+  case PS_MIN:
+    return std::fmin(a, b);
+  default:
+    return std::fmax(a, b);
+  }
+}
+} // namespace
+
+extern "C" {
+void ps_parallel_for(ps_loop_body body, void *context, int64_t iterations,
+                     int64_t chunk) {
+  if (iterations <= 0) {
+    return;
+  }
+  if (ps_serial_loops || ThreadPool::get().size() == 1 ||
+      !ThreadPool::get().run(body, context, iterations, chunk)) {
+    body(context, 0, iterations);
+  }
+}
+
+void ps_reduce_int(int64_t *shared, int64_t value, int32_t op) {
+  std::lock_guard<std::mutex> lock(reduction);
+  *shared = combine(*shared, value, op);
+}
+
+void ps_reduce_double(double *shared, double value, int32_t op) {
+  std::lock_guard<std::mutex> lock(reduction);
+  *shared = combine(*shared, value, op);
+}
+
+// Multiplication uses the same formula as the compiled code
+void ps_reduce_complex(double *shared, double re, double im, int32_t op) {
+  std::lock_guard<std::mutex> lock(reduction);
+  if (op == PS_ADD) {
+    shared[0] += re;
+    shared[1] += im;
+  } else {
+    double real = shared[0] * re - shared[1] * im;
+    shared[1] = shared[0] * im + shared[1] * re;
+    shared[0] = real;
+  }
+}
+}
@@ -0,0 +1,101 @@
+#include "runtime.h"
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+struct Registration {
+  std::string file;
+  const char *const *names;
+  const int64_t *sizes;
+  int64_t functions;
+  int64_t *counters;
+};
+
+// Programs register their counters from a constructor, which may run
+// before static variables of the library are initialized
+std::vector<Registration> &registrations() {
+  static std::vector<Registration> registered;
+  return registered;
+}
+
+using Counts = std::vector<std::pair<std::string, std::vector<int64_t>>>;
+
+// Functions of the profile file, one per line with its name and counters
+Counts read(const std::string &file) {
+  Counts counts;
+  std::ifstream in(file);
+  std::string line;
+  while (std::getline(in, line)) {
+    std::istringstream fields(line);
+    std::string name;
+    if (!(fields >> name)) {
+      continue;
+    }
+    std::vector<int64_t> values;
+    for (int64_t value; fields >> value;) {
+      values.push_back(value);
+    }
+    counts.emplace_back(name, std::move(values));
+  }
+  return counts;
+}
+
+/**
+ * Counts of earlier runs are kept and added to, unless the function was
+ * changed since and has another number of counters.
+ **/
+void write() {
+  for (const Registration &registration : registrations()) {
+    Counts counts = read(registration.file);
+    std::unordered_map<std::string, size_t> index;
+    for (size_t i = 0; i < counts.size(); ++i) {
+      index[counts[i].first] = i;
+    }
+    const int64_t *counter = registration.counters;
+    for (int64_t i = 0; i < registration.functions; ++i) {
+      std::vector<int64_t> values(counter, counter + registration.sizes[i]);
+      counter += registration.sizes[i];
+      auto found = index.find(registration.names[i]);
+      if (found == index.end()) {
+        index[registration.names[i]] = counts.size();
+        counts.emplace_back(registration.names[i], std::move(values));
+        continue;
+      }
+      std::vector<int64_t> &previous = counts[found->second].second;
+      if (previous.size() == values.size()) {
+        for (size_t j = 0; j < values.size(); ++j) {
+          values[j] += previous[j];
+        }
+      }
+      previous = std::move(values);
+    }
+
+    std::ofstream out(registration.file);
+    for (const auto &function : counts) {
+      out << function.first;
+      for (int64_t value : function.second) {
+        out << ' ' << value;
+      }
+      out << '\n';
+    }
+    if (!out) {
+      std::fprintf(stderr, "Cannot write profile file %s\n",
+                   registration.file.c_str());
+    }
+  }
+}
+} // namespace
+
+void ps_profile_init(const char *file, const char *const *names,
+                     const int64_t *sizes, int64_t functions,
+                     int64_t *counters) {
+  if (registrations().empty()) {
+    std::atexit(write);
+  }
+  registrations().push_back({file, names, sizes, functions, counters});
+}
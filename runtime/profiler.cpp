@@ -0,0 +1,122 @@
+#include "runtime.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <vector>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace {
+// Call of an instrumented function, with the cycles of the calls it made
+struct Frame {
+  ps_site *site;
+  int64_t start, children;
+};
+
+thread_local std::vector<Frame> calls;
+
+std::mutex mutex;
+
+std::vector<ps_site *> &sites() {
+  static std::vector<ps_site *> registered;
+  return registered;
+}
+
+void add(int64_t *counter, int64_t value) {
+  __atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+/**
+ * Functions by the cycles spent in their own code, then while loops by the
+ * cycles spent in them. Shares are of the cycles of all functions, which
+ * are summed over threads.
+ **/
+void report() {
+  // Output of the program comes first
+  std::fflush(stdout);
+  std::vector<ps_site *> functions, loops;
+  int64_t total = 0;
+  for (ps_site *site : sites()) {
+    (site->loop ? loops : functions).push_back(site);
+    total += site->loop ? 0 : site->cycles;
+  }
+  auto hotter = [](ps_site *a, ps_site *b) { return a->cycles > b->cycles; };
+  std::sort(functions.begin(), functions.end(), hotter);
+  std::sort(loops.begin(), loops.end(), hotter);
+  auto share = [&](int64_t cycles) {
+    return total > 0 ? 100.0 * cycles / total : 0.0;
+  };
+
+  std::fprintf(stderr, "\nFlat profile:\n%8s %16s %12s  %s\n", "%", "cycles",
+               "calls", "function");
+  for (ps_site *site : functions) {
+    std::fprintf(stderr, "%7.2f%% %16lld %12lld  %s (line %lld)\n",
+                 share(site->cycles), static_cast<long long>(site->cycles),
+                 static_cast<long long>(site->count), site->function,
+                 static_cast<long long>(site->line));
+  }
+  if (loops.empty()) {
+    return;
+  }
+  std::fprintf(stderr, "\nHot loops:\n%8s %16s %12s %14s  %s\n", "%",
+               "cycles", "runs", "iterations", "line");
+  for (ps_site *site : loops) {
+    std::fprintf(stderr, "%7.2f%% %16lld %12lld %14lld  %lld in %s\n",
+                 share(site->cycles), static_cast<long long>(site->cycles),
+                 static_cast<long long>(site->count),
+                 static_cast<long long>(site->iterations),
+                 static_cast<long long>(site->line), site->function);
+  }
+}
+
+void reach(ps_site *site) {
+  if (__atomic_load_n(&site->registered, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex);
+  if (site->registered) {
+    return;
+  }
+  if (sites().empty()) {
+    std::atexit(report);
+  }
+  sites().push_back(site);
+  __atomic_store_n(&site->registered, 1, __ATOMIC_RELEASE);
+}
+} // namespace
+
+int64_t ps_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return static_cast<int64_t>(__rdtsc());
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+#endif
+}
+
+void ps_instrument_enter(ps_site *function) {
+  reach(function);
+  calls.push_back({function, ps_cycles(), 0});
+}
+
+void ps_instrument_exit(void) {
+  const Frame frame = calls.back();
+  calls.pop_back();
+  const int64_t cycles = ps_cycles() - frame.start;
+  add(&frame.site->count, 1);
+  add(&frame.site->cycles, cycles - frame.children);
+  if (!calls.empty()) {
+    calls.back().children += cycles;
+  }
+}
+
+void ps_instrument_loop(ps_site *loop, int64_t iterations, int64_t start) {
+  reach(loop);
+  add(&loop->count, 1);
+  add(&loop->iterations, iterations);
+  add(&loop->cycles, ps_cycles() - start);
+}
@@ -0,0 +1,243 @@
+#include "runtime.h"
+#include "threads.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+/**
+ * Chase-Lev deque of a fixed size, with the memory orders of Le et al.,
+ * "Correct and Efficient Work-Stealing for Weak Memory Models". The owner
+ * pushes and pops at the bottom, thieves steal from the top.
+ **/
+class Deque {
+  static constexpr int64_t CAPACITY = 1024;
+  alignas(64) std::atomic<int64_t> top{0};
+  alignas(64) std::atomic<int64_t> bottom{0};
+  std::atomic<ps_task *> tasks[CAPACITY];
+
+public:
+  bool push(ps_task *task) {
+    int64_t b = bottom.load(std::memory_order_relaxed);
+    int64_t t = top.load(std::memory_order_acquire);
+    if (b - t >= CAPACITY) {
+      return false;
+    }
+    tasks[b % CAPACITY].store(task, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  ps_task *pop() {
+    int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+    bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top.load(std::memory_order_relaxed);
+    if (t > b) {
+      bottom.store(b + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    ps_task *task = tasks[b % CAPACITY].load(std::memory_order_relaxed);
+    if (t == b) {
+      // The last task, a thief may be taking it at the same time
+      if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed)) {
+        task = nullptr;
+      }
+      bottom.store(b + 1, std::memory_order_relaxed);
+    }
+    return task;
+  }
+
+  ps_task *steal() {
+    int64_t t = top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom.load(std::memory_order_acquire);
+    if (t >= b) {
+      return nullptr;
+    }
+    ps_task *task = tasks[t % CAPACITY].load(std::memory_order_relaxed);
+    if (!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst,
+                                     std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return task;
+  }
+};
+
+// Tasks run by the thread which spawned them, the frame is its own
+void runOwn(ps_task *task) {
+  task->run(task->context);
+  --task->frame->spawned;
+}
+
+void runStolen(ps_task *task) {
+  task->run(task->context);
+  __atomic_fetch_add(&task->frame->stolen, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Every thread which spawns a task gets a deque, up to a limit after which
+ * its tasks run right away. Worker threads are started with the first
+ * spawn, PS_THREADS sets their number with the main thread included.
+ * Workers which find nothing to steal for a while sleep until a task is
+ * pushed. Spawning does not fence against a worker just going to sleep,
+ * instead sleeping workers look for tasks every millisecond. Parallel loops
+ * in tasks run by workers run serially, as the pool may be busy with the
+ * loop which spawned the task.
+ **/
+class Scheduler {
+  static constexpr int MAX_DEQUES = 256;
+  static constexpr int SPINS = 1 << 10;
+  std::unique_ptr<Deque> deques[MAX_DEQUES];
+  std::atomic<int> registered{0};
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::atomic<int> sleeping{0};
+  uint64_t signals = 0;
+  bool stopped = false;
+  std::vector<std::thread> workers;
+
+  Scheduler() {
+    size_t count = std::thread::hardware_concurrency();
+    if (const char *env = std::getenv("PS_THREADS")) {
+      count = std::strtoul(env, nullptr, 10);
+    }
+    for (size_t worker = 1; worker < count; ++worker) {
+      workers.emplace_back(&Scheduler::work, this);
+    }
+  }
+
+  ~Scheduler() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopped = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  void work() {
+    ps_serial_loops = true;
+    Deque *own = deque();
+    int idle = 0;
+    while (true) {
+      if (ps_task *task = steal(own)) {
+        runStolen(task);
+        idle = 0;
+      } else if (++idle < SPINS) {
+        std::this_thread::yield();
+      } else {
+        std::unique_lock<std::mutex> lock(mutex);
+        uint64_t seen = signals;
+        sleeping.fetch_add(1, std::memory_order_relaxed);
+        wake.wait_for(lock, std::chrono::milliseconds(1),
+                      [&] { return stopped || signals != seen; });
+        sleeping.fetch_sub(1, std::memory_order_relaxed);
+        if (stopped) {
+          return;
+        }
+        idle = signals != seen ? 0 : idle;
+      }
+    }
+  }
+
+public:
+  static Scheduler &get() {
+    static Scheduler scheduler;
+    return scheduler;
+  }
+
+  // Deque of the calling thread, null if there are no more of them
+  Deque *deque() {
+    thread_local Deque *own = nullptr;
+    thread_local bool assigned = false;
+    if (!assigned) {
+      assigned = true;
+      std::lock_guard<std::mutex> lock(mutex);
+      int index = registered.load(std::memory_order_relaxed);
+      if (index < MAX_DEQUES) {
+        deques[index] = std::make_unique<Deque>();
+        own = deques[index].get();
+        registered.store(index + 1, std::memory_order_release);
+      }
+    }
+    return own;
+  }
+
+  // Tries the deques of other threads, starting from a random one
+  ps_task *steal(Deque *own) {
+    thread_local uint32_t seed = 2463534242u;
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    int count = registered.load(std::memory_order_acquire);
+    for (int i = 0; i < count; ++i) {
+      Deque *victim = deques[(seed + i) % count].get();
+      if (victim == own) {
+        continue;
+      }
+      if (ps_task *task = victim->steal()) {
+        return task;
+      }
+    }
+    return nullptr;
+  }
+
+  void signal() {
+    if (sleeping.load(std::memory_order_relaxed) > 0) {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++signals;
+      }
+      wake.notify_one();
+    }
+  }
+};
+} // namespace
+
+extern "C" {
+void ps_spawn(ps_frame *frame, ps_task *task) {
+  task->frame = frame;
+  Scheduler &scheduler = Scheduler::get();
+  Deque *own = scheduler.deque();
+  if (!own || !own->push(task)) {
+    task->run(task->context);
+    return;
+  }
+  ++frame->spawned;
+  scheduler.signal();
+}
+
+void ps_sync(ps_frame *frame) {
+  if (frame->spawned == 0) {
+    return;
+  }
+  Scheduler &scheduler = Scheduler::get();
+  Deque *own = scheduler.deque();
+  /**
+   * Functions called since the spawns have synced before returning, so the
+   * tasks at the bottom of the deque are those of this frame.
+   **/
+  while (frame->spawned !=
+         __atomic_load_n(&frame->stolen, __ATOMIC_ACQUIRE)) {
+    if (ps_task *task = own->pop()) {
+      runOwn(task);
+    } else if (ps_task *task = scheduler.steal(own)) {
+      runStolen(task);
+    } else {
+      std::this_thread::yield();
+    }
+  }
+  frame->spawned = 0;
+  frame->stolen = 0;
+}
+}
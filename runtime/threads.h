@@ -0,0 +1,12 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+/**
+ * State shared by the thread pool of parallel loops and the scheduler of
+ * spawned tasks, internal to the runtime library.
+ **/
+
+// Set in threads of the runtime on which parallel loops run serially
+extern thread_local bool ps_serial_loops;
+
+#endif // THREADS_H
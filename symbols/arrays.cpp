@@ -0,0 +1,441 @@
+#include "interpreter.h"
+#include "llvm/IR/MDBuilder.h"
+
+bool Index::checked = true;
+std::vector<llvm::AllocaInst *> ArrayDefinition::heap;
+
+namespace {
+// Largest local array of constant length, in bytes, kept on the stack
+const uint64_t STACK_LIMIT = 64 * 1024;
+
+// Index out of bounds, does not return
+llvm::Function *boundsError() {
+  return Node::runtime("ps_bounds_error", Node::builder.getVoidTy(),
+                       {Node::intType, Node::intType, Node::intType},
+                       {llvm::Attribute::NoReturn, llvm::Attribute::NoUnwind,
+                        llvm::Attribute::NoRecurse, llvm::Attribute::Cold});
+}
+
+// Allocation of a heap array, which fails if the length is negative
+llvm::Function *allocate() {
+  llvm::Function *func =
+      Node::runtime("ps_alloc", Node::builder.getInt8PtrTy(),
+                    {Node::intType, Node::intType, Node::intType},
+                    {llvm::Attribute::NoUnwind, llvm::Attribute::NoRecurse});
+  func->addRetAttr(llvm::Attribute::NoAlias);
+  return func;
+}
+
+// Frees the heap array a slot points to, if there is one
+void deallocate(llvm::AllocaInst *slot) {
+  llvm::IRBuilder<> &builder = Node::builder;
+  llvm::Function *free =
+      Node::runtime("free", builder.getVoidTy(), {builder.getInt8PtrTy()},
+                    {llvm::Attribute::NoUnwind, llvm::Attribute::NoRecurse,
+                     llvm::Attribute::WillReturn});
+  builder.CreateCall(
+      free, {builder.CreateBitCast(
+                builder.CreateLoad(slot->getAllocatedType(), slot),
+                builder.getInt8PtrTy())});
+}
+
+/**
+ * Splits an integer into a value and a constant added to it, following
+ * additions and subtractions which do not overflow. The value is null if the
+ * integer is a constant.
+ **/
+std::pair<llvm::Value *, int64_t> split(llvm::Value *value) {
+  int64_t offset = 0;
+  for (;;) {
+    if (auto constant = llvm::dyn_cast<llvm::ConstantInt>(value)) {
+      int64_t sum;
+      if (__builtin_add_overflow(offset, constant->getSExtValue(), &sum)) {
+        break;
+      }
+      return {nullptr, sum};
+    }
+    auto op = llvm::dyn_cast<llvm::BinaryOperator>(value);
+    if (!op || (op->getOpcode() != llvm::Instruction::Add &&
+                op->getOpcode() != llvm::Instruction::Sub) ||
+        !op->hasNoSignedWrap()) {
+      break;
+    }
+    bool add = op->getOpcode() == llvm::Instruction::Add;
+    llvm::Value *other = op->getOperand(0);
+    auto constant = llvm::dyn_cast<llvm::ConstantInt>(op->getOperand(1));
+    if (!constant && add) {
+      other = op->getOperand(1);
+      constant = llvm::dyn_cast<llvm::ConstantInt>(op->getOperand(0));
+    }
+    int64_t sum;
+    if (!constant ||
+        (add ? __builtin_add_overflow(offset, constant->getSExtValue(), &sum)
+             : __builtin_sub_overflow(offset, constant->getSExtValue(),
+                                      &sum))) {
+      break;
+    }
+    offset = sum;
+    value = other;
+  }
+  return {value, offset};
+}
+
+/**
+ * Whether the index is in bounds whenever it is computed. An index equal to
+ * the counter of an enclosing for loop plus a constant lies between the
+ * bounds of the loop plus the constant, which are compared with 0 and the
+ * length when they are constants or the same value plus constants.
+ **/
+bool inBounds(llvm::Value *index, llvm::Value *length) {
+  auto low = split(index), high = low;
+  for (Loop *loop : Loop::active) {
+    auto counted = dynamic_cast<ForStatement *>(loop);
+    if (!low.first || !counted || counted->induction != low.first) {
+      continue;
+    }
+    auto first = split(counted->from), last = split(counted->to);
+    if (counted->step < 0) {
+      std::swap(first, last);
+    }
+    if (__builtin_add_overflow(first.second, low.second, &first.second) ||
+        __builtin_add_overflow(last.second, high.second, &last.second)) {
+      return false;
+    }
+    low = first;
+    high = last;
+    break;
+  }
+  auto size = split(length);
+  return !low.first && low.second >= 0 && high.first == size.first &&
+         high.second < size.second;
+}
+} // namespace
+
+Index::Index(Token name, expr_ptr index_, std::string field_)
+    : Expression(std::move(name)), index(std::move(index_)),
+      field(std::move(field_)) {}
+
+llvm::Value *Index::position(llvm::Value *length, const std::string &of) {
+  llvm::Value *i = index->generate();
+  if (i->getType() == int32Type) {
+    i = expand(i, intType);
+  }
+  if (i->getType() != intType) {
+    error("Index of " + of + " must be an integer", token.line);
+  }
+
+  auto constant = llvm::dyn_cast<llvm::ConstantInt>(i);
+  auto size = llvm::dyn_cast<llvm::ConstantInt>(length);
+  if (constant && size &&
+      (constant->isNegative() ||
+       constant->getSExtValue() >= size->getSExtValue())) {
+    error("Index " + std::to_string(constant->getSExtValue()) +
+              " is out of bounds of " + of,
+          token.line);
+  }
+
+  if (checked && !inBounds(i, length)) {
+    // A negative index is a large unsigned one, so one comparison is enough
+    llvm::Function *func = builder.GetInsertBlock()->getParent();
+    llvm::BasicBlock *fail = llvm::BasicBlock::Create(context, "", func),
+                     *pass = llvm::BasicBlock::Create(context, "", func);
+    builder.CreateCondBr(builder.CreateICmpULT(i, length), pass, fail,
+                         llvm::MDBuilder(context).createBranchWeights(
+                             (1U << 20) - 1, 1));
+    ssa.seal(pass);
+    ssa.seal(fail);
+    builder.SetInsertPoint(fail);
+    builder.CreateCall(
+        boundsError(),
+        {i, length, llvm::ConstantInt::get(intType, token.line)});
+    builder.CreateUnreachable();
+    builder.SetInsertPoint(pass);
+  }
+  return i;
+}
+
+TypeID Index::type(Identifier *array) {
+  const std::string name = token.getString();
+  if (!array->record) {
+    if (!field.empty()) {
+      error("Elements of " + name + " have no fields", token.line);
+    }
+    return array->type;
+  }
+  if (field.empty()) {
+    error("Expected a field of an element of " + name, token.line);
+  }
+  size_t k = array->record->field(field);
+  if (k == array->record->fields.size()) {
+    error("Struct " + array->record->token.getString() + " has no field " +
+              field,
+          token.line);
+  }
+  return array->record->fields[k]->type;
+}
+
+llvm::Value *Index::address() {
+  const std::string name = token.getString();
+  Identifier *array = getSymbol(name);
+  if (!array->length) {
+    error("Variable " + name + " is not an array", token.line);
+  }
+  llvm::Type *element = getType(type(array));
+  llvm::Value *i = position(array->length, "array " + name);
+  if (!array->record) {
+    return builder.CreateInBoundsGEP(element, array->alloc, i);
+  }
+  const size_t k = array->record->field(field);
+  if (array->record->soa) {
+    return builder.CreateInBoundsGEP(element, array->columns[k], i);
+  }
+  return builder.CreateInBoundsGEP(array->record->type, array->alloc,
+                                   {i, builder.getInt32(k)});
+}
+
+llvm::Value *Index::generate() {
+  const std::string name = token.getString();
+  Identifier *symbol = getSymbol(name);
+  if (!symbol->length && field.empty()) {
+    if (auto vector =
+            llvm::dyn_cast<llvm::FixedVectorType>(getType(symbol->type))) {
+      llvm::Value *value = Identifier(token, symbol->type).generate();
+      return builder.CreateExtractElement(
+          value,
+          position(llvm::ConstantInt::get(intType, vector->getNumElements()),
+                   "vector " + name));
+    }
+  }
+  llvm::Value *ptr = address();
+  return builder.CreateLoad(getType(type(symbol)), ptr);
+}
+
+ArrayDefinition::ArrayDefinition(id_ptr identifier_, expr_ptr length_,
+                                 expr_ptr expression_)
+    : Statement(identifier_->token), identifier(std::move(identifier_)),
+      length(std::move(length_)), expression(std::move(expression_)) {}
+
+void ArrayDefinition::release() {
+  for (llvm::AllocaInst *slot : heap) {
+    deallocate(slot);
+  }
+}
+
+void ArrayDefinition::fill(llvm::Value *array, llvm::Value *count,
+                           llvm::Value *value) {
+  llvm::BasicBlock *entry = builder.GetInsertBlock();
+  llvm::Function *func = entry->getParent();
+  llvm::BasicBlock *loop = llvm::BasicBlock::Create(context, "", func),
+                   *exit = llvm::BasicBlock::Create(context, "", func);
+  builder.CreateCondBr(builder.CreateICmpSGT(count, INT_ZERO), loop, exit);
+  builder.SetInsertPoint(loop);
+  llvm::PHINode *i = builder.CreatePHI(intType, 2);
+  builder.CreateStore(value,
+                      builder.CreateInBoundsGEP(value->getType(), array, i));
+  llvm::Value *next =
+      builder.CreateNSWAdd(i, llvm::ConstantInt::get(intType, 1));
+  i->addIncoming(INT_ZERO, entry);
+  i->addIncoming(next, loop);
+  builder.CreateCondBr(builder.CreateICmpSLT(next, count), loop, exit);
+  ssa.seal(loop);
+  ssa.seal(exit);
+  builder.SetInsertPoint(exit);
+}
+
+llvm::Value *ArrayDefinition::storage(llvm::Type *type, llvm::Value *count,
+                                     llvm::Value *init,
+                                     const std::string &name) {
+  auto constant = llvm::dyn_cast<llvm::ConstantInt>(count);
+  llvm::BasicBlock *block = builder.GetInsertBlock();
+  if (!block) {
+    auto value = llvm::cast<llvm::Constant>(init);
+    auto arrayType = llvm::ArrayType::get(type, constant->getZExtValue());
+    llvm::Constant *data =
+        value->isNullValue()
+            ? llvm::ConstantAggregateZero::get(arrayType)
+            : llvm::ConstantArray::get(
+                  arrayType, std::vector<llvm::Constant *>(
+                                 constant->getZExtValue(), value));
+    auto global = new llvm::GlobalVariable(*module, arrayType, false,
+                                           llvm::GlobalValue::InternalLinkage,
+                                           data, name);
+    llvm::Constant *first[] = {INT_ZERO, INT_ZERO};
+    return llvm::ConstantExpr::getInBoundsGetElementPtr(arrayType, global,
+                                                        first);
+  }
+
+  llvm::Value *alloc;
+  llvm::Function *func = block->getParent();
+  llvm::IRBuilder<> allocaBuilder(&func->getEntryBlock(),
+                                  func->getEntryBlock().begin());
+  if (constant &&
+      constant->getZExtValue() <=
+          STACK_LIMIT / module->getDataLayout().getTypeAllocSize(type)) {
+    auto arrayType = llvm::ArrayType::get(type, constant->getZExtValue());
+    llvm::Value *data = allocaBuilder.CreateAlloca(arrayType, nullptr, name);
+    alloc = allocaBuilder.CreateInBoundsGEP(arrayType, data,
+                                            {INT_ZERO, INT_ZERO});
+  } else {
+    // The slot keeps the array of the previous execution, null at first
+    llvm::Type *pointer = type->getPointerTo();
+    llvm::AllocaInst *slot = allocaBuilder.CreateAlloca(pointer);
+    allocaBuilder.CreateStore(
+        llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(pointer)),
+        slot);
+    heap.push_back(slot);
+    deallocate(slot);
+    llvm::Value *memory = builder.CreateCall(
+        allocate(), {count, llvm::ConstantExpr::getSizeOf(type),
+                     llvm::ConstantInt::get(intType, token.line)});
+    alloc = builder.CreateBitCast(memory, pointer, name);
+    builder.CreateStore(alloc, slot);
+  }
+  fill(alloc, count, init);
+  return alloc;
+}
+
+llvm::Value *ArrayDefinition::generate() {
+  const std::string name = identifier->token.getString();
+  StructDefinition *structure = nullptr;
+  if (!record.empty()) {
+    structure = symbols.getStruct(record);
+    if (!structure) {
+      error("Unknown struct " + record, token.line);
+    }
+  } else if (identifier->type == TypeID::STRING) {
+    error("Arrays of strings are not supported", token.line);
+  }
+  Identifier *previous = symbols.get(name);
+  if (previous && SpawnStatement::isPending(previous)) {
+    error("Variable " + name + " is redefined before sync", token.line);
+  }
+
+  // The length is constant if it can be computed during compilation
+  llvm::Value *count = interpreter.fold(*length);
+  llvm::BasicBlock *block = builder.GetInsertBlock();
+  if (!count && block) {
+    count = length->generate();
+  }
+  if (count && count->getType() == int32Type) {
+    count = expand(count, intType);
+  }
+  auto constant = llvm::dyn_cast_or_null<llvm::ConstantInt>(count);
+  if (!count || count->getType() != intType || (!block && !constant)) {
+    error("Length of array " + name + " must be " +
+              (block ? "an integer" : "a constant integer"),
+          token.line);
+  }
+  if (constant && constant->isNegative()) {
+    error("Length of array " + name + " is negative", token.line);
+  }
+
+  llvm::Value *init;
+  if (!block) {
+    init = interpreter.fold(*expression);
+    if (!init) {
+      error("Initial value of global array " + name + " must be constant",
+            token.line);
+    }
+  } else {
+    init = expression->generate();
+  }
+
+  auto symbol =
+      std::make_unique<Identifier>(identifier->token, identifier->type);
+  symbol->length = count;
+  symbol->record = structure;
+  if (!structure) {
+    llvm::Type *type = getType(identifier->type);
+    symbol->alloc = storage(type, count, expand(init, type), name);
+  } else if (structure->soa) {
+    for (auto &field : structure->fields) {
+      llvm::Type *type = getType(field->type);
+      symbol->columns.push_back(
+          storage(type, count, expand(init, type),
+                   name + "." + field->token.getString()));
+    }
+  } else {
+    llvm::Value *element = llvm::PoisonValue::get(structure->type);
+    for (unsigned k = 0; k < structure->fields.size(); ++k) {
+      element = builder.CreateInsertValue(
+          element, expand(init, getType(structure->fields[k]->type)), k);
+    }
+    symbol->alloc = storage(structure->type, count, element, name);
+  }
+  symbols.add(name, std::move(symbol));
+  return TRUE;
+}
+
+StructDefinition::StructDefinition(Token name, std::vector<id_ptr> &fields_,
+                                   bool soa_)
+    : Statement(std::move(name)), fields(std::move(fields_)), soa(soa_),
+      type(nullptr) {}
+
+size_t StructDefinition::field(const std::string &name) const {
+  size_t k = 0;
+  while (k < fields.size() && fields[k]->token.getString() != name) {
+    ++k;
+  }
+  return k;
+}
+
+llvm::Value *StructDefinition::generate() {
+  const std::string name = token.getString();
+  if (symbols.getStruct(name)) {
+    error("Struct " + name + " is already defined", token.line);
+  }
+  if (fields.empty()) {
+    error("Struct " + name + " has no fields", token.line);
+  }
+  std::vector<llvm::Type *> types;
+  for (size_t k = 0; k < fields.size(); ++k) {
+    Identifier &field = *fields[k];
+    if (field.type == TypeID::STRING || field.type == TypeID::NONE) {
+      error("Field " + field.token.getString() + " of struct " + name +
+                " must be a number or a vector",
+            field.token.line);
+    }
+    if (this->field(field.token.getString()) != k) {
+      error("Field " + field.token.getString() + " of struct " + name +
+                " is defined twice",
+            field.token.line);
+    }
+    types.push_back(getType(field.type));
+  }
+  type = llvm::StructType::create(context, types, name);
+  symbols.addStruct(name, this);
+  return TRUE;
+}
+
+ElementAssignment::ElementAssignment(std::unique_ptr<Index> element_,
+                                     expr_ptr expression_)
+    : Statement(element_->token), element(std::move(element_)),
+      expression(std::move(expression_)) {}
+
+llvm::Value *ElementAssignment::generate() {
+  const std::string name = element->token.getString();
+  Identifier *array = getSymbol(name);
+  if (!array->length && element->field.empty() &&
+      getType(array->type)->isVectorTy()) {
+    // A lane is inserted into the vector, which is then assigned
+    Identifier *variable = assignable(name);
+    auto vector = llvm::cast<llvm::FixedVectorType>(getType(variable->type));
+    llvm::Value *lane = element->position(
+        llvm::ConstantInt::get(intType, vector->getNumElements()),
+        "vector " + name);
+    llvm::Value *value =
+        expand(expression->generate(), vector->getElementType());
+    assign(variable, builder.CreateInsertElement(
+                         Identifier(element->token, variable->type).generate(),
+                         value, lane));
+    return value;
+  }
+  llvm::Value *ptr = element->address();
+  if (array->constant) {
+    error("Cannot assign to elements of read-only view " + name, token.line);
+  }
+  llvm::Value *value =
+      expand(expression->generate(), getType(element->type(array)));
+  builder.CreateStore(value, ptr);
+  return value;
+}
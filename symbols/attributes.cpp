@@ -0,0 +1,253 @@
+#include "parse_tree.h"
+#include "llvm/IR/IntrinsicInst.h"
+#include <unordered_set>
+
+namespace {
+// Memory access of a function, from the most restrictive
+enum class Memory { NONE, READ, WRITE };
+
+struct Effects {
+  Memory memory = Memory::NONE;
+  bool unwind = false, loops = false, norecurse = true, willreturn = true;
+  std::vector<llvm::Function *> callees;
+};
+
+// Whether the pointer points into a stack allocation of the function
+bool isLocal(llvm::Value *ptr) {
+  while (auto gep = llvm::dyn_cast<llvm::GEPOperator>(ptr)) {
+    ptr = gep->getPointerOperand();
+  }
+  return llvm::isa<llvm::AllocaInst>(ptr);
+}
+
+// Finds back edges with a depth-first search of the control flow graph
+bool hasLoops(llvm::Function &func) {
+  std::unordered_map<llvm::BasicBlock *, bool> onStack;
+  std::vector<std::pair<llvm::BasicBlock *, unsigned>> stack;
+  stack.push_back({&func.getEntryBlock(), 0});
+  onStack[&func.getEntryBlock()] = true;
+  while (!stack.empty()) {
+    auto &top = stack.back();
+    llvm::Instruction *term = top.first->getTerminator();
+    if (!term || top.second >= term->getNumSuccessors()) {
+      onStack[top.first] = false;
+      stack.pop_back();
+      continue;
+    }
+    llvm::BasicBlock *succ = term->getSuccessor(top.second++);
+    auto visited = onStack.find(succ);
+    if (visited == onStack.end()) {
+      onStack[succ] = true;
+      stack.push_back({succ, 0});
+    } else if (visited->second) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Effects scan(llvm::Function &func) {
+  Effects effects;
+  effects.loops = hasLoops(func);
+  for (auto &block : func) {
+    for (auto &inst : block) {
+      Memory access = Memory::NONE;
+      if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+        access = isLocal(load->getPointerOperand()) ? Memory::NONE
+                                                    : Memory::READ;
+      } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+        access = isLocal(store->getPointerOperand()) ? Memory::NONE
+                                                     : Memory::WRITE;
+      } else if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+        llvm::Function *callee = call->getCalledFunction();
+        if (callee) {
+          effects.callees.push_back(callee);
+        } else {
+          access = Memory::WRITE;
+          effects.unwind = true;
+          effects.norecurse = false;
+        }
+      } else if (inst.mayWriteToMemory()) {
+        access = Memory::WRITE;
+      } else if (inst.mayReadFromMemory()) {
+        access = Memory::READ;
+      }
+      effects.memory = std::max(effects.memory, access);
+    }
+  }
+  return effects;
+}
+
+/**
+ * Whether the function can call itself through functions defined in module,
+ * or through external functions called by them, which might call back. The
+ * runtime calls spawned functions and bodies of parallel loops that way.
+ **/
+bool isRecursive(llvm::Function *func,
+                 std::unordered_map<llvm::Function *, Effects> &effects) {
+  std::unordered_map<llvm::Function *, bool> visited;
+  std::vector<llvm::Function *> stack(effects[func].callees);
+  while (!stack.empty()) {
+    llvm::Function *callee = stack.back();
+    stack.pop_back();
+    if (callee == func) {
+      return true;
+    }
+    if (callee->isDeclaration() && !callee->isIntrinsic() &&
+        !callee->doesNotRecurse()) {
+      return true;
+    }
+    if (visited[callee] || callee->isDeclaration()) {
+      continue;
+    }
+    visited[callee] = true;
+    const auto &callees = effects[callee].callees;
+    stack.insert(stack.end(), callees.begin(), callees.end());
+  }
+  return false;
+}
+} // namespace
+
+void inferAttributes(llvm::Module &module) {
+  std::unordered_map<llvm::Function *, Effects> effects;
+  for (auto &func : module) {
+    if (!func.isDeclaration()) {
+      effects[&func] = scan(func);
+    }
+  }
+
+  /**
+   * Memory access and unwinding start from the effects of the function body
+   * and grow with the effects of callees until nothing changes, which
+   * handles recursive functions. External functions are assumed to do
+   * anything their attributes do not rule out.
+   **/
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto &entry : effects) {
+      Effects &caller = entry.second;
+      for (llvm::Function *callee : caller.callees) {
+        Memory memory;
+        bool unwind;
+        if (callee->isDeclaration()) {
+          memory = callee->doesNotAccessMemory() ? Memory::NONE
+                   : callee->onlyReadsMemory()   ? Memory::READ
+                                                 : Memory::WRITE;
+          unwind = !callee->doesNotThrow();
+        } else {
+          memory = effects[callee].memory;
+          unwind = effects[callee].unwind;
+        }
+        if (memory > caller.memory || (unwind && !caller.unwind)) {
+          caller.memory = std::max(caller.memory, memory);
+          caller.unwind = caller.unwind || unwind;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  // External functions other than intrinsics might call back into the module
+  for (auto &entry : effects) {
+    Effects &caller = entry.second;
+    for (llvm::Function *callee : caller.callees) {
+      if (callee->isDeclaration() && !callee->isIntrinsic() &&
+          !callee->doesNotRecurse()) {
+        caller.norecurse = false;
+      }
+    }
+    caller.norecurse = caller.norecurse && !isRecursive(entry.first, effects);
+    caller.willreturn = caller.norecurse && !caller.loops;
+  }
+
+  // Functions without loops or recursion return if all of their callees do
+  for (bool changed = true; changed;) {
+    changed = false;
+    for (auto &entry : effects) {
+      Effects &caller = entry.second;
+      for (llvm::Function *callee : caller.callees) {
+        bool willreturn = callee->isDeclaration() ? callee->willReturn()
+                                                  : effects[callee].willreturn;
+        if (caller.willreturn && !willreturn) {
+          caller.willreturn = false;
+          changed = true;
+        }
+      }
+    }
+  }
+
+  for (auto &entry : effects) {
+    llvm::Function *func = entry.first;
+    const Effects &result = entry.second;
+    if (result.memory == Memory::NONE) {
+      func->addFnAttr(llvm::Attribute::ReadNone);
+    } else if (result.memory == Memory::READ) {
+      func->addFnAttr(llvm::Attribute::ReadOnly);
+    }
+    if (!result.unwind) {
+      func->addFnAttr(llvm::Attribute::NoUnwind);
+    }
+    if (result.norecurse) {
+      func->addFnAttr(llvm::Attribute::NoRecurse);
+    }
+    if (result.willreturn) {
+      func->addFnAttr(llvm::Attribute::WillReturn);
+    }
+  }
+}
+
+bool isPure(llvm::Function *func) {
+  // Runtime functions which keep the caches of memo functions or profiles,
+  // or terminate the program
+  static const std::unordered_set<std::string> runtime{
+      "ps_memo_lookup",      "ps_memo_store",      "ps_bounds_error",
+      "ps_instrument_enter", "ps_instrument_exit", "ps_instrument_loop",
+      "ps_cycles"};
+  auto readable = [](llvm::Value *ptr) {
+    auto global = llvm::dyn_cast<llvm::GlobalVariable>(
+        ptr->stripInBoundsOffsets());
+    return isLocal(ptr) || (global && global->isConstant());
+  };
+
+  std::unordered_set<llvm::Function *> visited{func};
+  std::vector<llvm::Function *> stack{func};
+  while (!stack.empty()) {
+    llvm::Function *caller = stack.back();
+    stack.pop_back();
+    for (auto &block : *caller) {
+      for (auto &inst : block) {
+        if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+          if (!readable(load->getPointerOperand())) {
+            return false;
+          }
+        } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+          if (!isLocal(store->getPointerOperand())) {
+            return false;
+          }
+        } else if (auto copy = llvm::dyn_cast<llvm::MemIntrinsic>(&inst)) {
+          auto transfer = llvm::dyn_cast<llvm::MemTransferInst>(copy);
+          if (!isLocal(copy->getDest()) ||
+              (transfer && !readable(transfer->getSource()))) {
+            return false;
+          }
+        } else if (auto call = llvm::dyn_cast<llvm::CallInst>(&inst)) {
+          llvm::Function *callee = call->getCalledFunction();
+          if (!callee) {
+            return false;
+          }
+          if (!callee->isDeclaration()) {
+            if (visited.insert(callee).second) {
+              stack.push_back(callee);
+            }
+          } else if (!callee->doesNotAccessMemory() &&
+                     !runtime.count(callee->getName().str())) {
+            return false;
+          }
+        } else if (inst.mayReadOrWriteMemory()) {
+          return false;
+        }
+      }
+    }
+  }
+  return true;
+}
@@ -0,0 +1,204 @@
+#include "parse_tree.h"
+
+namespace {
+const std::unordered_map<std::string, size_t> BUILTINS = {
+    {"sqrt", 1}, {"exp", 1}, {"sin", 1}, {"cos", 1}, {"arg", 1},
+    {"pow", 2},  {"min", 2}, {"max", 2}, {"fma", 3}, {"len", 1},
+    {"hsum", 1}, {"hmin", 1}, {"hmax", 1}, {"shuffle", 0}};
+} // namespace
+
+BuiltinCall::BuiltinCall(Token name, std::vector<expr_ptr> &args)
+    : FunctionCall(std::move(name), args) {}
+
+bool BuiltinCall::isBuiltin(const std::string &name) {
+  return BUILTINS.find(name) != BUILTINS.end();
+}
+
+size_t BuiltinCall::arity(const std::string &name) {
+  return BUILTINS.at(name);
+}
+
+llvm::Value *BuiltinCall::intrinsic(llvm::Intrinsic::ID id,
+                                    std::vector<llvm::Value *> args) {
+  return builder.CreateCall(
+      llvm::Intrinsic::getDeclaration(module.get(), id, {args[0]->getType()}),
+      args);
+}
+
+// There is no intrinsic for atan2, but it does not touch memory
+llvm::Value *BuiltinCall::arg(llvm::Value *re, llvm::Value *im) {
+  llvm::Type *type = re->getType();
+  llvm::FunctionCallee atan2 = module->getOrInsertFunction(
+      type == floatType ? "atan2f" : "atan2",
+      llvm::FunctionType::get(type, {type, type}, false));
+  if (auto func = llvm::dyn_cast<llvm::Function>(atan2.getCallee())) {
+    func->addFnAttr(llvm::Attribute::ReadNone);
+    func->addFnAttr(llvm::Attribute::NoUnwind);
+    func->addFnAttr(llvm::Attribute::NoRecurse);
+    func->addFnAttr(llvm::Attribute::WillReturn);
+  }
+  return builder.CreateCall(atan2, {im, re});
+}
+
+/**
+ * The sum is taken pairwise, in whichever order the target adds lanes of a
+ * vector fastest, so it may differ from adding them one by one.
+ **/
+llvm::Value *BuiltinCall::horizontal(const std::string &name,
+                                     llvm::Value *vector) {
+  if (!vector->getType()->isVectorTy()) {
+    error(name + "() expects a vector", token.line);
+  }
+  if (name == "hsum") {
+    llvm::IRBuilderBase::FastMathFlagGuard guard(builder);
+    llvm::FastMathFlags flags = builder.getFastMathFlags();
+    flags.setAllowReassoc();
+    builder.setFastMathFlags(flags);
+    return builder.CreateFAddReduce(
+        llvm::ConstantFP::getNegativeZero(vector->getType()->getScalarType()),
+        vector);
+  }
+  return name == "hmax" ? builder.CreateFPMaxReduce(vector)
+                        : builder.CreateFPMinReduce(vector);
+}
+
+llvm::Value *BuiltinCall::shuffle() {
+  if (arguments.size() < 2) {
+    error("Incorrect number of parameters in call to shuffle()", token.line);
+  }
+  llvm::Value *first = arguments[0]->generate(),
+              *second = arguments[1]->generate();
+  auto vector = llvm::dyn_cast<llvm::FixedVectorType>(first->getType());
+  if (!vector) {
+    error("shuffle() expects a vector", token.line);
+  }
+  const unsigned size = vector->getNumElements();
+  // Without a second vector the first lane is already generated
+  std::vector<llvm::Value *> lanes;
+  size_t from = 2;
+  if (second->getType() != vector) {
+    lanes.push_back(second);
+    second = llvm::PoisonValue::get(vector);
+    from = 1;
+  }
+  if (arguments.size() - from != size) {
+    error("shuffle() expects " + std::to_string(size) + " lanes", token.line);
+  }
+  for (size_t i = from + lanes.size(); i < arguments.size(); ++i) {
+    lanes.push_back(arguments[i]->generate());
+  }
+  std::vector<int> mask;
+  for (llvm::Value *lane : lanes) {
+    auto constant = llvm::dyn_cast<llvm::ConstantInt>(lane);
+    if (!constant || constant->isNegative() ||
+        constant->getSExtValue() >= int64_t(size * from)) {
+      error("Lanes of shuffle() must be constant integers less than " +
+                std::to_string(size * from),
+            token.line);
+    }
+    mask.push_back(constant->getSExtValue());
+  }
+  return builder.CreateShuffleVector(first, second, mask);
+}
+
+llvm::Value *BuiltinCall::generate() {
+  const std::string name = token.getString();
+  if (name == "shuffle") {
+    return shuffle();
+  }
+  if (arguments.size() != arity(name)) {
+    error("Incorrect number of parameters in call to " + name + "()",
+          token.line);
+  }
+
+  if (name == "len") {
+    auto id = dynamic_cast<Identifier *>(arguments[0].get());
+    Identifier *array = id ? symbols.get(id->token.getString()) : nullptr;
+    if (!array || !array->length) {
+      error("len() expects an array or a view", token.line);
+    }
+    return array->length;
+  }
+
+  if (name == "hsum" || name == "hmin" || name == "hmax") {
+    return horizontal(name, arguments[0]->generate());
+  }
+
+  std::vector<llvm::Value *> args;
+  std::vector<std::pair<Expression *, llvm::Value *>> operands;
+  for (const auto &argument : arguments) {
+    args.push_back(argument->generate());
+    operands.emplace_back(argument.get(), args.back());
+  }
+  llvm::Type *common = getMaxType(operands);
+
+  if (name == "min" || name == "max") {
+    for (auto &value : args) {
+      value = expand(value, common);
+    }
+    if (kind(common) == INTEGER) {
+      return intrinsic(name == "min" ? llvm::Intrinsic::smin
+                                     : llvm::Intrinsic::smax,
+                       args);
+    }
+    if (kind(common) != REAL) {
+      error("Unsupported type in call to " + name + "()", token.line);
+    }
+    return intrinsic(
+        name == "min" ? llvm::Intrinsic::minnum : llvm::Intrinsic::maxnum,
+        args);
+  }
+
+  if (kind(common) == COMPLEX) {
+    auto comp = Complex::getComponents(expand(args[0], common));
+    llvm::Value *re = comp.first, *im = comp.second;
+    if (name == "arg") {
+      return arg(re, im);
+    }
+    if (name == "exp") {
+      // e^(a + bi) = e^a * (cos(b) + i sin(b))
+      llvm::Value *length = intrinsic(llvm::Intrinsic::exp, {re});
+      return Complex::get(
+          builder.CreateFMul(length, intrinsic(llvm::Intrinsic::cos, {im})),
+          builder.CreateFMul(length, intrinsic(llvm::Intrinsic::sin, {im})));
+    }
+    if (name == "sqrt") {
+      // Principal root, its imaginary part has the sign of the argument's
+      llvm::Value *half = llvm::ConstantFP::get(re->getType(), 0.5);
+      llvm::Value *abs = intrinsic(
+          llvm::Intrinsic::sqrt,
+          {builder.CreateFAdd(builder.CreateFMul(re, re),
+                              builder.CreateFMul(im, im))});
+      llvm::Value *rootRe =
+          intrinsic(llvm::Intrinsic::sqrt,
+                    {builder.CreateFMul(builder.CreateFAdd(abs, re), half)});
+      llvm::Value *rootIm =
+          intrinsic(llvm::Intrinsic::sqrt,
+                    {builder.CreateFMul(builder.CreateFSub(abs, re), half)});
+      return Complex::get(
+          rootRe, intrinsic(llvm::Intrinsic::copysign, {rootIm, im}));
+    }
+    error("Unsupported type in call to " + name + "()", token.line);
+  }
+
+  // Functions of integers are computed in reals of the same width
+  llvm::Type *real =
+      common->isVectorTy() ? common : numeric(REAL, isNarrow(common));
+  for (auto &value : args) {
+    value = expand(value, real);
+  }
+  if (name == "arg" && real->isVectorTy()) {
+    error("Unsupported type in call to arg()", token.line);
+  }
+  if (name == "arg") {
+    return arg(args[0], llvm::ConstantFP::get(real, 0.0));
+  }
+  static const std::unordered_map<std::string, llvm::Intrinsic::ID>
+      intrinsics = {{"sqrt", llvm::Intrinsic::sqrt},
+                    {"exp", llvm::Intrinsic::exp},
+                    {"sin", llvm::Intrinsic::sin},
+                    {"cos", llvm::Intrinsic::cos},
+                    {"pow", llvm::Intrinsic::pow},
+                    {"fma", llvm::Intrinsic::fma}};
+  return intrinsic(intrinsics.at(name), args);
+}
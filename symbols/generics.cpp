@@ -0,0 +1,123 @@
+#include "interpreter.h"
+
+GenericFunction::GenericFunction(Token name,
+                                 std::vector<std::string> &typeParameters_)
+    : Statement(std::move(name)),
+      typeParameters(std::move(typeParameters_)) {}
+
+FunctionDefinition *
+GenericFunction::instantiate(const std::vector<TypeID> &types) {
+  auto cached = instances.find(types);
+  if (cached != instances.end()) {
+    return cached->second.get();
+  }
+  // Recursive calls of the instance find it while it is generated
+  FunctionDefinition *instance = (instances[types] = parse(types)).get();
+  instance->annotations = annotations;
+
+  // The instance is generated as a function of its own, in the middle of
+  // the function which calls it
+  llvm::IRBuilderBase::InsertPointGuard guard(builder);
+  llvm::IRBuilderBase::FastMathFlagGuard flags(builder);
+  SSABuilder outer = std::move(ssa);
+  ssa.clear();
+  std::vector<Loop *> loops = std::move(Loop::active);
+  Loop::active.clear();
+  std::vector<SpawnStatement::Pending> pending =
+      std::move(SpawnStatement::pending);
+  const size_t scope = SpawnStatement::scope;
+  llvm::Value *frame = SpawnStatement::frame;
+  std::vector<llvm::AllocaInst *> heap = std::move(ArrayDefinition::heap);
+  symbols.suspend();
+
+  instance->generate();
+
+  symbols.resume();
+  ssa = std::move(outer);
+  Loop::active = std::move(loops);
+  SpawnStatement::pending = std::move(pending);
+  SpawnStatement::scope = scope;
+  SpawnStatement::frame = frame;
+  ArrayDefinition::heap = std::move(heap);
+  return instance;
+}
+
+llvm::Value *GenericFunction::generate() {
+  const std::string name = token.getString();
+  if (module->getFunction(name) || symbols.getGeneric(name)) {
+    error("Two functions with the same name: " + name, token.line);
+  }
+  symbols.addGeneric(name, this);
+  return nullptr;
+}
+
+namespace {
+const std::vector<TypeID> numericTypes{
+    TypeID::INT,   TypeID::DOUBLE,    TypeID::COMPLEX,
+    TypeID::INT32, TypeID::FLOAT,     TypeID::COMPLEX32,
+    TypeID::VEC2D, TypeID::VEC4D,     TypeID::VEC8F};
+} // namespace
+
+/**
+ * A type parameter of views is the element type of the arrays passed to
+ * them. Otherwise it is the common type of the arguments of its parameters,
+ * so axpy(2, x, y) with float x and y is computed in float.
+ **/
+FunctionDefinition *
+FunctionCall::instantiate(GenericFunction &generic,
+                          std::vector<llvm::Value *> &values) {
+  const std::string name = token.getString();
+  const std::vector<id_ptr> &parameters = generic.definition->parameters;
+  if (arguments.size() != parameters.size()) {
+    error("Incorrect number of parameters in call to " + name, token.line);
+  }
+  values.assign(arguments.size(), nullptr);
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    if (!parameters[i]->view) {
+      values[i] = arguments[i]->generate();
+    }
+  }
+
+  std::vector<TypeID> types;
+  for (const std::string &typeParameter : generic.typeParameters) {
+    TypeID elements = TypeID::NONE;
+    std::vector<std::pair<Expression *, llvm::Value *>> operands;
+    for (size_t i = 0; i < arguments.size(); ++i) {
+      if (generic.bindings[i] != typeParameter) {
+        continue;
+      }
+      if (values[i]) {
+        operands.emplace_back(arguments[i].get(), values[i]);
+        continue;
+      }
+      auto id = dynamic_cast<Identifier *>(arguments[i].get());
+      Identifier *array = id ? symbols.get(id->token.getString()) : nullptr;
+      if (!array || !array->length || array->record) {
+        error("Argument " + parameters[i]->token.getString() + " of " +
+                  name + "() must be an array or a view of numbers",
+              token.line);
+      }
+      if (elements != TypeID::NONE && elements != array->type) {
+        error("Arrays passed to " + name +
+                  "() have different types of elements for " +
+                  typeParameter,
+              token.line);
+      }
+      elements = array->type;
+    }
+    if (elements != TypeID::NONE) {
+      types.push_back(elements);
+      continue;
+    }
+    llvm::Type *type = getMaxType(operands);
+    auto id = std::find_if(numericTypes.begin(), numericTypes.end(),
+                           [&](TypeID id) { return getType(id) == type; });
+    if (id == numericTypes.end()) {
+      error("Unsupported type for " + typeParameter + " in call to " + name +
+                "()",
+            token.line);
+    }
+    types.push_back(*id);
+  }
+  return generic.instantiate(types);
+}
@@ -0,0 +1,864 @@
+#include "interpreter.h"
+
+EvaluationError::EvaluationError(const std::string &err)
+    : std::runtime_error(err) {}
+
+const size_t Interpreter::FUEL = 1000000;
+const size_t Interpreter::BUDGET = 5000000;
+const size_t Interpreter::MAX_DEPTH = 512;
+
+Interpreter::Interpreter()
+    : fuel(0), budget(BUDGET), readGlobals(false), globalReads(0),
+      missing(nullptr), jump(Tag::RETURN) {}
+
+std::string Interpreter::key(const std::string &name,
+                             const std::vector<const_value> &args) {
+  std::string res = name;
+  for (const auto &arg : args) {
+    res += static_cast<char>(arg.index());
+    std::visit(
+        [&res](const auto &val) {
+          res.append(reinterpret_cast<const char *>(&val), sizeof(val));
+        },
+        arg);
+  }
+  return res;
+}
+
+llvm::Constant *Interpreter::fold(Expression &expr) {
+  fuel = FUEL;
+  frames.clear();
+  readGlobals = false;
+  missing = nullptr;
+  try {
+    return constant(expr.evaluate(*this));
+  } catch (EvaluationError &) {
+    return nullptr;
+  }
+}
+
+namespace {
+/**
+ * 64-bit scalar type of the same kind, values of narrow types and vectors
+ * are not evaluated. A vector is initialized with a broadcast scalar.
+ **/
+TypeID wide(TypeID type) {
+  switch (type) {
+  case TypeID::INT32:
+    return TypeID::INT;
+  case TypeID::FLOAT:
+  case TypeID::VEC2D:
+  case TypeID::VEC4D:
+  case TypeID::VEC8F:
+    return TypeID::DOUBLE;
+  case TypeID::COMPLEX32:
+    return TypeID::COMPLEX;
+  default:
+    return type;
+  }
+}
+} // namespace
+
+/**
+ * The initial value of a narrow or vector global is computed in the wide
+ * scalar type, as generated code computes literals, and is converted by the
+ * caller. The global is not evaluated later, as its arithmetic would differ.
+ **/
+llvm::Constant *Interpreter::initialize(llvm::GlobalVariable *global,
+                                        Expression &init, TypeID type,
+                                        bool readGlobals_) {
+  fuel = FUEL;
+  frames.clear();
+  readGlobals = readGlobals_;
+  missing = nullptr;
+  try {
+    const_value value = expand(init.evaluate(*this), wide(type));
+    if (wide(type) == type) {
+      globals[global] = value;
+    }
+    return constant(value);
+  } catch (EvaluationError &) {
+    return nullptr;
+  }
+}
+
+void Interpreter::step() {
+  if (fuel == 0 || budget == 0) {
+    throw EvaluationError("Out of fuel");
+  }
+  --fuel;
+  --budget;
+}
+
+void Interpreter::push() { frames.back().emplace_back(); }
+
+void Interpreter::pop() { frames.back().pop_back(); }
+
+std::pair<TypeID, const_value> &Interpreter::lookup(const std::string &name) {
+  if (!frames.empty()) {
+    auto &scopes = frames.back();
+    for (auto i = scopes.rbegin(); i < scopes.rend(); ++i) {
+      if (i->find(name) != i->end()) {
+        return i->at(name);
+      }
+    }
+  }
+  throw EvaluationError("Access to non-local variable " + name);
+}
+
+void Interpreter::define(const std::string &name, TypeID type,
+                         const_value value) {
+  frames.back().back()[name] = {type, expand(value, type)};
+}
+
+void Interpreter::assign(const std::string &name, const_value value) {
+  auto &variable = lookup(name);
+  variable.second = expand(value, variable.first);
+}
+
+const_value Interpreter::get(const std::string &name) {
+  bool local = false;
+  if (!frames.empty()) {
+    for (const auto &scope : frames.back()) {
+      local = local || scope.find(name) != scope.end();
+    }
+  }
+  if (local) {
+    return lookup(name).second;
+  }
+
+  // Outside of evaluated functions names are resolved at the call site
+  Identifier *id = frames.empty() ? Node::symbols.get(name)
+                                  : Node::symbols.getGlobal(name);
+  if (!id) {
+    return lookup(name).second;
+  }
+
+  // Constant globals never change, other globals only before main() starts
+  auto global = globals.find(id->alloc);
+  if (global != globals.end() && (id->constant || readGlobals)) {
+    if (!id->constant) {
+      ++globalReads;
+    }
+    return global->second;
+  }
+  if (global == globals.end() && id->alloc &&
+      llvm::isa<llvm::GlobalVariable>(id->alloc)) {
+    missing = id->alloc;
+  }
+
+  if (wide(id->type) != id->type) {
+    throw EvaluationError("Narrow types and vectors are not evaluated");
+  }
+  if (id->constant && id->alloc &&
+      !llvm::isa<llvm::GlobalVariable>(id->alloc)) {
+    if (auto val = llvm::dyn_cast<llvm::ConstantInt>(id->alloc)) {
+      return val->getSExtValue();
+    }
+    if (auto val = llvm::dyn_cast<llvm::ConstantFP>(id->alloc)) {
+      return val->getValueAPF().convertToDouble();
+    }
+    if (auto val = llvm::dyn_cast<llvm::Constant>(id->alloc)) {
+      auto re = llvm::dyn_cast_or_null<llvm::ConstantFP>(
+               val->getAggregateElement(0u)),
+           im = llvm::dyn_cast_or_null<llvm::ConstantFP>(
+               val->getAggregateElement(1u));
+      if (re && im) {
+        return std::complex<double>(re->getValueAPF().convertToDouble(),
+                                    im->getValueAPF().convertToDouble());
+      }
+    }
+  }
+  return lookup(name).second;
+}
+
+const_value Interpreter::call(const std::string &name,
+                              std::vector<const_value> &args) {
+  FunctionDefinition *func = Node::symbols.getFunction(name);
+  if (!func) {
+    throw EvaluationError("Call to external function " + name);
+  }
+  if (args.size() != func->parameters.size()) {
+    throw EvaluationError("Incorrect number of parameters in call to " + name);
+  }
+  if (frames.size() >= MAX_DEPTH) {
+    throw EvaluationError("Maximum call depth exceeded");
+  }
+  for (size_t i = 0; i < args.size(); ++i) {
+    args[i] = expand(args[i], func->parameters[i]->type);
+  }
+
+  const std::string callKey = key(name, args);
+  auto cached = cache.find(callKey);
+  if (cached != cache.end()) {
+    return cached->second;
+  }
+
+  /**
+   * A call which fails once fails again, unless it may read globals or read
+   * one without a known value, which could be initialized in the meantime. One which ran out of fuel
+   * or exceeded the call depth might succeed with more of them, but retrying
+   * it is not worth the fuel.
+   **/
+  if (!readGlobals && failed.count(callKey)) {
+    throw EvaluationError("Call to " + name + " failed before");
+  }
+  const size_t reads = globalReads;
+  try {
+    frames.emplace_back(1);
+    for (size_t i = 0; i < args.size(); ++i) {
+      define(func->parameters[i]->token.getString(),
+             func->parameters[i]->type, args[i]);
+    }
+    if (!func->block->execute(*this)) {
+      throw EvaluationError("Function " + name + " did not return");
+    }
+  } catch (EvaluationError &) {
+    if (!readGlobals && !missing) {
+      failed.insert(callKey);
+    }
+    throw;
+  }
+  frames.pop_back();
+
+  const_value res = expand(returnValue, func->returnType);
+  if (reads == globalReads) {
+    cache[callKey] = res;
+  }
+  return res;
+}
+
+TypeID Interpreter::typeOf(const const_value &value) {
+  switch (value.index()) {
+  case 0:
+    return TypeID::INT;
+  case 1:
+    return TypeID::DOUBLE;
+  default:
+    return TypeID::COMPLEX;
+  }
+}
+
+TypeID Interpreter::maxType(TypeID a, TypeID b) {
+  if (a == TypeID::COMPLEX || b == TypeID::COMPLEX) {
+    return TypeID::COMPLEX;
+  }
+  if (a == TypeID::DOUBLE || b == TypeID::DOUBLE) {
+    return TypeID::DOUBLE;
+  }
+  return TypeID::INT;
+}
+
+const_value Interpreter::expand(const const_value &value, TypeID to) {
+  if (wide(to) != to) {
+    throw EvaluationError("Narrow types and vectors are not evaluated");
+  }
+  TypeID from = typeOf(value);
+  if (from == to) {
+    return value;
+  }
+  if (from == TypeID::INT && to == TypeID::DOUBLE) {
+    return static_cast<double>(std::get<int64_t>(value));
+  }
+  if (from == TypeID::INT && to == TypeID::COMPLEX) {
+    return std::complex<double>(static_cast<double>(std::get<int64_t>(value)),
+                                0.0);
+  }
+  if (from == TypeID::DOUBLE && to == TypeID::COMPLEX) {
+    return std::complex<double>(std::get<double>(value), 0.0);
+  }
+  throw EvaluationError("Unsupported type conversion");
+}
+
+llvm::Constant *Interpreter::constant(const const_value &value) {
+  switch (typeOf(value)) {
+  case TypeID::INT:
+    return llvm::ConstantInt::get(Node::intType, std::get<int64_t>(value),
+                                  true);
+  case TypeID::DOUBLE:
+    return llvm::ConstantFP::get(Node::doubleType, std::get<double>(value));
+  default:
+    auto complex = std::get<std::complex<double>>(value);
+    return llvm::ConstantStruct::get(
+        Node::complexStruct,
+        {llvm::ConstantFP::get(Node::doubleType, complex.real()),
+         llvm::ConstantFP::get(Node::doubleType, complex.imag())});
+  }
+}
+
+/**
+ * Semantics of the operations below mirror the code emitted by generate(),
+ * so that a folded call yields exactly the value computed at runtime.
+ * Integer overflow is undefined, so it stops the evaluation, and complex
+ * multiplication and division use the same formulas as Complex::mul and
+ * BinaryOperation::divideComplex.
+ **/
+
+namespace {
+std::complex<double> mul(std::complex<double> a, std::complex<double> b) {
+  return {a.real() * b.real() - a.imag() * b.imag(),
+          a.real() * b.imag() + a.imag() * b.real()};
+}
+
+std::complex<double> divide(std::complex<double> a, std::complex<double> b) {
+  std::complex<double> conjugate(b.real(), b.imag() * -1.0);
+  auto top = mul(a, conjugate), bottom = mul(b, conjugate);
+  return {top.real() / bottom.real(), top.imag() / bottom.real()};
+}
+
+// Multiplication and reciprocal as emitted for the power operator
+const_value product(const const_value &l, const const_value &r) {
+  switch (Interpreter::typeOf(l)) {
+  case TypeID::INT: {
+    int64_t res;
+    if (__builtin_mul_overflow(std::get<int64_t>(l), std::get<int64_t>(r),
+                               &res)) {
+      throw EvaluationError("Undefined integer operation");
+    }
+    return res;
+  }
+  case TypeID::DOUBLE:
+    return std::get<double>(l) * std::get<double>(r);
+  default:
+    return mul(std::get<std::complex<double>>(l),
+               std::get<std::complex<double>>(r));
+  }
+}
+
+const_value inverse(const const_value &val) {
+  switch (Interpreter::typeOf(val)) {
+  case TypeID::INT:
+    if (std::get<int64_t>(val) == 0) {
+      throw EvaluationError("Undefined integer operation");
+    }
+    return 1 / std::get<int64_t>(val);
+  case TypeID::DOUBLE:
+    return 1.0 / std::get<double>(val);
+  default:
+    return divide(1.0, std::get<std::complex<double>>(val));
+  }
+}
+
+bool truth(const const_value &value) { return std::get<int64_t>(value) != 0; }
+} // namespace
+
+const_value Expression::evaluate(Interpreter &interpreter) {
+  throw EvaluationError("Expression cannot be evaluated at compile time");
+}
+
+const_value Identifier::evaluate(Interpreter &interpreter) {
+  interpreter.step();
+  return interpreter.get(token.getString());
+}
+
+const_value FunctionCall::evaluate(Interpreter &interpreter) {
+  interpreter.step();
+  std::vector<const_value> args;
+  for (const auto &arg : arguments) {
+    args.push_back(arg->evaluate(interpreter));
+  }
+
+  if (token.tag == Tag::RE || token.tag == Tag::IM) {
+    if (args.size() != 1) {
+      throw EvaluationError("Incorrect number of parameters");
+    }
+    const_value val = args.front();
+    if (Interpreter::typeOf(val) == TypeID::COMPLEX) {
+      auto complex = std::get<std::complex<double>>(val);
+      return token.tag == Tag::RE ? complex.real() : complex.imag();
+    }
+    if (token.tag == Tag::RE) {
+      return val;
+    }
+    if (Interpreter::typeOf(val) == TypeID::INT) {
+      return int64_t(0);
+    }
+    return 0.0;
+  }
+  if (token.tag == Tag::CONJ) {
+    if (args.size() != 1) {
+      throw EvaluationError("Incorrect number of parameters");
+    }
+    const_value val = args.front();
+    if (Interpreter::typeOf(val) == TypeID::COMPLEX) {
+      return std::conj(std::get<std::complex<double>>(val));
+    }
+    return val;
+  }
+  return interpreter.call(instance ? instance->token.getString()
+                                   : token.getString(),
+                          args);
+}
+
+// Computes the same operations in the same order as BuiltinCall::generate
+const_value BuiltinCall::evaluate(Interpreter &interpreter) {
+  interpreter.step();
+  const std::string name = token.getString();
+  if (name == "len") {
+    throw EvaluationError("Arrays cannot be evaluated");
+  }
+  if (name == "hsum" || name == "hmin" || name == "hmax" ||
+      name == "shuffle") {
+    throw EvaluationError("Vectors cannot be evaluated");
+  }
+  std::vector<const_value> args;
+  TypeID common = TypeID::INT;
+  for (const auto &argument : arguments) {
+    args.push_back(argument->evaluate(interpreter));
+    common = Interpreter::maxType(common, Interpreter::typeOf(args.back()));
+  }
+  if (args.size() != arity(name)) {
+    throw EvaluationError("Incorrect number of parameters");
+  }
+
+  if (name == "min" || name == "max") {
+    if (common == TypeID::INT) {
+      int64_t a = std::get<int64_t>(args[0]), b = std::get<int64_t>(args[1]);
+      return name == "min" ? std::min(a, b) : std::max(a, b);
+    }
+    if (common != TypeID::DOUBLE) {
+      throw EvaluationError("Unsupported type");
+    }
+    double a = std::get<double>(Interpreter::expand(args[0], common)),
+           b = std::get<double>(Interpreter::expand(args[1], common));
+    return name == "min" ? std::fmin(a, b) : std::fmax(a, b);
+  }
+
+  if (common == TypeID::COMPLEX) {
+    auto z = std::get<std::complex<double>>(args[0]);
+    double re = z.real(), im = z.imag();
+    if (name == "arg") {
+      return std::atan2(im, re);
+    }
+    if (name == "exp") {
+      double length = std::exp(re);
+      return std::complex<double>(length * std::cos(im),
+                                  length * std::sin(im));
+    }
+    if (name == "sqrt") {
+      double abs = std::sqrt(re * re + im * im);
+      return std::complex<double>(
+          std::sqrt((abs + re) * 0.5),
+          std::copysign(std::sqrt((abs - re) * 0.5), im));
+    }
+    throw EvaluationError("Unsupported type");
+  }
+
+  std::vector<double> x;
+  for (const auto &value : args) {
+    x.push_back(std::get<double>(Interpreter::expand(value, TypeID::DOUBLE)));
+  }
+  if (name == "arg") {
+    return std::atan2(0.0, x[0]);
+  } else if (name == "sqrt") {
+    return std::sqrt(x[0]);
+  } else if (name == "exp") {
+    return std::exp(x[0]);
+  } else if (name == "sin") {
+    return std::sin(x[0]);
+  } else if (name == "cos") {
+    return std::cos(x[0]);
+  } else if (name == "pow") {
+    return std::pow(x[0], x[1]);
+  }
+  return std::fma(x[0], x[1], x[2]);
+}
+
+const_value AbsoluteValue::evaluate(Interpreter &interpreter) {
+  interpreter.step();
+  const_value val = val_->evaluate(interpreter);
+  switch (Interpreter::typeOf(val)) {
+  case TypeID::INT: {
+    int64_t i = std::get<int64_t>(val);
+    return i < 0 ? static_cast<int64_t>(-static_cast<uint64_t>(i)) : i;
+  }
+  case TypeID::DOUBLE:
+    return std::fabs(std::get<double>(val));
+  default:
+    auto complex = std::get<std::complex<double>>(val);
+    return std::sqrt(complex.real() * complex.real() +
+                     complex.imag() * complex.imag());
+  }
+}
+
+const_value Complex::evaluate(Interpreter &interpreter) {
+  interpreter.step();
+  const_value im =
+      Interpreter::expand(imaginary->evaluate(interpreter), TypeID::DOUBLE);
+  return std::complex<double>(0.0, std::get<double>(im));
+}
+
+const_value BinaryOperation::evaluate(Interpreter &interpreter) {
+  interpreter.step();
+  const_value L = lhs->evaluate(interpreter), R = rhs->evaluate(interpreter);
+  if (token.tag == Tag::POWER) {
+    return power(L, R);
+  }
+  TypeID common =
+      Interpreter::maxType(Interpreter::typeOf(L), Interpreter::typeOf(R));
+  L = Interpreter::expand(L, common);
+  R = Interpreter::expand(R, common);
+
+  if (common == TypeID::INT) {
+    int64_t l = std::get<int64_t>(L), r = std::get<int64_t>(R), res;
+    bool overflow;
+    switch (token.tag) {
+    case Tag::PLUS:
+      overflow = __builtin_add_overflow(l, r, &res);
+      break;
+    case Tag::MINUS:
+      overflow = __builtin_sub_overflow(l, r, &res);
+      break;
+    case Tag::TIMES:
+      overflow = __builtin_mul_overflow(l, r, &res);
+      break;
+    case Tag::DIVIDE:
+      overflow = r == 0 || (l == INT64_MIN && r == -1);
+      res = overflow ? 0 : l / r;
+      break;
+    default:
+      throw EvaluationError("Unsupported binary operator");
+    }
+    if (overflow) {
+      throw EvaluationError("Undefined integer operation");
+    }
+    return res;
+  } else if (common == TypeID::DOUBLE) {
+    double l = std::get<double>(L), r = std::get<double>(R);
+    switch (token.tag) {
+    case Tag::PLUS:
+      return l + r;
+    case Tag::MINUS:
+      return l - r;
+    case Tag::TIMES:
+      return l * r;
+    case Tag::DIVIDE:
+      return l / r;
+    default:
+      break;
+    }
+  } else {
+    auto l = std::get<std::complex<double>>(L),
+         r = std::get<std::complex<double>>(R);
+    switch (token.tag) {
+    case Tag::PLUS:
+      return std::complex<double>(l.real() + r.real(), l.imag() + r.imag());
+    case Tag::MINUS:
+      return std::complex<double>(l.real() - r.real(), l.imag() - r.imag());
+    case Tag::TIMES:
+      return mul(l, r);
+    case Tag::DIVIDE:
+      return divide(l, r);
+    default:
+      break;
+    }
+  }
+  throw EvaluationError("Unsupported binary operator");
+}
+
+const_value BinaryOperation::power(const const_value &base,
+                                   const const_value &exponent) {
+  const_value one = Interpreter::expand(int64_t(1), Interpreter::typeOf(base));
+  int64_t n;
+  if (constantExponent(n)) {
+    if (n == 0) {
+      return one;
+    }
+    std::vector<const_value> powers{base};
+    for (auto step : chain(n < 0 ? 0 - uint64_t(n) : n)) {
+      powers.push_back(product(powers[step.first], powers[step.second]));
+    }
+    return n < 0 ? inverse(powers.back()) : powers.back();
+  }
+
+  if (Interpreter::typeOf(exponent) == TypeID::INT) {
+    n = std::get<int64_t>(exponent);
+    uint64_t bits = n < 0 ? 0 - uint64_t(n) : n;
+    const_value result = one, square = base;
+    while (bits) {
+      if (bits & 1) {
+        result = product(result, square);
+      }
+      bits >>= 1;
+      if (bits) {
+        square = product(square, square);
+      }
+    }
+    return n < 0 ? inverse(result) : result;
+  }
+  if (Interpreter::typeOf(exponent) == TypeID::DOUBLE &&
+      Interpreter::typeOf(base) != TypeID::COMPLEX) {
+    return std::pow(std::get<double>(Interpreter::expand(base, TypeID::DOUBLE)),
+                    std::get<double>(exponent));
+  }
+  throw EvaluationError("Unsupported binary operator");
+}
+
+const_value UnaryOperation::evaluate(Interpreter &interpreter) {
+  interpreter.step();
+  const_value val = expression->evaluate(interpreter);
+  if (token.tag != Tag::MINUS) {
+    return val;
+  }
+  switch (Interpreter::typeOf(val)) {
+  case TypeID::INT:
+    if (std::get<int64_t>(val) == INT64_MIN) {
+      throw EvaluationError("Undefined integer operation");
+    }
+    return -std::get<int64_t>(val);
+  case TypeID::DOUBLE:
+    return std::get<double>(val) * -1.0;
+  default:
+    auto complex = std::get<std::complex<double>>(val);
+    return std::complex<double>(complex.real() * -1.0, complex.imag() * -1.0);
+  }
+}
+
+const_value Constant::evaluate(Interpreter &interpreter) {
+  interpreter.step();
+  if (type == TypeID::INT) {
+    return token.getInt();
+  }
+  if (type == TypeID::DOUBLE) {
+    return token.getDouble();
+  }
+  throw EvaluationError("Unsupported constant");
+}
+
+const_value Disjunction::evaluate(Interpreter &interpreter) {
+  interpreter.step();
+  bool l = truth(lhs->evaluate(interpreter)),
+       r = truth(rhs->evaluate(interpreter));
+  return static_cast<int64_t>(l || r);
+}
+
+const_value Conjunction::evaluate(Interpreter &interpreter) {
+  interpreter.step();
+  bool l = truth(lhs->evaluate(interpreter)),
+       r = truth(rhs->evaluate(interpreter));
+  return static_cast<int64_t>(l && r);
+}
+
+const_value Negation::evaluate(Interpreter &interpreter) {
+  interpreter.step();
+  return static_cast<int64_t>(!truth(expression->evaluate(interpreter)));
+}
+
+const_value Relation::evaluate(Interpreter &interpreter) {
+  interpreter.step();
+  const_value L = lhs->evaluate(interpreter), R = rhs->evaluate(interpreter);
+  TypeID common =
+      Interpreter::maxType(Interpreter::typeOf(L), Interpreter::typeOf(R));
+  L = Interpreter::expand(L, common);
+  R = Interpreter::expand(R, common);
+
+  if (common != TypeID::COMPLEX) {
+    auto compare = [this](auto l, auto r) {
+      switch (token.tag) {
+      case Tag::LT:
+        return l < r;
+      case Tag::LE:
+        return l <= r;
+      case Tag::EQ:
+        return l == r;
+      case Tag::NEQ:
+        return l < r || l > r;
+      case Tag::GE:
+        return l >= r;
+      case Tag::GT:
+        return l > r;
+      default:
+        throw EvaluationError("Unsupported relational operator");
+      }
+    };
+    if (common == TypeID::INT) {
+      return static_cast<int64_t>(
+          compare(std::get<int64_t>(L), std::get<int64_t>(R)));
+    }
+    return static_cast<int64_t>(
+        compare(std::get<double>(L), std::get<double>(R)));
+  }
+
+  auto l = std::get<std::complex<double>>(L),
+       r = std::get<std::complex<double>>(R);
+  bool res;
+  switch (token.tag) {
+  case Tag::LT:
+    res = l.real() < r.real();
+    break;
+  case Tag::LE:
+    res = l.real() < r.real() ||
+          (l.real() == r.real() && l.imag() <= r.imag());
+    break;
+  case Tag::EQ:
+    res = l.real() == r.real() && l.imag() == r.imag();
+    break;
+  case Tag::NEQ:
+    res = (l.real() < r.real() || l.real() > r.real()) ||
+          (l.imag() < r.imag() || l.imag() > r.imag());
+    break;
+  case Tag::GE:
+    res = l.real() > r.real() ||
+          (l.real() == r.real() && l.imag() >= r.imag());
+    break;
+  case Tag::GT:
+    res = l.real() > r.real();
+    break;
+  default:
+    throw EvaluationError("Unsupported relational operator");
+  }
+  return static_cast<int64_t>(res);
+}
+
+bool Statement::execute(Interpreter &interpreter) {
+  throw EvaluationError("Statement cannot be executed at compile time");
+}
+
+bool IfStatement::execute(Interpreter &interpreter) {
+  interpreter.step();
+  bool cond = truth(condition->evaluate(interpreter));
+  Statement *branch = cond ? ifBlock.get() : elseBlock.get();
+  if (!branch) {
+    return false;
+  }
+
+  interpreter.push();
+  bool returned = branch->execute(interpreter);
+  interpreter.pop();
+  return returned;
+}
+
+bool MatchStatement::execute(Interpreter &interpreter) {
+  interpreter.step();
+  auto integer = [&](Expression &expr) {
+    const_value res = expr.evaluate(interpreter);
+    if (Interpreter::typeOf(res) != TypeID::INT) {
+      throw EvaluationError("Matched value and patterns must be integers");
+    }
+    return std::get<int64_t>(res);
+  };
+  const int64_t x = integer(*value);
+  Statement *branch = otherwise.get();
+  for (auto &arm : arms) {
+    for (auto &pattern : arm.patterns) {
+      int64_t first = integer(*pattern.first);
+      int64_t last = pattern.second ? integer(*pattern.second) : first;
+      if (first <= x && x <= last) {
+        branch = arm.block.get();
+      }
+    }
+  }
+  if (!branch) {
+    return false;
+  }
+
+  interpreter.push();
+  bool returned = branch->execute(interpreter);
+  interpreter.pop();
+  return returned;
+}
+
+bool WhileStatement::execute(Interpreter &interpreter) {
+  while (true) {
+    interpreter.step();
+    if (!truth(condition->evaluate(interpreter))) {
+      return false;
+    }
+
+    interpreter.push();
+    bool jumped = block->execute(interpreter);
+    interpreter.pop();
+    if (jumped && interpreter.jump != Tag::CONTINUE) {
+      return interpreter.jump == Tag::RETURN;
+    }
+  }
+}
+
+bool ForStatement::execute(Interpreter &interpreter) {
+  interpreter.step();
+  if (parallel) {
+    // The order of iterations, and so of reductions, is not known
+    throw EvaluationError("Parallel loops cannot be evaluated");
+  }
+  const_value first = start->evaluate(interpreter),
+              last = end->evaluate(interpreter);
+  if (Interpreter::typeOf(first) != TypeID::INT ||
+      Interpreter::typeOf(last) != TypeID::INT) {
+    throw EvaluationError("Bounds of a for loop must be integers");
+  }
+  int64_t i = std::get<int64_t>(first), bound = std::get<int64_t>(last);
+  while (step > 0 ? i <= bound : i >= bound) {
+    interpreter.step();
+    interpreter.push();
+    interpreter.define(counter->token.getString(), TypeID::INT, i);
+    interpreter.push();
+    bool jumped = block->execute(interpreter);
+    interpreter.pop();
+    interpreter.pop();
+    if (jumped && interpreter.jump != Tag::CONTINUE) {
+      return interpreter.jump == Tag::RETURN;
+    }
+    // The counter would pass the end bound if it overflowed
+    if (__builtin_add_overflow(i, step, &i)) {
+      break;
+    }
+  }
+  return false;
+}
+
+bool JumpStatement::execute(Interpreter &interpreter) {
+  interpreter.step();
+  interpreter.jump = token.tag;
+  return true;
+}
+
+bool ReturnStatement::execute(Interpreter &interpreter) {
+  interpreter.step();
+  interpreter.returnValue = return_->evaluate(interpreter);
+  interpreter.jump = Tag::RETURN;
+  return true;
+}
+
+bool Assignment::execute(Interpreter &interpreter) {
+  interpreter.step();
+  interpreter.assign(identifier->token.getString(),
+                     expression->evaluate(interpreter));
+  return false;
+}
+
+bool VariableDefinition::execute(Interpreter &interpreter) {
+  interpreter.step();
+  if (identifier->type == TypeID::STRING) {
+    throw EvaluationError("Unsupported type of variable");
+  }
+  interpreter.define(identifier->token.getString(), identifier->type,
+                     expression->evaluate(interpreter));
+  return false;
+}
+
+// Spawned calls are evaluated right away, which is one valid order
+bool SpawnStatement::execute(Interpreter &interpreter) {
+  interpreter.step();
+  if (definition) {
+    interpreter.define(identifier->token.getString(), identifier->type,
+                       call->evaluate(interpreter));
+  } else {
+    interpreter.assign(identifier->token.getString(),
+                       call->evaluate(interpreter));
+  }
+  return false;
+}
+
+bool SyncStatement::execute(Interpreter &interpreter) {
+  interpreter.step();
+  return false;
+}
+
+bool Sequence::execute(Interpreter &interpreter) {
+  for (auto &statement : statements) {
+    if (statement->execute(interpreter)) {
+      return true;
+    }
+  }
+  return false;
+}
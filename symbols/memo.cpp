@@ -0,0 +1,112 @@
+#include "parse_tree.h"
+
+/**
+ * The key of the cache is a packed structure of the arguments, so that no
+ * padding bytes take part in the comparison. Arguments are compared by
+ * their bytes, so 0.0 and -0.0 have separate results.
+ **/
+llvm::Function *FunctionDefinition::memoize(llvm::Function *func) {
+  const std::string name = token.getString();
+  int64_t capacity = 0;
+  for (auto &annotation : annotations) {
+    if (annotation.token.getString() != "memo") {
+      continue;
+    }
+    if (annotation.arguments.size() > 1 ||
+        (annotation.arguments.size() == 1 && annotation.arguments[0] < 1)) {
+      error("Annotation @memo expects at most one positive argument",
+            annotation.token.line);
+    }
+    capacity = annotation.arguments.empty() ? 0 : annotation.arguments[0];
+  }
+  if (token.tag == Tag::MAIN) {
+    error("Function main cannot be a memo function", token.line);
+  }
+  if (returnType == TypeID::STRING) {
+    error("Memo function " + name + " cannot return a string", token.line);
+  }
+  std::vector<llvm::Type *> fields;
+  for (const auto &param : parameters) {
+    if (param->view || param->type == TypeID::STRING) {
+      error("Parameter " + param->token.getString() + " of memo function " +
+                name + " must be a number",
+            param->token.line);
+    }
+    fields.push_back(getType(param->type));
+  }
+
+  // Calls generated so far, including recursive ones, go through the cache
+  llvm::Function *wrapper = llvm::Function::Create(
+      func->getFunctionType(), func->getLinkage(), "", *module);
+  func->replaceAllUsesWith(wrapper);
+  wrapper->takeName(func);
+  wrapper->setAttributes(func->getAttributes());
+  func->setName(name + ".uncached");
+  func->setLinkage(llvm::Function::InternalLinkage);
+
+  llvm::Type *bytes = builder.getInt8PtrTy();
+  auto cache = new llvm::GlobalVariable(
+      *module, bytes, false, llvm::GlobalValue::InternalLinkage,
+      llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(bytes)),
+      name + ".cache");
+  llvm::Function *lookup =
+      runtime("ps_memo_lookup", builder.getInt32Ty(),
+              {bytes->getPointerTo(), intType, bytes, intType, bytes,
+               intType});
+  llvm::Function *store =
+      runtime("ps_memo_store", builder.getVoidTy(),
+              {bytes->getPointerTo(), intType, bytes, intType, bytes,
+               intType});
+
+  llvm::BasicBlock *entry = llvm::BasicBlock::Create(context, "", wrapper);
+  builder.SetInsertPoint(entry);
+  llvm::StructType *keyType = llvm::StructType::get(context, fields, true);
+  llvm::Value *key = builder.CreateAlloca(keyType);
+  llvm::Type *resultType = func->getReturnType();
+  llvm::Value *result = builder.CreateAlloca(resultType);
+  std::vector<llvm::Value *> args;
+  for (auto &arg : wrapper->args()) {
+    arg.setName(func->getArg(arg.getArgNo())->getName());
+    builder.CreateStore(
+        &arg, builder.CreateStructGEP(keyType, key, arg.getArgNo()));
+    args.push_back(&arg);
+  }
+  // Sizes are folded once the data layout of the target is known
+  std::vector<llvm::Value *> operands{
+      cache,
+      llvm::ConstantInt::get(intType, capacity),
+      builder.CreateBitCast(key, bytes),
+      llvm::ConstantExpr::getSizeOf(keyType),
+      builder.CreateBitCast(result, bytes),
+      llvm::ConstantExpr::getSizeOf(resultType)};
+  llvm::Value *found = builder.CreateCall(lookup, operands);
+
+  llvm::BasicBlock *hit = llvm::BasicBlock::Create(context, "", wrapper);
+  llvm::BasicBlock *miss = llvm::BasicBlock::Create(context, "", wrapper);
+  builder.CreateCondBr(builder.CreateICmpNE(found, builder.getInt32(0)), hit,
+                       miss);
+  builder.SetInsertPoint(hit);
+  builder.CreateRet(builder.CreateLoad(resultType, result));
+
+  builder.SetInsertPoint(miss);
+  llvm::Value *value = builder.CreateCall(func, args);
+  builder.CreateStore(value, result);
+  builder.CreateCall(store, operands);
+  builder.CreateRet(value);
+  builder.ClearInsertionPoint();
+
+  if (llvm::verifyFunction(*wrapper)) {
+    error("Memo function " + name + " could not be verified", token.line);
+  }
+  symbols.addMemo(this);
+  return wrapper;
+}
+
+void FunctionDefinition::checkPurity() {
+  const std::string name = token.getString();
+  if (!isPure(module->getFunction(name + ".uncached"))) {
+    error("Memo function " + name +
+              " has side effects or reads global variables",
+          token.line);
+  }
+}
@@ -6,6 +6,10 @@ BinaryOperation::BinaryOperation(expr_ptr lhs_, Token operator_, expr_ptr rhs_)
     : Operation(std::move(operator_)), lhs(std::move(lhs_)),
       rhs(std::move(rhs_)) {}
 
+bool BinaryOperation::literal() const {
+  return lhs->literal() && rhs->literal();
+}
+
 llvm::Value *BinaryOperation::multiplyComplex(llvm::Value *re1,
                                               llvm::Value *im1,
                                               llvm::Value *re2,
@@ -17,7 +21,8 @@ llvm::Value *BinaryOperation::multiplyComplex(llvm::Value *re1,
 llvm::Value *BinaryOperation::divideComplex(llvm::Value *re1, llvm::Value *im1,
                                             llvm::Value *re2,
                                             llvm::Value *im2) {
-  llvm::Value *conjugateIm = builder.CreateFMul(im2, MINUS_ONE_DOUBLE);
+  llvm::Value *conjugateIm =
+      builder.CreateFMul(im2, llvm::ConstantFP::get(im2->getType(), -1.0));
   auto mulTop = Complex::mul(re1, im1, re2, conjugateIm);
   auto mulBottom = Complex::mul(re2, im2, re2, conjugateIm);
 
@@ -27,23 +32,26 @@ llvm::Value *BinaryOperation::divideComplex(llvm::Value *re1, llvm::Value *im1,
 
 llvm::Value *BinaryOperation::generate() {
   llvm::Value *L = lhs->generate(), *R = rhs->generate();
-  llvm::Type *common = getMaxType(L->getType(), R->getType());
+  if (token.tag == Tag::POWER) {
+    return power(L, R);
+  }
+  llvm::Type *common = getMaxType({{lhs.get(), L}, {rhs.get(), R}});
   L = expand(L, common);
   R = expand(R, common);
-  if (common == intType) {
+  if (kind(common) == INTEGER) {
     switch (token.tag) {
     case Tag::PLUS:
-      return builder.CreateAdd(L, R);
+      return builder.CreateNSWAdd(L, R);
     case Tag::MINUS:
-      return builder.CreateSub(L, R);
+      return builder.CreateNSWSub(L, R);
     case Tag::TIMES:
-      return builder.CreateMul(L, R);
+      return builder.CreateNSWMul(L, R);
     case Tag::DIVIDE:
       return builder.CreateSDiv(L, R);
     default:
       error("Unsupported binary operator", token.line);
     }
-  } else if (common == doubleType) {
+  } else if (kind(common) == REAL) {
     switch (token.tag) {
     case Tag::PLUS:
       return builder.CreateFAdd(L, R);
@@ -56,7 +64,7 @@ llvm::Value *BinaryOperation::generate() {
     default:
       error("Unsupported binary operator", token.line);
     }
-  } else if (common == complexStruct) {
+  } else {
     auto left = Complex::getComponents(L), right = Complex::getComponents(R);
 
     switch (token.tag) {
@@ -79,22 +87,240 @@ llvm::Value *BinaryOperation::generate() {
   return nullptr;
 }
 
+namespace {
+/**
+ * Depth-first search for a chain of at most limit steps, in which each power
+ * is the previous one multiplied by some earlier power. Such chains are the
+ * shortest for all exponents below 12509.
+ **/
+bool extend(std::vector<uint64_t> &powers,
+            std::vector<std::pair<size_t, size_t>> &steps, uint64_t n,
+            size_t limit) {
+  const uint64_t last = powers.back();
+  if (last == n) {
+    return true;
+  }
+  if (steps.size() == limit || last << (limit - steps.size()) < n) {
+    return false;
+  }
+  for (size_t i = powers.size(); i-- > 0;) {
+    if (last + powers[i] > n) {
+      continue;
+    }
+    powers.push_back(last + powers[i]);
+    steps.emplace_back(powers.size() - 2, i);
+    if (extend(powers, steps, n, limit)) {
+      return true;
+    }
+    powers.pop_back();
+    steps.pop_back();
+  }
+  return false;
+}
+} // namespace
+
+std::vector<std::pair<size_t, size_t>> BinaryOperation::chain(uint64_t n) {
+  std::vector<std::pair<size_t, size_t>> steps;
+  // Search time grows quickly, above 128 it would slow down compilation
+  if (n <= 128) {
+    for (size_t limit = 0;; ++limit) {
+      std::vector<uint64_t> powers{1};
+      if (extend(powers, steps, n, limit)) {
+        return steps;
+      }
+    }
+  }
+
+  // Binary method for large exponents, squaring from the highest bit
+  int bit = 63 - __builtin_clzll(n);
+  while (bit-- > 0) {
+    steps.emplace_back(steps.size(), steps.size());
+    if (n >> bit & 1) {
+      steps.emplace_back(steps.size(), 0);
+    }
+  }
+  return steps;
+}
+
+// Exponent is constant if it is an integer literal, possibly negated
+bool BinaryOperation::constantExponent(int64_t &exponent) {
+  Expression *expr = rhs.get();
+  bool negative = false;
+  if (auto unary = dynamic_cast<UnaryOperation *>(expr)) {
+    negative = unary->token.tag == Tag::MINUS;
+    expr = unary->expression.get();
+  }
+  auto literal = dynamic_cast<Constant *>(expr);
+  if (!literal || literal->type != TypeID::INT) {
+    return false;
+  }
+  exponent = negative ? -literal->token.getInt() : literal->token.getInt();
+  return true;
+}
+
+llvm::Value *BinaryOperation::multiply(llvm::Value *L, llvm::Value *R) {
+  if (kind(L->getType()) == INTEGER) {
+    return builder.CreateNSWMul(L, R);
+  }
+  if (kind(L->getType()) == REAL) {
+    return builder.CreateFMul(L, R);
+  }
+  auto left = Complex::getComponents(L), right = Complex::getComponents(R);
+  return multiplyComplex(left.first, left.second, right.first, right.second);
+}
+
+llvm::Value *BinaryOperation::reciprocal(llvm::Value *val) {
+  llvm::Type *type = val->getType();
+  if (kind(type) == INTEGER) {
+    return builder.CreateSDiv(llvm::ConstantInt::get(type, 1), val);
+  }
+  if (kind(type) == REAL) {
+    return builder.CreateFDiv(llvm::ConstantFP::get(type, 1.0), val);
+  }
+  auto comp = Complex::getComponents(val);
+  type = comp.first->getType();
+  return divideComplex(llvm::ConstantFP::get(type, 1.0),
+                       llvm::ConstantFP::get(type, 0.0), comp.first,
+                       comp.second);
+}
+
+/**
+ * Integer exponents are computed with multiplications of the base type,
+ * a negative exponent takes the reciprocal of the result, so for integers
+ * it is 0 unless the base is 1 or -1. Real exponents call pow.
+ **/
+llvm::Value *BinaryOperation::power(llvm::Value *base, llvm::Value *exponent) {
+  llvm::Type *type = base->getType();
+  if (type == stringType || type == boolType) {
+    error("Unsupported types for binary operator", token.line);
+  }
+
+  int64_t n;
+  const bool constant = constantExponent(n);
+  if (!constant &&
+      (type->isVectorTy() || exponent->getType()->isVectorTy())) {
+    error("Vectors can only be raised to constant integer powers",
+          token.line);
+  }
+  if (constant) {
+    if (n == 0) {
+      return expand(llvm::ConstantInt::get(intType, 1), type);
+    }
+    std::vector<llvm::Value *> powers{base};
+    for (auto step : chain(n < 0 ? 0 - uint64_t(n) : n)) {
+      powers.push_back(multiply(powers[step.first], powers[step.second]));
+    }
+    return n < 0 ? reciprocal(powers.back()) : powers.back();
+  }
+
+  if (exponent->getType() == intType || exponent->getType() == int32Type) {
+    return builder.CreateCall(powerFunction(type),
+                              {base, expand(exponent, intType)});
+  }
+  if (kind(exponent->getType()) == REAL && kind(type) != COMPLEX) {
+    llvm::Type *real = numeric(
+        REAL, isNarrow(getMaxType({{lhs.get(), base}, {rhs.get(), exponent}})));
+    llvm::Value *args[] = {expand(base, real), expand(exponent, real)};
+    return builder.CreateCall(
+        llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::pow,
+                                        {real}),
+        args);
+  }
+  error("Unsupported types for binary operator", token.line);
+  return nullptr;
+}
+
+// Binary exponentiation for exponents known only at runtime
+llvm::Function *BinaryOperation::powerFunction(llvm::Type *type) {
+  static const std::unordered_map<llvm::Type *, const char *> names = {
+      {intType, "power.int"},          {doubleType, "power.double"},
+      {complexStruct, "power.complex"}, {int32Type, "power.int32"},
+      {floatType, "power.float"},      {complex32Struct, "power.complex32"}};
+  const std::string name = names.at(type);
+  if (llvm::Function *func = module->getFunction(name)) {
+    return func;
+  }
+  llvm::Function *func = llvm::Function::Create(
+      llvm::FunctionType::get(type, {type, intType}, false),
+      llvm::Function::InternalLinkage, name, module.get());
+
+  llvm::IRBuilderBase::InsertPointGuard insertGuard(builder);
+  llvm::IRBuilderBase::FastMathFlagGuard flagsGuard(builder);
+  builder.setFastMathFlags(fastMath);
+  auto block = [&](const char *label) {
+    return llvm::BasicBlock::Create(context, label, func);
+  };
+  llvm::BasicBlock *entry = block("entry"), *header = block("header"),
+                   *body = block("body"), *exit = block("exit"),
+                   *invert = block("invert"), *done = block("done");
+
+  builder.SetInsertPoint(entry);
+  llvm::Value *x = func->getArg(0), *n = func->getArg(1);
+  llvm::Value *negative = builder.CreateICmpSLT(n, INT_ZERO);
+  // Negation of the lowest exponent wraps to its magnitude as unsigned
+  llvm::Value *magnitude =
+      builder.CreateSelect(negative, builder.CreateSub(INT_ZERO, n), n);
+  builder.CreateBr(header);
+
+  builder.SetInsertPoint(header);
+  llvm::PHINode *result = builder.CreatePHI(type, 2);
+  llvm::PHINode *square = builder.CreatePHI(type, 2);
+  llvm::PHINode *bits = builder.CreatePHI(intType, 2);
+  builder.CreateCondBr(builder.CreateICmpEQ(bits, INT_ZERO), exit, body);
+
+  // Products not selected may overflow, which only makes them poison
+  builder.SetInsertPoint(body);
+  llvm::Value *odd = builder.CreateICmpNE(
+      builder.CreateAnd(bits, llvm::ConstantInt::get(intType, 1)), INT_ZERO);
+  llvm::Value *nextResult =
+      builder.CreateSelect(odd, multiply(result, square), result);
+  llvm::Value *rest = builder.CreateLShr(bits, 1);
+  llvm::Value *nextSquare =
+      builder.CreateSelect(builder.CreateICmpNE(rest, INT_ZERO),
+                           multiply(square, square), square);
+  builder.CreateBr(header);
+
+  result->addIncoming(expand(llvm::ConstantInt::get(intType, 1), type), entry);
+  result->addIncoming(nextResult, body);
+  square->addIncoming(x, entry);
+  square->addIncoming(nextSquare, body);
+  bits->addIncoming(magnitude, entry);
+  bits->addIncoming(rest, body);
+
+  builder.SetInsertPoint(exit);
+  builder.CreateCondBr(negative, invert, done);
+  builder.SetInsertPoint(invert);
+  llvm::Value *inverse = reciprocal(result);
+  builder.CreateBr(done);
+  builder.SetInsertPoint(done);
+  llvm::PHINode *value = builder.CreatePHI(type, 2);
+  value->addIncoming(result, exit);
+  value->addIncoming(inverse, invert);
+  builder.CreateRet(value);
+  return func;
+}
+
 UnaryOperation::UnaryOperation(Token operator_, expr_ptr expression_)
     : Operation(std::move(operator_)), expression(std::move(expression_)) {}
 
+bool UnaryOperation::literal() const { return expression->literal(); }
+
 llvm::Value *UnaryOperation::generate() {
   llvm::Value *val = expression->generate();
   if (token.tag == Tag::MINUS) {
-    if (val->getType() == intType) {
-      return builder.CreateMul(val, MINUS_ONE_INT);
-    } else if (val->getType() == doubleType) {
-      return builder.CreateFMul(val, MINUS_ONE_DOUBLE);
-    } else if (val->getType() == complexStruct) {
-      auto comp = Complex::getComponents(val);
-      return Complex::get(builder.CreateFMul(comp.first, MINUS_ONE_DOUBLE),
-                          builder.CreateFMul(comp.second, MINUS_ONE_DOUBLE));
-    } else {
+    llvm::Type *type = val->getType();
+    if (type == stringType || type == boolType) {
       error("Unsupported type for unary operator", token.line);
+    } else if (kind(type) == INTEGER) {
+      return builder.CreateNSWMul(val, llvm::ConstantInt::get(type, -1, true));
+    } else if (kind(type) == REAL) {
+      return builder.CreateFMul(val, llvm::ConstantFP::get(type, -1.0));
+    } else {
+      auto comp = Complex::getComponents(val);
+      llvm::Value *minusOne =
+          llvm::ConstantFP::get(comp.first->getType(), -1.0);
+      return Complex::get(builder.CreateFMul(comp.first, minusOne),
+                          builder.CreateFMul(comp.second, minusOne));
     }
   }
   return val;
@@ -103,6 +329,8 @@ llvm::Value *UnaryOperation::generate() {
 Constant::Constant(Token token, TypeID type_)
     : Expression(std::move(token)), type(type_) {}
 
+bool Constant::literal() const { return type != TypeID::STRING; }
+
 llvm::Value *Constant::generate() {
   if (type == TypeID::DOUBLE) {
     return llvm::ConstantFP::get(context, llvm::APFloat(token.getDouble()));
@@ -153,11 +381,14 @@ Relation::Relation(expr_ptr lhs_, Token operator_, expr_ptr rhs_)
 
 llvm::Value *Relation::generate() {
   llvm::Value *L = lhs->generate(), *R = rhs->generate();
-  llvm::Type *common = getMaxType(L->getType(), R->getType());
-  expand(L, common);
-  expand(R, common);
+  llvm::Type *common = getMaxType({{lhs.get(), L}, {rhs.get(), R}});
+  if (common->isVectorTy()) {
+    error("Vectors cannot be compared", token.line);
+  }
+  L = expand(L, common);
+  R = expand(R, common);
 
-  if (common == intType) {
+  if (kind(common) == INTEGER) {
     switch (token.tag) {
     case Tag::LT:
       return builder.CreateICmpSLT(L, R);
@@ -174,7 +405,7 @@ llvm::Value *Relation::generate() {
     default:
       error("Unsupported relational operator", token.line);
     }
-  } else if (common == doubleType) {
+  } else if (kind(common) == REAL) {
     switch (token.tag) {
     case Tag::LT:
       return builder.CreateFCmpOLT(L, R);
@@ -191,7 +422,7 @@ llvm::Value *Relation::generate() {
     default:
       error("Unsupported relational operator", token.line);
     }
-  } else if (common == complexStruct) {
+  } else {
     auto left = Complex::getComponents(L), right = Complex::getComponents(R);
     switch (token.tag) {
     case Tag::LT:
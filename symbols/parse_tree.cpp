@@ -1,4 +1,8 @@
-#include "parse_tree.h"
+#include "interpreter.h"
+#include "llvm/IR/InstIterator.h"
+#include <algorithm>
+#include <set>
+#include <unordered_set>
 
 CodeGenError::CodeGenError(const std::string &err) : std::runtime_error(err) {}
 
@@ -6,13 +10,20 @@ llvm::LLVMContext Node::context;
 llvm::IRBuilder<> Node::builder(context);
 std::unique_ptr<llvm::Module> Node::module;
 SymbolTable Node::symbols;
+Interpreter Node::interpreter;
+SSABuilder Node::ssa;
+llvm::FastMathFlags Node::fastMath;
 
 llvm::Type *Node::intType = llvm::Type::getInt64Ty(context);
+llvm::Type *Node::int32Type = llvm::Type::getInt32Ty(context);
 llvm::Type *Node::doubleType = llvm::Type::getDoubleTy(context);
+llvm::Type *Node::floatType = llvm::Type::getFloatTy(context);
 llvm::Type *Node::boolType = llvm::Type::getInt1Ty(context);
 llvm::Type *Node::stringType = llvm::Type::getInt8PtrTy(context);
 llvm::StructType *Node::complexStruct =
     llvm::StructType::get(context, {doubleType, doubleType});
+llvm::StructType *Node::complex32Struct =
+    llvm::StructType::get(context, {floatType, floatType});
 
 llvm::Constant *Node::TRUE =
     llvm::ConstantInt::get(boolType, llvm::APInt(1, 1, false));
@@ -20,20 +31,10 @@ llvm::Constant *Node::TRUE =
 llvm::Constant *Node::FALSE =
     llvm::ConstantInt::get(boolType, llvm::APInt(1, 0, false));
 
-llvm::Constant *Node::MINUS_ONE_INT =
-    llvm::ConstantInt::get(intType, llvm::APInt(64, -1, true));
-
-llvm::Constant *Node::MINUS_ONE_DOUBLE =
-    llvm::ConstantFP::get(doubleType, llvm::APFloat(-1.0));
-
 llvm::Constant *Node::INT_ZERO =
     llvm::ConstantInt::get(intType, llvm::APInt(64, 0, true));
 llvm::Constant *Node::DOUBLE_ZERO =
     llvm::ConstantFP::get(doubleType, llvm::APFloat(0.0));
-llvm::Constant *Node::COMPLEX_ZERO =
-    llvm::ConstantStruct::get(complexStruct, {DOUBLE_ZERO, DOUBLE_ZERO});
-llvm::Constant *Node::STRING_ZERO = llvm::ConstantPointerNull::get(
-    static_cast<llvm::PointerType *>(stringType));
 
 Node::Node(Token token_) : token(std::move(token_)) {}
 
@@ -60,6 +61,18 @@ llvm::Type *Node::getType(TypeID type) {
     return doubleType;
   case TypeID::COMPLEX:
     return complexStruct;
+  case TypeID::INT32:
+    return int32Type;
+  case TypeID::FLOAT:
+    return floatType;
+  case TypeID::COMPLEX32:
+    return complex32Struct;
+  case TypeID::VEC2D:
+    return llvm::FixedVectorType::get(doubleType, 2);
+  case TypeID::VEC4D:
+    return llvm::FixedVectorType::get(doubleType, 4);
+  case TypeID::VEC8F:
+    return llvm::FixedVectorType::get(floatType, 8);
   case TypeID::STRING:
     return stringType;
   default:
@@ -68,94 +81,458 @@ llvm::Type *Node::getType(TypeID type) {
   }
 }
 
+Node::Kind Node::kind(llvm::Type *type) {
+  if (type->isStructTy()) {
+    return COMPLEX;
+  }
+  return type->isFPOrFPVectorTy() ? REAL : INTEGER;
+}
+
+bool Node::isNarrow(llvm::Type *type) {
+  return type == int32Type || type == floatType || type == complex32Struct;
+}
+
+llvm::Type *Node::numeric(Kind kind, bool narrow) {
+  switch (kind) {
+  case INTEGER:
+    return narrow ? int32Type : intType;
+  case REAL:
+    return narrow ? floatType : doubleType;
+  default:
+    return narrow ? complex32Struct : complexStruct;
+  }
+}
+
+/**
+ * Operands are promoted to the highest kind among them. The result is narrow
+ * only if all of them are, so int32 + float is float, but float + int is
+ * double and complex32 + double is complex.
+ **/
 llvm::Type *Node::getMaxType(llvm::Type *a, llvm::Type *b) {
   if (a == stringType || b == stringType) {
     error("Error - strings cannot be converted to other types", token.line);
   }
-  if (a == complexStruct || b == complexStruct) {
-    return complexStruct;
+  if (a->isVectorTy() || b->isVectorTy()) {
+    llvm::Type *scalar = a->isVectorTy() ? b : a;
+    if (a != b && (scalar->isVectorTy() || scalar == boolType ||
+                   kind(scalar) == COMPLEX)) {
+      error("Unsupported types for vector operation", token.line);
+    }
+    return a->isVectorTy() ? a : b;
   }
-  if (a == doubleType || b == doubleType) {
-    return doubleType;
+  return numeric(std::max(kind(a), kind(b)), isNarrow(a) && isNarrow(b));
+}
+
+namespace {
+// Whether a literal converted to a narrow type keeps its value, up to
+// rounding of reals
+bool fits(llvm::Constant *literal, llvm::Type *type) {
+  if (auto integer = llvm::dyn_cast<llvm::ConstantInt>(literal)) {
+    return !type->isIntegerTy() || integer->getValue().isSignedIntN(32);
+  }
+  if (auto real = llvm::dyn_cast<llvm::ConstantFP>(literal)) {
+    llvm::APFloat value = real->getValueAPF();
+    bool lost;
+    return !(value.convert(llvm::APFloat::IEEEsingle(),
+                           llvm::APFloat::rmNearestTiesToEven, &lost) &
+             llvm::APFloat::opOverflow);
+  }
+  for (unsigned i = 0; i < 2; ++i) {
+    llvm::Constant *part = literal->getAggregateElement(i);
+    if (!part || !fits(part, type)) {
+      return false;
+    }
+  }
+  return true;
+}
+} // namespace
+
+/**
+ * Literals have no width of their own, x * 0.5 is computed in float if x is
+ * a float, unless the literal overflows it, or does not fit int32 where the
+ * result is an integer.
+ **/
+llvm::Type *Node::getMaxType(
+    const std::vector<std::pair<Expression *, llvm::Value *>> &operands) {
+  llvm::Type *type = int32Type;
+  bool narrow = true, typed = false;
+  for (const auto &operand : operands) {
+    type = getMaxType(type, operand.second->getType());
+    if (!operand.first->literal()) {
+      narrow = narrow && isNarrow(operand.second->getType());
+      typed = true;
+    }
   }
-  return intType;
+  if (!narrow || !typed || isNarrow(type) || type->isVectorTy()) {
+    return type;
+  }
+  llvm::Type *narrowType = numeric(kind(type), true);
+  for (const auto &operand : operands) {
+    auto literal = llvm::dyn_cast<llvm::Constant>(operand.second);
+    if (operand.first->literal() && (!literal || !fits(literal, narrowType))) {
+      return type;
+    }
+  }
+  return narrowType;
 }
 
+/**
+ * Values are converted to a type of the same or a higher kind. Within a kind
+ * they are widened or narrowed, narrowing rounds reals and keeps the low 32
+ * bits of integers.
+ **/
 llvm::Value *Node::expand(llvm::Value *val, llvm::Type *to) {
-  if (val->getType() == to) {
+  llvm::Type *from = val->getType();
+  if (from == to) {
     return val;
   }
-  if (val->getType() == Node::intType) {
-    val = builder.CreateSIToFP(val, Node::doubleType);
+  if (from == stringType || to == stringType || from == boolType ||
+      to == boolType || kind(from) > kind(to) || from->isVectorTy()) {
+    error("Unsupported type conversion", token.line);
   }
-  if (to == doubleType) {
-    return val;
+  if (auto vector = llvm::dyn_cast<llvm::FixedVectorType>(to)) {
+    return builder.CreateVectorSplat(
+        vector->getNumElements(), expand(val, vector->getElementType()));
+  }
+  if (kind(to) == COMPLEX) {
+    llvm::Type *part = numeric(REAL, isNarrow(to));
+    if (kind(from) != COMPLEX) {
+      return Complex::get(expand(val, part), llvm::ConstantFP::get(part, 0.0));
+    }
+    auto comp = Complex::getComponents(val);
+    return Complex::get(expand(comp.first, part), expand(comp.second, part));
   }
-  if (to == complexStruct) {
-    llvm::AllocaInst *alloc = builder.CreateAlloca(complexStruct, nullptr);
-    builder.CreateStore(val, Complex::re(alloc));
-    builder.CreateStore(DOUBLE_ZERO, Complex::im(alloc));
-    return builder.CreateLoad(complexStruct, alloc);
+  if (kind(to) == REAL) {
+    return kind(from) == INTEGER ? builder.CreateSIToFP(val, to)
+                                 : builder.CreateFPCast(val, to);
   }
-  error("Unsupported type conversion", token.line);
-  return nullptr;
+  return builder.CreateSExtOrTrunc(val, to);
 }
 
+llvm::Function *
+Node::runtime(const char *name, llvm::Type *result,
+              std::vector<llvm::Type *> params,
+              std::initializer_list<llvm::Attribute::AttrKind> attributes) {
+  llvm::FunctionCallee callee = module->getOrInsertFunction(
+      name, llvm::FunctionType::get(result, params, false));
+  auto func = llvm::cast<llvm::Function>(callee.getCallee());
+  for (auto attribute : attributes) {
+    func->addFnAttr(attribute);
+  }
+  return func;
+}
+
+namespace {
+// Globals loaded and stored by the function and by the functions it refers to
+struct Accesses {
+  std::unordered_set<llvm::GlobalVariable *> reads, writes;
+};
+
+Accesses accesses(llvm::Function *init) {
+  Accesses globals;
+  std::unordered_set<llvm::Function *> visited{init};
+  std::vector<llvm::Function *> pending{init};
+  auto global = [](llvm::Value *pointer) {
+    return llvm::dyn_cast<llvm::GlobalVariable>(
+        pointer->stripInBoundsOffsets());
+  };
+  while (!pending.empty()) {
+    llvm::Function *func = pending.back();
+    pending.pop_back();
+    for (llvm::Instruction &inst : llvm::instructions(func)) {
+      if (auto load = llvm::dyn_cast<llvm::LoadInst>(&inst)) {
+        if (auto read = global(load->getPointerOperand())) {
+          globals.reads.insert(read);
+        }
+      } else if (auto store = llvm::dyn_cast<llvm::StoreInst>(&inst)) {
+        if (auto written = global(store->getPointerOperand())) {
+          globals.writes.insert(written);
+        }
+      }
+      // Functions are also passed to the runtime library, as parallel loop
+      // bodies and spawned tasks
+      for (llvm::Value *operand : inst.operands()) {
+        auto callee = llvm::dyn_cast<llvm::Function>(operand);
+        if (callee && !callee->isDeclaration() &&
+            visited.insert(callee).second) {
+          pending.push_back(callee);
+        }
+      }
+    }
+  }
+  return globals;
+}
+} // namespace
+
 void Node::initGlobals() {
   llvm::Function *mainFunc = module->getFunction("main");
   if (!mainFunc || mainFunc->empty()) {
     throw CodeGenError("Missing main() function definiton");
   }
 
-  builder.SetInsertPoint(&*mainFunc->getEntryBlock().begin());
-  for (auto &global : SymbolTable::globals()) {
-    const expr_ptr &expr = std::get<expr_ptr>(global);
-    llvm::Value *expanded =
-        expr->expand(expr->generate(), expr->getType(std::get<TypeID>(global)));
+  /**
+   * Initializers which can be evaluated at compile time become initializers
+   * of the globals. An initializer stopped by reading a global defined later
+   * is evaluated again after that global, so forward references are
+   * resolved in dependency order. An initializer can read other globals
+   * only if every global defined before it is initialized statically or
+   * waits for it, as one initialized at runtime could modify the values it
+   * reads.
+   **/
+  auto &globals = symbols.globals();
+  std::unordered_map<llvm::Value *, size_t> indices;
+  for (size_t i = 0; i < globals.size(); ++i) {
+    indices[std::get<llvm::GlobalVariable *>(globals[i])] = i;
+  }
+  enum State { UNVISITED, WAITING, DONE };
+  std::vector<State> state(globals.size(), UNVISITED);
+  std::vector<bool> initialized(globals.size(), false);
+  std::set<size_t> unvisited;
+  for (size_t i = 0; i < globals.size(); ++i) {
+    unvisited.insert(i);
+  }
+  size_t firstDynamic = globals.size();
+  for (size_t root = 0; root < globals.size(); ++root) {
+    if (state[root] != UNVISITED) {
+      continue;
+    }
+    std::vector<size_t> waiting{root};
+    state[root] = WAITING;
+    unvisited.erase(root);
+    while (!waiting.empty()) {
+      const size_t i = waiting.back();
+      llvm::GlobalVariable *global =
+          std::get<llvm::GlobalVariable *>(globals[i]);
+      Expression &expr = *std::get<expr_ptr>(globals[i]);
+      TypeID type = std::get<TypeID>(globals[i]);
+
+      // Globals before the root are done, those after it may not be visited
+      auto next = unvisited.lower_bound(root);
+      const bool readGlobals =
+          firstDynamic > i && (next == unvisited.end() || *next > i);
+      llvm::Constant *init = nullptr;
+      interpreter.missing = nullptr;
+      auto literal = dynamic_cast<Constant *>(&expr);
+      if (type == TypeID::STRING && literal && literal->type == type) {
+        init = llvm::cast<llvm::Constant>(literal->generate());
+      } else if (type != TypeID::STRING) {
+        init = interpreter.initialize(global, expr, type, readGlobals);
+        if (init) {
+          init = llvm::cast<llvm::Constant>(
+              expr.expand(init, global->getValueType()));
+        }
+      }
+
+      if (init) {
+        global->setInitializer(init);
+        global->setConstant(std::get<bool>(globals[i]));
+        initialized[i] = true;
+      } else {
+        auto dependency = indices.find(interpreter.missing);
+        if (dependency != indices.end() &&
+            state[dependency->second] == UNVISITED) {
+          const size_t j = dependency->second;
+          state[j] = WAITING;
+          unvisited.erase(j);
+          waiting.push_back(j);
+          continue;
+        }
+        firstDynamic = std::min(firstDynamic, i);
+      }
+      state[i] = DONE;
+      waiting.pop_back();
+    }
+  }
+
+  /**
+   * Remaining initializers are generated into functions of their own, which
+   * run before main(). Each runs after the initializers of the globals it
+   * reads, directly or through the functions it calls, and otherwise in
+   * definition order. An initializer is not moved past an earlier one which
+   * reads or writes the globals it writes, or writes the globals it reads.
+   * Reads are found in every function which may be called, whether or not
+   * the call happens, so if the order has a cycle definition order is kept.
+   **/
+  std::unordered_map<llvm::GlobalVariable *, size_t> dynamic;
+  std::vector<llvm::Function *> inits(globals.size(), nullptr);
+  for (size_t i = 0; i < globals.size(); ++i) {
+    if (initialized[i]) {
+      continue;
+    }
+    llvm::GlobalVariable *global = std::get<llvm::GlobalVariable *>(globals[i]);
+    inits[i] = llvm::Function::Create(
+        llvm::FunctionType::get(llvm::Type::getVoidTy(context), false),
+        llvm::Function::InternalLinkage, global->getName() + ".init",
+        *module);
+    builder.SetInsertPoint(llvm::BasicBlock::Create(context, "", inits[i]));
+    const expr_ptr &expr = std::get<expr_ptr>(globals[i]);
+    llvm::Value *expanded = expr->expand(
+        expr->generate(), expr->getType(std::get<TypeID>(globals[i])));
+    builder.CreateStore(expanded, global);
+    builder.CreateRetVoid();
+    dynamic[global] = i;
+  }
+  if (dynamic.empty()) {
+    return;
+  }
+
+  std::vector<size_t> pending;
+  std::vector<Accesses> access(globals.size());
+  for (size_t i = 0; i < globals.size(); ++i) {
+    if (inits[i]) {
+      pending.push_back(i);
+      access[i] = accesses(inits[i]);
+      // The initializer reading its own global is not a dependency, nor is
+      // writing it a side effect
+      auto *global = std::get<llvm::GlobalVariable *>(globals[i]);
+      access[i].reads.erase(global);
+      access[i].writes.erase(global);
+    }
+  }
+  /**
+   * Conflicting accesses are ordered through the last initializer which
+   * wrote each global and those which read it since, so the number of edges
+   * grows with the number of accesses rather than of pairs of initializers.
+   **/
+  std::vector<std::vector<size_t>> after(globals.size());
+  std::vector<size_t> before(globals.size(), 0);
+  auto edge = [&](size_t from, size_t to) {
+    after[from].push_back(to);
+    ++before[to];
+  };
+  std::unordered_map<llvm::GlobalVariable *, size_t> writer;
+  std::unordered_map<llvm::GlobalVariable *, std::vector<size_t>> readers;
+  for (size_t i : pending) {
+    for (llvm::GlobalVariable *read : access[i].reads) {
+      auto dependency = dynamic.find(read);
+      if (dependency != dynamic.end()) {
+        edge(dependency->second, i);
+      }
+      auto last = writer.find(read);
+      if (last != writer.end()) {
+        edge(last->second, i);
+      }
+      readers[read].push_back(i);
+    }
+    for (llvm::GlobalVariable *written : access[i].writes) {
+      auto last = writer.find(written);
+      if (last != writer.end()) {
+        edge(last->second, i);
+      }
+      auto &read = readers[written];
+      for (size_t j : read) {
+        if (j != i) {
+          edge(j, i);
+        }
+      }
+      read.clear();
+      writer[written] = i;
+    }
+  }
+
+  // The earliest defined initializer which is ready runs next
+  std::vector<size_t> order;
+  std::set<size_t> ready;
+  for (size_t i : pending) {
+    if (before[i] == 0) {
+      ready.insert(i);
+    }
+  }
+  while (!ready.empty()) {
+    size_t i = *ready.begin();
+    ready.erase(ready.begin());
+    order.push_back(i);
+    for (size_t j : after[i]) {
+      if (--before[j] == 0) {
+        ready.insert(j);
+      }
+    }
+  }
+  if (order.size() != pending.size()) {
+    order = pending;
+  }
 
-    builder.CreateStore(expanded, std::get<llvm::GlobalVariable *>(global));
+  llvm::Function *initFunc = llvm::Function::Create(
+      llvm::FunctionType::get(llvm::Type::getVoidTy(context), false),
+      llvm::Function::InternalLinkage, "globals.init", *module);
+  builder.SetInsertPoint(llvm::BasicBlock::Create(context, "", initFunc));
+  for (size_t i : order) {
+    builder.CreateCall(inits[i]);
   }
+  builder.CreateRetVoid();
+  builder.SetInsertPoint(&*mainFunc->getEntryBlock().begin());
+  builder.CreateCall(initFunc);
 }
 
 Expression::Expression(Token token) : Node(std::move(token)) {}
 
-Identifier::Identifier(Token id, TypeID type_, llvm::Value *alloc_)
-    : Expression(std::move(id)), type(type_), alloc(alloc_) {}
+bool Expression::literal() const { return false; }
+
+Identifier::Identifier(Token id, TypeID type_, llvm::Value *alloc_,
+                       bool constant_)
+    : Expression(std::move(id)), type(type_), alloc(alloc_),
+      constant(constant_), captured(false), variable(0), length(nullptr),
+      view(false), noalias(false), record(nullptr) {}
 
 llvm::Value *Identifier::generate() {
   const std::string name = token.getString();
   Identifier *id = getSymbol(name);
+  if (id->length) {
+    error("Array " + name + " cannot be used as a value", token.line);
+  }
+  if (SpawnStatement::isPending(id)) {
+    error("Variable " + name + " is used before sync", token.line);
+  }
+  if (!id->alloc) {
+    return ssa.read(id->variable, builder.GetInsertBlock());
+  }
+  if (id->constant) {
+    auto global = llvm::dyn_cast<llvm::GlobalVariable>(id->alloc);
+    if (!global) {
+      return id->alloc;
+    }
+    if (global->isConstant()) {
+      return global->getInitializer();
+    }
+  }
   return builder.CreateLoad(getType(id->type), id->alloc, name);
 }
 
 FunctionCall::FunctionCall(Token name, std::vector<expr_ptr> &args)
-    : Expression(std::move(name)), arguments(std::move(args)) {}
+    : Expression(std::move(name)), arguments(std::move(args)),
+      instance(nullptr) {}
 
 llvm::Value *FunctionCall::Re(llvm::Value *val) {
-  if (val->getType() == intType || val->getType() == doubleType) {
-    return val;
+  if (val->getType() == stringType || val->getType() == boolType) {
+    error("Unsupported type in call to Re()", token.line);
   }
-  if (val->getType() == complexStruct) {
+  if (kind(val->getType()) == COMPLEX) {
     auto comp = Complex::getComponents(val);
     return comp.first;
   }
-  error("Unsupported type in call to Re()", token.line);
-  return nullptr;
+  return val;
 }
 
 llvm::Value *FunctionCall::Im(llvm::Value *val) {
-  if (val->getType() == intType) {
-    return INT_ZERO;
-  }
-  if (val->getType() == doubleType) {
-    return DOUBLE_ZERO;
+  if (val->getType() == stringType || val->getType() == boolType) {
+    error("Unsupported type in call to Im()", token.line);
   }
-  if (val->getType() == complexStruct) {
+  if (kind(val->getType()) == COMPLEX) {
     auto comp = Complex::getComponents(val);
     return comp.second;
   }
-  error("Unsupported type in call to Im()", token.line);
-  return nullptr;
+  return llvm::Constant::getNullValue(val->getType());
+}
+
+llvm::Value *FunctionCall::conj(llvm::Value *val) {
+  if (val->getType() == stringType || val->getType() == boolType) {
+    error("Unsupported type in call to conj()", token.line);
+  }
+  if (kind(val->getType()) == COMPLEX) {
+    auto comp = Complex::getComponents(val);
+    return Complex::get(comp.first, builder.CreateFNeg(comp.second));
+  }
+  return val;
 }
 
 llvm::Value *FunctionCall::generate() {
@@ -175,22 +552,100 @@ llvm::Value *FunctionCall::generate() {
     return Im(arguments.front()->generate());
   }
 
+  if (token.tag == Tag::CONJ) {
+    if (arguments.size() != 1) {
+      error("Incorrect number of parameters in call to conj()", token.line);
+    }
+    return conj(arguments.front()->generate());
+  }
+
+  if (GenericFunction *generic = symbols.getGeneric(name)) {
+    std::vector<llvm::Value *> values;
+    instance = instantiate(*generic, values);
+    if (llvm::Constant *folded = interpreter.fold(*this)) {
+      return folded;
+    }
+    return builder.CreateCall(
+        module->getFunction(instance->token.getString()),
+        generateArguments(instance->parameters, values));
+  }
+
   llvm::Function *func = module->getFunction(name);
   if (!func) {
     error("Function " + name + " not defined", token.line);
   }
 
+  if (symbols.getFunction(name)) {
+    if (llvm::Constant *folded = interpreter.fold(*this)) {
+      return folded;
+    }
+  }
+
+  // A prototype has the parameters of a definition following it
+  FunctionDeclaration *callee = symbols.getFunction(name);
+  if (!callee) {
+    callee = symbols.getExternal(name);
+  }
+  return builder.CreateCall(func, generateArguments(callee->parameters));
+}
+
+std::vector<llvm::Value *>
+FunctionCall::generateArguments(const std::vector<id_ptr> &parameters,
+                                const std::vector<llvm::Value *> &values) {
+  const std::string name = token.getString();
+  if (arguments.size() != parameters.size()) {
+    error("Incorrect number of parameters in call to " + name, token.line);
+  }
   std::vector<llvm::Value *> args;
-  int i = 0;
-  for (const auto &arg : func->args()) {
-    if (i >= arguments.size()) {
-      error("Incorrect number of parameters in call to " +
-                func->getName().str(),
+  std::vector<Identifier *> arrays(arguments.size(), nullptr);
+  for (size_t i = 0; i < arguments.size(); ++i) {
+    Identifier &param = *parameters[i];
+    if (!param.view) {
+      llvm::Value *value = i < values.size() && values[i]
+                               ? values[i]
+                               : arguments[i]->generate();
+      args.push_back(expand(value, getType(param.type)));
+      continue;
+    }
+    auto id = dynamic_cast<Identifier *>(arguments[i].get());
+    Identifier *array = id ? symbols.get(id->token.getString()) : nullptr;
+    if (!array || !array->length) {
+      error("Argument " + param.token.getString() + " of " + name +
+                "() must be an array or a view",
+            token.line);
+    }
+    const std::string arrayName = id->token.getString();
+    if (array->record) {
+      error("Array of structs " + arrayName + " cannot be passed to " + name +
+                "()",
+            token.line);
+    }
+    if (array->type != param.type) {
+      error("Elements of " + arrayName + " do not have the type of " +
+                param.token.getString() + " in call to " + name + "()",
             token.line);
     }
-    args.push_back(expand(arguments[i++]->generate(), arg.getType()));
+    if (array->constant && !param.constant) {
+      error("Read-only view " + arrayName + " is passed as writable to " +
+                name + "()",
+            token.line);
+    }
+    // Accesses through a @noalias view cannot overlap with writes through
+    // another view of the call
+    for (size_t j = 0; j < i; ++j) {
+      Identifier &other = *parameters[j];
+      if (arrays[j] == array && (param.noalias || other.noalias) &&
+          (!param.constant || !other.constant)) {
+        error("Array " + arrayName + " is passed to " + name +
+                  "() twice, to a @noalias view",
+              token.line);
+      }
+    }
+    arrays[i] = array;
+    args.push_back(array->alloc);
+    args.push_back(array->length);
   }
-  return builder.CreateCall(func, args);
+  return args;
 }
 
 AbsoluteValue::AbsoluteValue(Token token, expr_ptr value)
@@ -198,68 +653,81 @@ AbsoluteValue::AbsoluteValue(Token token, expr_ptr value)
 
 llvm::Value *AbsoluteValue::generate() {
   llvm::Value *val = val_->generate();
-  if (val->getType() == intType) {
+  llvm::Type *type = val->getType();
+  if (type == stringType || type == boolType) {
+    error("Unsupported type inside absolute value", val_->token.line);
+  }
+  if (kind(type) == INTEGER) {
     return builder.CreateCall(
         llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::abs,
-                                        {intType}),
+                                        {type}),
         {val, FALSE});
-  } else if (val->getType() == doubleType) {
+  }
+  if (kind(type) == REAL) {
     return builder.CreateCall(
         llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::fabs,
-                                        {doubleType}),
+                                        {type}),
         {val});
-  } else if (val->getType() == complexStruct) {
-    llvm::AllocaInst *alloc = builder.CreateAlloca(complexStruct, nullptr);
-    val = builder.CreateStore(val, alloc);
-
-    llvm::Value *re = builder.CreateLoad(doubleType, Complex::re(alloc)),
-                *im = builder.CreateLoad(doubleType, Complex::im(alloc));
-
-    re = builder.CreateFMul(re, re);
-    im = builder.CreateFMul(im, im);
-    llvm::Value *sum = builder.CreateFAdd(re, im);
-    return builder.CreateCall(
-        llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::sqrt,
-                                        {doubleType}),
-        {sum});
   }
-  error("Unsupported type inside absolute value", val_->token.line);
-  return nullptr;
+  auto comp = Complex::getComponents(val);
+  llvm::Value *re = comp.first, *im = comp.second;
+
+  re = builder.CreateFMul(re, re);
+  im = builder.CreateFMul(im, im);
+  llvm::Value *sum = builder.CreateFAdd(re, im);
+  return builder.CreateCall(
+      llvm::Intrinsic::getDeclaration(module.get(), llvm::Intrinsic::sqrt,
+                                      {sum->getType()}),
+      {sum});
 }
 
 Complex::Complex(expr_ptr imaginary_, Token token)
     : Expression(std::move(token)), imaginary(std::move(imaginary_)) {}
 
-llvm::Value *Complex::generate() {
-  llvm::Value *re = DOUBLE_ZERO,
-              *im = expand(imaginary->generate(), doubleType);
-  return get(re, im);
-}
-
-llvm::GetElementPtrInst *Complex::re(llvm::Value *complex) {
-  static std::vector<llvm::Value *> reIndex{
-      llvm::ConstantInt::get(context, llvm::APInt(32, 0, true)),
-      llvm::ConstantInt::get(context, llvm::APInt(32, 0, true))};
+bool Complex::literal() const { return imaginary->literal(); }
 
-  return static_cast<llvm::GetElementPtrInst *>(
-      builder.CreateGEP(complexStruct, complex, reIndex));
+// The imaginary unit keeps the width of the value it multiplies
+llvm::Value *Complex::generate() {
+  llvm::Value *im = imaginary->generate();
+  if (im->getType() == stringType || im->getType() == boolType ||
+      kind(im->getType()) == COMPLEX) {
+    error("Unsupported type of imaginary number", token.line);
+  }
+  im = expand(im, numeric(REAL, isNarrow(im->getType())));
+  return get(llvm::ConstantFP::get(im->getType(), 0.0), im);
 }
 
-llvm::GetElementPtrInst *Complex::im(llvm::Value *complex) {
-  static std::vector<llvm::Value *> imIndex{
-      llvm::ConstantInt::get(context, llvm::APInt(32, 0, true)),
-      llvm::ConstantInt::get(context, llvm::APInt(32, 1, true))};
-
-  return static_cast<llvm::GetElementPtrInst *>(
-      builder.CreateGEP(complexStruct, complex, imIndex));
+llvm::Value *Complex::get(llvm::Value *real_, llvm::Value *im_) {
+  llvm::Value *complex = llvm::UndefValue::get(
+      real_->getType() == floatType ? complex32Struct : complexStruct);
+  complex = builder.CreateInsertValue(complex, real_, {0});
+  return builder.CreateInsertValue(complex, im_, {1});
 }
 
-llvm::Value *Complex::get(llvm::Value *real_, llvm::Value *im_) {
-  llvm::AllocaInst *alloc = builder.CreateAlloca(complexStruct, nullptr);
-  builder.CreateStore(real_, re(alloc));
-  builder.CreateStore(im_, im(alloc));
+Vector::Vector(Token token, std::vector<expr_ptr> &lanes_)
+    : Expression(token), type(token.getType()), lanes(std::move(lanes_)) {}
 
-  return builder.CreateLoad(complexStruct, alloc);
+llvm::Value *Vector::generate() {
+  auto vector = llvm::cast<llvm::FixedVectorType>(getType(type));
+  const unsigned size = vector->getNumElements();
+  if (lanes.size() == 1) {
+    return expand(lanes[0]->generate(), vector);
+  }
+  if (lanes.size() != size) {
+    error("Vector of " + std::to_string(size) + " lanes expects 1 or " +
+              std::to_string(size) + " values",
+          token.line);
+  }
+  llvm::Value *result = llvm::PoisonValue::get(vector);
+  for (unsigned i = 0; i < size; ++i) {
+    llvm::Value *lane = lanes[i]->generate();
+    if (lane->getType()->isVectorTy()) {
+      error("Lanes of a vector must be numbers", token.line);
+    }
+    result = builder.CreateInsertElement(
+        result, expand(lane, vector->getElementType()), uint64_t(i));
+  }
+  return result;
 }
 
 std::pair<llvm::Value *, llvm::Value *> Complex::mul(llvm::Value *re1,
@@ -277,10 +745,7 @@ std::pair<llvm::Value *, llvm::Value *> Complex::mul(llvm::Value *re1,
 
 std::pair<llvm::Value *, llvm::Value *>
 Complex::getComponents(llvm::Value *complex) {
-  llvm::AllocaInst *alloc = builder.CreateAlloca(complexStruct, nullptr);
-  builder.CreateStore(complex, alloc);
-
   return std::make_pair<llvm::Value *, llvm::Value *>(
-      builder.CreateLoad(doubleType, re(alloc)),
-      builder.CreateLoad(doubleType, im(alloc)));
+      builder.CreateExtractValue(complex, {0}),
+      builder.CreateExtractValue(complex, {1}));
 }
\ No newline at end of file
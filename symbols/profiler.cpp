@@ -0,0 +1,63 @@
+#include "parse_tree.h"
+
+bool Profiler::enabled = false;
+
+namespace {
+// Layout of ps_site
+llvm::StructType *siteType() {
+  llvm::Type *intType = Node::intType;
+  if (auto type = llvm::StructType::getTypeByName(Node::context, "ps_site")) {
+    return type;
+  }
+  return llvm::StructType::create(
+      {Node::builder.getInt8PtrTy(), intType, intType, intType, intType,
+       intType, intType},
+      "ps_site");
+}
+} // namespace
+
+llvm::Constant *Profiler::site(llvm::Function *func, int line, bool loop) {
+  llvm::IRBuilder<> &builder = Node::builder;
+  llvm::Constant *zero = llvm::ConstantInt::get(Node::intType, 0);
+  llvm::Constant *fields[] = {
+      builder.CreateGlobalStringPtr(func->getName(), "", 0,
+                                   Node::module.get()),
+      llvm::ConstantInt::get(Node::intType, line),
+      llvm::ConstantInt::get(Node::intType, loop),
+      zero,
+      zero,
+      zero,
+      zero};
+  llvm::StructType *type = siteType();
+  return new llvm::GlobalVariable(
+      *Node::module, type, false, llvm::GlobalValue::InternalLinkage,
+      llvm::ConstantStruct::get(type, fields),
+      func->getName() + (loop ? ".loop" : ".site"));
+}
+
+void Profiler::enter(llvm::Constant *site) {
+  Node::builder.CreateCall(
+      Node::runtime("ps_instrument_enter", Node::builder.getVoidTy(),
+                    {siteType()->getPointerTo()}, {llvm::Attribute::NoUnwind}),
+      {site});
+}
+
+void Profiler::exit() {
+  Node::builder.CreateCall(Node::runtime("ps_instrument_exit",
+                                         Node::builder.getVoidTy(), {},
+                                         {llvm::Attribute::NoUnwind}));
+}
+
+llvm::Value *Profiler::cycles() {
+  return Node::builder.CreateCall(Node::runtime(
+      "ps_cycles", Node::intType, {}, {llvm::Attribute::NoUnwind}));
+}
+
+void Profiler::loop(llvm::Constant *site, llvm::Value *iterations,
+                    llvm::Value *start) {
+  Node::builder.CreateCall(
+      Node::runtime("ps_instrument_loop", Node::builder.getVoidTy(),
+                    {siteType()->getPointerTo(), Node::intType, Node::intType},
+                    {llvm::Attribute::NoUnwind}),
+      {site, iterations, start});
+}
@@ -0,0 +1,113 @@
+#include "ssa.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/Constants.h"
+
+void SSABuilder::clear() {
+  definitions.clear();
+  incomplete.clear();
+  sealed.clear();
+  types.clear();
+}
+
+size_t SSABuilder::add(llvm::Type *type) {
+  types.push_back(type);
+  return types.size() - 1;
+}
+
+void SSABuilder::write(size_t variable, llvm::BasicBlock *block,
+                       llvm::Value *value) {
+  definitions[block][variable] = value;
+}
+
+llvm::Value *SSABuilder::read(size_t variable, llvm::BasicBlock *block) {
+  auto &defs = definitions[block];
+  auto def = defs.find(variable);
+  if (def != defs.end()) {
+    return def->second;
+  }
+  return readRecursive(variable, block);
+}
+
+llvm::Value *SSABuilder::readRecursive(size_t variable,
+                                       llvm::BasicBlock *block) {
+  llvm::Value *value;
+  if (sealed.find(block) == sealed.end()) {
+    llvm::PHINode *phi = createPhi(variable, block);
+    incomplete[block].push_back({variable, phi});
+    value = phi;
+  } else if (llvm::BasicBlock *pred = block->getSinglePredecessor()) {
+    value = read(variable, pred);
+  } else {
+    // Breaks cycles in loops before the operands are looked up
+    llvm::PHINode *phi = createPhi(variable, block);
+    write(variable, block, phi);
+    value = addOperands(variable, phi);
+  }
+  write(variable, block, value);
+  return value;
+}
+
+llvm::PHINode *SSABuilder::createPhi(size_t variable, llvm::BasicBlock *block) {
+  llvm::Instruction *first = block->getFirstNonPHI();
+  if (first) {
+    return llvm::PHINode::Create(types[variable], 0, "", first);
+  }
+  return llvm::PHINode::Create(types[variable], 0, "", block);
+}
+
+llvm::Value *SSABuilder::addOperands(size_t variable, llvm::PHINode *phi) {
+  for (llvm::BasicBlock *pred : llvm::predecessors(phi->getParent())) {
+    phi->addIncoming(read(variable, pred), pred);
+  }
+  return removeTrivial(phi);
+}
+
+llvm::Value *SSABuilder::removeTrivial(llvm::PHINode *phi) {
+  llvm::Value *same = nullptr;
+  for (llvm::Value *op : phi->incoming_values()) {
+    if (op == same || op == phi) {
+      continue;
+    }
+    if (same) {
+      return phi;
+    }
+    same = op;
+  }
+  if (!same) {
+    // The phi is unreachable or in the entry block
+    same = llvm::UndefValue::get(phi->getType());
+  }
+
+  // Users might become trivial as well, unless they are removed before
+  std::vector<llvm::WeakVH> users;
+  for (llvm::User *user : phi->users()) {
+    if (llvm::isa<llvm::PHINode>(user) && user != phi) {
+      users.emplace_back(user);
+    }
+  }
+
+  // Definitions are tracking handles, so they are updated as well
+  phi->replaceAllUsesWith(same);
+  phi->eraseFromParent();
+  // The replacement itself might be removed as one of the users
+  llvm::WeakTrackingVH replacement(same);
+
+  // Phi nodes still getting their operands are checked once they have all
+  for (auto &user : users) {
+    auto userPhi = llvm::dyn_cast_or_null<llvm::PHINode>(user);
+    if (userPhi && userPhi->getNumIncomingValues() ==
+                       llvm::pred_size(userPhi->getParent())) {
+      removeTrivial(userPhi);
+    }
+  }
+  return replacement;
+}
+
+void SSABuilder::seal(llvm::BasicBlock *block) {
+  auto phis = std::move(incomplete[block]);
+  incomplete.erase(block);
+  for (auto &phi : phis) {
+    addOperands(phi.first, phi.second);
+  }
+  sealed.insert(block);
+}
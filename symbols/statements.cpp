@@ -1,11 +1,69 @@
-#include "parse_tree.h"
+#include "interpreter.h"
+#include "runtime.h"
+#include "llvm/IR/MDBuilder.h"
+#include <map>
 
 Statement::Statement(Token token) : Node(std::move(token)) {}
 
+Identifier *Statement::assignable(const std::string &name) {
+  Identifier *lhs = getSymbol(name);
+  if (lhs->length) {
+    error("Cannot assign to array " + name, token.line);
+  }
+  // Only reduction variables are private to each thread
+  if (lhs->captured ||
+      (lhs == symbols.getGlobal(name) && Loop::inParallel())) {
+    error("Cannot assign to " + name + " inside of a parallel loop",
+          token.line);
+  }
+  if (lhs->constant) {
+    error("Cannot assign to constant " + name, token.line);
+  }
+  if (SpawnStatement::isPending(lhs)) {
+    error("Variable " + name + " is assigned before sync", token.line);
+  }
+  return lhs;
+}
+
+void Statement::assign(Identifier *variable, llvm::Value *value) {
+  if (variable->alloc) {
+    builder.CreateStore(value, variable->alloc);
+  } else {
+    ssa.write(variable->variable, builder.GetInsertBlock(), value);
+  }
+}
+
+/**
+ * The weights are those which llvm.expect is lowered to, so that a likely
+ * branch is laid out as the fall-through path and its successor is treated
+ * as hot by the optimizer.
+ **/
+llvm::BranchInst *Statement::branch(llvm::Value *cond, llvm::BasicBlock *then,
+                                    llvm::BasicBlock *otherwise,
+                                    Expectation expected) {
+  const uint32_t taken = 2000, untaken = 1;
+  llvm::MDNode *weights = nullptr;
+  if (expected != Expectation::NONE) {
+    const bool likely = expected == Expectation::LIKELY;
+    weights = llvm::MDBuilder(context).createBranchWeights(
+        likely ? taken : untaken, likely ? untaken : taken);
+  }
+  return builder.CreateCondBr(cond, then, otherwise, weights);
+}
+
+namespace {
+// Statements ending with return, break or continue leave the current block
+bool terminates(llvm::Value *statement) {
+  auto inst = llvm::dyn_cast_or_null<llvm::Instruction>(statement);
+  return inst && inst->isTerminator();
+}
+} // namespace
+
 IfStatement::IfStatement(Token token, expr_ptr condition_, stmt_ptr ifBlock_,
                          stmt_ptr elseBlock_)
     : Statement(std::move(token)), condition(std::move(condition_)),
-      ifBlock(std::move(ifBlock_)), elseBlock(std::move(elseBlock_)) {}
+      ifBlock(std::move(ifBlock_)), elseBlock(std::move(elseBlock_)),
+      expected(Expectation::NONE) {}
 
 llvm::Value *IfStatement::generate() {
   llvm::Value *cond = condition->generate();
@@ -18,14 +76,18 @@ llvm::Value *IfStatement::generate() {
                    *else_ =
                        elseBlock ? llvm::BasicBlock::Create(context) : cont;
 
-  builder.CreateCondBr(cond, if_, else_);
+  branch(cond, if_, else_, expected);
+  ssa.seal(if_);
+  if (elseBlock) {
+    ssa.seal(else_);
+  }
   builder.SetInsertPoint(if_);
 
   symbols.push();
   llvm::Value *then = ifBlock->generate();
   symbols.pop();
 
-  if (llvm::dyn_cast<llvm::ReturnInst>(then) == nullptr) {
+  if (!terminates(then)) {
     builder.CreateBr(cont);
   }
 
@@ -37,24 +99,227 @@ llvm::Value *IfStatement::generate() {
     llvm::Value *elseStmt = elseBlock->generate();
     symbols.pop();
 
-    if (llvm::dyn_cast<llvm::ReturnInst>(elseStmt) == nullptr) {
+    if (!terminates(elseStmt)) {
       builder.CreateBr(cont);
     }
   }
 
+  ssa.seal(cont);
   func->getBasicBlockList().push_back(cont);
   builder.SetInsertPoint(cont);
 
   return TRUE;
 }
 
+const int64_t MatchStatement::MAX_RANGE_CASES = 256;
+
+MatchStatement::MatchStatement(Token token, expr_ptr value_,
+                               std::vector<Arm> &arms_, stmt_ptr otherwise_)
+    : Statement(std::move(token)), value(std::move(value_)),
+      arms(std::move(arms_)), otherwise(std::move(otherwise_)) {}
+
+llvm::Value *MatchStatement::generate() {
+  llvm::Value *val = value->generate();
+  llvm::Type *type = val->getType();
+  if (!type->isIntegerTy() || type == boolType) {
+    error("Matched value must be an integer", token.line);
+  }
+
+  struct Range {
+    int64_t first, last;
+    size_t arm;
+  };
+  std::vector<Range> ranges;
+  auto constant = [&](Expression &pattern) {
+    auto folded =
+        llvm::dyn_cast_or_null<llvm::ConstantInt>(interpreter.fold(pattern));
+    if (!folded ||
+        !llvm::ConstantInt::isValueValidForType(type, folded->getSExtValue())) {
+      error("Pattern must be a constant of the type of the matched value",
+            pattern.token.line);
+    }
+    return folded->getSExtValue();
+  };
+  for (size_t i = 0; i < arms.size(); ++i) {
+    for (auto &pattern : arms[i].patterns) {
+      int64_t first = constant(*pattern.first);
+      int64_t last = pattern.second ? constant(*pattern.second) : first;
+      if (first > last) {
+        error("Empty range of values " + std::to_string(first) + " to " +
+                  std::to_string(last),
+              pattern.first->token.line);
+      }
+      ranges.push_back({first, last, i});
+    }
+  }
+  std::sort(ranges.begin(), ranges.end(),
+            [](const Range &a, const Range &b) { return a.first < b.first; });
+  for (size_t i = 1; i < ranges.size(); ++i) {
+    if (ranges[i].first <= ranges[i - 1].last) {
+      error("Value " + std::to_string(ranges[i].first) +
+                " is matched by more than one pattern",
+            token.line);
+    }
+  }
+
+  llvm::Function *func = builder.GetInsertBlock()->getParent();
+  llvm::BasicBlock *cont = llvm::BasicBlock::Create(context),
+                   *otherwiseBlock =
+                       otherwise ? llvm::BasicBlock::Create(context) : cont;
+  std::vector<llvm::BasicBlock *> blocks;
+  for (size_t i = 0; i < arms.size(); ++i) {
+    blocks.push_back(llvm::BasicBlock::Create(context));
+  }
+
+  // Values of short ranges are cases, wide ones are compared if none matches
+  llvm::SwitchInst *switch_ =
+      builder.CreateSwitch(val, otherwiseBlock, ranges.size());
+  std::vector<Range> wide;
+  for (const Range &range : ranges) {
+    if (uint64_t(range.last) - uint64_t(range.first) >=
+        uint64_t(MAX_RANGE_CASES)) {
+      wide.push_back(range);
+      continue;
+    }
+    for (int64_t i = range.first;; ++i) {
+      switch_->addCase(llvm::ConstantInt::getSigned(
+                           llvm::cast<llvm::IntegerType>(type), i),
+                       blocks[range.arm]);
+      if (i == range.last) {
+        break;
+      }
+    }
+  }
+  std::vector<llvm::BasicBlock *> checks;
+  for (size_t i = 0; i < wide.size(); ++i) {
+    checks.push_back(llvm::BasicBlock::Create(context, "", func));
+  }
+  checks.push_back(otherwiseBlock);
+  switch_->setDefaultDest(checks.front());
+  for (size_t i = 0; i < wide.size(); ++i) {
+    ssa.seal(checks[i]);
+    builder.SetInsertPoint(checks[i]);
+    llvm::Value *offset = builder.CreateSub(
+        val, llvm::ConstantInt::getSigned(type, wide[i].first));
+    llvm::Value *inside = builder.CreateICmpULE(
+        offset, llvm::ConstantInt::get(type, uint64_t(wide[i].last) -
+                                                 uint64_t(wide[i].first)));
+    builder.CreateCondBr(inside, blocks[wide[i].arm], checks[i + 1]);
+  }
+
+  auto generateArm = [&](llvm::BasicBlock *block, Statement &statement) {
+    func->getBasicBlockList().push_back(block);
+    ssa.seal(block);
+    builder.SetInsertPoint(block);
+    symbols.push();
+    llvm::Value *last = statement.generate();
+    symbols.pop();
+    if (!terminates(last)) {
+      builder.CreateBr(cont);
+    }
+  };
+  for (size_t i = 0; i < arms.size(); ++i) {
+    generateArm(blocks[i], *arms[i].block);
+  }
+  if (otherwise) {
+    generateArm(otherwiseBlock, *otherwise);
+  }
+
+  ssa.seal(cont);
+  func->getBasicBlockList().push_back(cont);
+  builder.SetInsertPoint(cont);
+  return TRUE;
+}
+
+std::vector<Loop *> Loop::active;
+
+Loop::Loop(Token token, stmt_ptr block_)
+    : Statement(std::move(token)), block(std::move(block_)), latch(nullptr),
+      exit(nullptr), parallel(false) {}
+
+llvm::MDNode *Loop::metadata() {
+  // The first operand refers to the node itself, as LLVM requires
+  std::vector<llvm::Metadata *> hints{nullptr};
+  auto hint = [&](const char *name, llvm::Constant *value) {
+    hints.push_back(llvm::MDNode::get(
+        context, {llvm::MDString::get(context, name),
+                  llvm::ConstantAsMetadata::get(value)}));
+  };
+  for (auto &annotation : annotations) {
+    const std::string name = annotation.token.getString();
+    if (parallel && name == "dynamic") {
+      continue;
+    }
+    if (name != "unroll" && name != "vectorize") {
+      error("Unknown annotation @" + name, annotation.token.line);
+    }
+    if (annotation.arguments.size() != 1 || annotation.arguments[0] < 1) {
+      error("Annotation @" + name + " expects one positive argument",
+            annotation.token.line);
+    }
+    auto count = builder.getInt32(annotation.arguments[0]);
+    if (name == "unroll") {
+      hint("llvm.loop.unroll.count", count);
+    } else {
+      hint("llvm.loop.vectorize.width", count);
+      hint("llvm.loop.vectorize.enable",
+           builder.getInt1(annotation.arguments[0] > 1));
+    }
+  }
+  if (hints.size() == 1) {
+    return nullptr;
+  }
+  llvm::MDNode *loop = llvm::MDNode::getDistinct(context, hints);
+  loop->replaceOperandWith(0, loop);
+  return loop;
+}
+
+bool Loop::inParallel() {
+  for (Loop *loop : active) {
+    if (loop->parallel) {
+      return true;
+    }
+  }
+  return false;
+}
+
+llvm::Value *Loop::body() {
+  active.push_back(this);
+  symbols.push();
+  llvm::Value *body = block->generate();
+  symbols.pop();
+  active.pop_back();
+  if (!terminates(body)) {
+    builder.CreateBr(latch);
+  }
+  ssa.seal(latch);
+  return body;
+}
+
 WhileStatement::WhileStatement(Token token, expr_ptr condition_,
                                stmt_ptr block_)
-    : Statement(std::move(token)), condition(std::move(condition_)),
-      block(std::move(block_)) {}
+    : Loop(std::move(token), std::move(block_)),
+      condition(std::move(condition_)), expected(Expectation::NONE),
+      site(nullptr), start(nullptr), iterations(nullptr) {}
+
+void WhileStatement::leave() {
+  if (site) {
+    Profiler::loop(site, builder.CreateLoad(intType, iterations), start);
+  }
+}
 
 llvm::Value *WhileStatement::generate() {
+  llvm::MDNode *hints = metadata();
   llvm::Function *func = builder.GetInsertBlock()->getParent();
+  site = nullptr;
+  if (Profiler::enabled) {
+    site = Profiler::site(func, token.line, true);
+    llvm::BasicBlock &entry = func->getEntryBlock();
+    llvm::IRBuilder<> allocaBuilder(&entry, entry.begin());
+    iterations = allocaBuilder.CreateAlloca(intType);
+    builder.CreateStore(INT_ZERO, iterations);
+    start = Profiler::cycles();
+  }
   llvm::BasicBlock *preCond = llvm::BasicBlock::Create(context, "", func);
   builder.CreateBr(preCond);
   builder.SetInsertPoint(preCond);
@@ -63,32 +328,537 @@ llvm::Value *WhileStatement::generate() {
   cond = builder.CreateICmpNE(cond,
                               llvm::ConstantInt::get(context, llvm::APInt()));
 
-  llvm::BasicBlock *loop = llvm::BasicBlock::Create(context, "", func),
-                   *cont = llvm::BasicBlock::Create(context);
+  llvm::BasicBlock *loop = llvm::BasicBlock::Create(context, "", func);
+  latch = llvm::BasicBlock::Create(context);
+  exit = llvm::BasicBlock::Create(context);
 
-  builder.CreateCondBr(cond, loop, cont);
+  branch(cond, loop, exit, expected);
+  ssa.seal(loop);
   builder.SetInsertPoint(loop);
+  if (site) {
+    builder.CreateStore(
+        builder.CreateAdd(builder.CreateLoad(intType, iterations),
+                          llvm::ConstantInt::get(intType, 1)),
+        iterations);
+  }
+  body();
+
+  // Continue statements and the end of the body share a single back edge
+  func->getBasicBlockList().push_back(latch);
+  builder.SetInsertPoint(latch);
+  builder.CreateBr(preCond)->setMetadata(llvm::LLVMContext::MD_loop, hints);
+  // The condition block is complete once the loop jumps back to it
+  ssa.seal(preCond);
+  ssa.seal(exit);
+
+  func->getBasicBlockList().push_back(exit);
+  builder.SetInsertPoint(exit);
+  leave();
+
+  return TRUE;
+}
+
+ForStatement::ForStatement(Token token, id_ptr counter_, expr_ptr start_,
+                           expr_ptr end_, int64_t step_, stmt_ptr block_)
+    : Loop(std::move(token), std::move(block_)), counter(std::move(counter_)),
+      start(std::move(start_)), end(std::move(end_)), step(step_),
+      from(nullptr), to(nullptr), induction(nullptr) {}
+
+/**
+ * The loop is generated in rotated form: a guard skips it if it runs zero
+ * times, then the body is followed by the exit test and the increment.
+ * The test counts increments up to the distance between the bounds divided
+ * by the step, computed unsigned before the loop, so the counter is never
+ * incremented past the end bound, even one near the limits of an int.
+ **/
+llvm::Value *ForStatement::generate() {
+  llvm::Value *first = start->generate(), *last = end->generate();
+  // The counter is an int, int32 bounds are widened to it
+  if (first->getType() == int32Type) {
+    first = expand(first, intType);
+  }
+  if (last->getType() == int32Type) {
+    last = expand(last, intType);
+  }
+  if (first->getType() != intType || last->getType() != intType) {
+    error("Bounds of a for loop must be integers", token.line);
+  }
+  if (parallel) {
+    return outline(first, last);
+  }
+  llvm::MDNode *hints = metadata();
+  auto inRange = [&](llvm::Value *value) {
+    return step > 0 ? builder.CreateICmpSLE(value, last)
+                    : builder.CreateICmpSGE(value, last);
+  };
+
+  llvm::Function *func = builder.GetInsertBlock()->getParent();
+  llvm::BasicBlock *loop = llvm::BasicBlock::Create(context, "", func);
+  latch = llvm::BasicBlock::Create(context);
+  exit = llvm::BasicBlock::Create(context);
+
+  const std::string name = counter->token.getString();
+  size_t variable = ssa.add(intType), increments = ssa.add(intType);
+  ssa.write(variable, builder.GetInsertBlock(), first);
+  ssa.write(increments, builder.GetInsertBlock(), INT_ZERO);
+  llvm::Value *trips = tripCount(first, last);
+  builder.CreateCondBr(inRange(first), loop, exit);
+  builder.SetInsertPoint(loop);
+  from = first;
+  to = last;
+  induction = ssa.read(variable, loop);
 
   symbols.push();
-  llvm::Value *body = block->generate();
+  auto symbol = std::make_unique<Identifier>(counter->token, TypeID::INT,
+                                             nullptr, true);
+  symbol->variable = variable;
+  symbols.add(name, std::move(symbol));
+  body();
   symbols.pop();
 
-  if (llvm::dyn_cast<llvm::ReturnInst>(body) == nullptr) {
-    builder.CreateBr(preCond);
+  func->getBasicBlockList().push_back(latch);
+  builder.SetInsertPoint(latch);
+  llvm::Value *done = ssa.read(increments, latch);
+  ssa.write(variable, latch,
+            builder.CreateNSWAdd(ssa.read(variable, latch),
+                                 llvm::ConstantInt::get(intType, step)));
+  ssa.write(increments, latch,
+            builder.CreateAdd(done, llvm::ConstantInt::get(intType, 1)));
+  builder.CreateCondBr(builder.CreateICmpNE(done, trips), loop, exit)
+      ->setMetadata(llvm::LLVMContext::MD_loop, hints);
+  ssa.seal(loop);
+  ssa.seal(exit);
+
+  func->getBasicBlockList().push_back(exit);
+  builder.SetInsertPoint(exit);
+
+  return TRUE;
+}
+
+llvm::Value *ForStatement::tripCount(llvm::Value *first, llvm::Value *last) {
+  llvm::Value *distance = step > 0 ? builder.CreateSub(last, first)
+                                   : builder.CreateSub(first, last);
+  if (std::abs(step) == 1) {
+    return distance;
   }
+  return builder.CreateUDiv(distance,
+                            llvm::ConstantInt::get(intType, std::abs(step)));
+}
 
-  func->getBasicBlockList().push_back(cont);
-  builder.SetInsertPoint(cont);
+namespace {
+struct ReductionInfo {
+  size_t variable;
+  llvm::Type *type;
+  int32_t op;
+  llvm::Value *shared;
+};
 
+// Neutral element of the operator, the initial value of private copies
+llvm::Value *identity(llvm::Type *type, int32_t op) {
+  if (type == Node::intType) {
+    switch (op) {
+    case PS_ADD:
+      return Node::INT_ZERO;
+    case PS_MUL:
+      return llvm::ConstantInt::get(type, 1);
+    case PS_MIN:
+      return llvm::ConstantInt::get(type, INT64_MAX);
+    default:
+      return llvm::ConstantInt::get(type, INT64_MIN);
+    }
+  }
+  llvm::Constant *re = Node::DOUBLE_ZERO;
+  if (op == PS_MUL) {
+    re = llvm::ConstantFP::get(Node::doubleType, 1.0);
+  } else if (op != PS_ADD) {
+    re = llvm::ConstantFP::getInfinity(Node::doubleType, op == PS_MAX);
+  }
+  if (type == Node::doubleType) {
+    return re;
+  }
+  return llvm::ConstantStruct::get(Node::complexStruct,
+                                   {re, Node::DOUBLE_ZERO});
+}
+} // namespace
+
+llvm::Value *ForStatement::outline(llvm::Value *first, llvm::Value *last) {
+  // Locals are captured by value, results of spawns would be missing
+  if (!SpawnStatement::pending.empty()) {
+    error("Cannot start a parallel loop before sync", token.line);
+  }
+  int64_t chunk = 0;
+  for (auto &annotation : annotations) {
+    if (annotation.token.getString() == "dynamic") {
+      if (annotation.arguments.size() != 1 || annotation.arguments[0] < 1) {
+        error("Annotation @dynamic expects one positive argument",
+              annotation.token.line);
+      }
+      chunk = annotation.arguments[0];
+    }
+  }
+  llvm::MDNode *hints = metadata();
+
+  /**
+   * Iterations are numbered from 0, the body computes the counter. The
+   * runtime takes a signed number of iterations, so loops of more than
+   * INT64_MAX of them are not supported.
+   **/
+  llvm::Value *iterations = builder.CreateSelect(
+      step > 0 ? builder.CreateICmpSLE(first, last)
+               : builder.CreateICmpSGE(first, last),
+      builder.CreateAdd(tripCount(first, last),
+                        llvm::ConstantInt::get(intType, 1)),
+      INT_ZERO);
+
+  llvm::BasicBlock *block = builder.GetInsertBlock();
+  llvm::Function *caller = block->getParent();
+  llvm::IRBuilder<> allocaBuilder(&caller->getEntryBlock(),
+                                  caller->getEntryBlock().begin());
+
+  std::vector<ReductionInfo> shared;
+  std::vector<llvm::Value *> slots;
+  std::unordered_map<std::string, size_t> reduced;
+  for (auto &reduction : reductions) {
+    const std::string name = reduction.second->token.getString();
+    Identifier *id = getSymbol(name);
+    llvm::Type *type = getType(id->type);
+    Token &op = reduction.first;
+    if (id->alloc || id->constant ||
+        (type != intType && type != doubleType && type != complexStruct)) {
+      error("Reduction variable " + name +
+                " must be a local variable of type int, double or complex",
+            op.line);
+    }
+    int32_t code = op.tag == Tag::PLUS    ? PS_ADD
+                   : op.tag == Tag::TIMES ? PS_MUL
+                   : op.getString() == "min" ? PS_MIN
+                                             : PS_MAX;
+    if (type == complexStruct && code != PS_ADD && code != PS_MUL) {
+      error("Complex reduction variable " + name + " can only be added to "
+                                                    "or multiplied",
+            op.line);
+    }
+    if (!reduced.insert({name, shared.size()}).second) {
+      error("Variable " + name + " is reduced twice", op.line);
+    }
+    llvm::Value *slot = allocaBuilder.CreateAlloca(type);
+    builder.CreateStore(ssa.read(id->variable, block), slot);
+    shared.push_back({id->variable, type, code, slot});
+    slots.push_back(slot);
+  }
+
+  /**
+   * The context holds the start, captured locals and shared reductions.
+   * Locals with constant values are not stored, the body uses them directly.
+   **/
+  std::vector<std::pair<Identifier *, std::vector<llvm::Value *>>> captured;
+  std::vector<llvm::Type *> fields{intType};
+  std::vector<llvm::Value *> values{first};
+  for (auto &local : symbols.locals()) {
+    Identifier *id = local.second;
+    if (reduced.count(local.first)) {
+      continue;
+    }
+    // An array of structs with the SoA layout is a pointer to each field
+    std::vector<llvm::Value *> pointers = id->columns;
+    if (pointers.empty()) {
+      pointers.push_back(id->alloc ? id->alloc
+                                   : ssa.read(id->variable, block));
+    }
+    captured.emplace_back(id, std::vector<llvm::Value *>());
+    for (llvm::Value *value : pointers) {
+      if (llvm::isa<llvm::Constant>(value)) {
+        captured.back().second.push_back(value);
+        continue;
+      }
+      captured.back().second.push_back(nullptr);
+      fields.push_back(value->getType());
+      values.push_back(value);
+    }
+    if (id->length && !llvm::isa<llvm::Constant>(id->length)) {
+      fields.push_back(intType);
+      values.push_back(id->length);
+    }
+  }
+  for (auto &reduction : shared) {
+    fields.push_back(reduction.shared->getType());
+    values.push_back(reduction.shared);
+  }
+  llvm::StructType *contextType = llvm::StructType::get(context, fields);
+  llvm::Value *data = allocaBuilder.CreateAlloca(contextType);
+  for (unsigned i = 0; i < values.size(); ++i) {
+    builder.CreateStore(values[i],
+                        builder.CreateStructGEP(contextType, data, i));
+  }
+
+  llvm::Type *voidPtr = builder.getInt8PtrTy();
+  llvm::Function *func = llvm::Function::Create(
+      llvm::FunctionType::get(builder.getVoidTy(),
+                              {voidPtr, intType, intType}, false),
+      llvm::Function::InternalLinkage, caller->getName() + ".parallel",
+      module.get());
+  {
+    llvm::IRBuilderBase::InsertPointGuard guard(builder);
+    SSABuilder outer = std::move(ssa);
+    ssa.clear();
+    std::vector<Loop *> loops = std::move(active);
+    active.clear();
+    const size_t scope = SpawnStatement::scope;
+    llvm::Value *spawnFrame = SpawnStatement::frame;
+    SpawnStatement::scope = 0;
+    SpawnStatement::frame = nullptr;
+    std::vector<llvm::AllocaInst *> heap = std::move(ArrayDefinition::heap);
+    ArrayDefinition::heap.clear();
+
+    llvm::BasicBlock *entry = llvm::BasicBlock::Create(context, "", func);
+    builder.SetInsertPoint(entry);
+    ssa.seal(entry);
+    llvm::Value *frame =
+        builder.CreateBitCast(func->getArg(0), contextType->getPointerTo());
+    auto field = [&](unsigned i) {
+      return builder.CreateLoad(fields[i],
+                                builder.CreateStructGEP(contextType, frame, i));
+    };
+
+    symbols.push();
+    llvm::Value *begin = field(0);
+    unsigned index = 1;
+    for (auto &local : captured) {
+      Identifier *id = local.first;
+      std::vector<llvm::Value *> pointers;
+      for (llvm::Value *value : local.second) {
+        pointers.push_back(value ? value : field(index++));
+      }
+      auto symbol = std::make_unique<Identifier>(
+          id->token, id->type, id->columns.empty() ? pointers[0] : nullptr,
+          true);
+      symbol->captured = true;
+      symbol->record = id->record;
+      if (!id->columns.empty()) {
+        symbol->columns = std::move(pointers);
+      }
+      if (id->length) {
+        symbol->constant = id->constant;
+        symbol->length = llvm::isa<llvm::Constant>(id->length)
+                             ? id->length
+                             : field(index++);
+      }
+      symbols.add(id->token.getString(), std::move(symbol));
+    }
+    std::vector<size_t> privates;
+    for (unsigned i = 0; i < shared.size(); ++i) {
+      shared[i].shared = field(index++);
+      privates.push_back(ssa.add(shared[i].type));
+      ssa.write(privates.back(), entry,
+                identity(shared[i].type, shared[i].op));
+      Identifier *id = reductions[i].second.get();
+      auto symbol = std::make_unique<Identifier>(
+          id->token, getSymbol(id->token.getString())->type);
+      symbol->variable = privates.back();
+      symbols.add(id->token.getString(), std::move(symbol));
+    }
+
+    llvm::Value *lo = func->getArg(1), *hi = func->getArg(2);
+    llvm::BasicBlock *loop = llvm::BasicBlock::Create(context, "", func);
+    latch = llvm::BasicBlock::Create(context);
+    exit = llvm::BasicBlock::Create(context);
+    size_t iteration = ssa.add(intType);
+    ssa.write(iteration, entry, lo);
+    builder.CreateCondBr(builder.CreateICmpSLT(lo, hi), loop, exit);
+
+    // The product may exceed an int when the sum does not, so both wrap
+    builder.SetInsertPoint(loop);
+    llvm::Value *i = builder.CreateAdd(
+        begin, builder.CreateMul(ssa.read(iteration, loop),
+                                 llvm::ConstantInt::get(intType, step)));
+    symbols.push();
+    symbols.add(counter->token.getString(),
+                std::make_unique<Identifier>(counter->token, TypeID::INT, i,
+                                             true));
+    body();
+    symbols.pop();
+
+    func->getBasicBlockList().push_back(latch);
+    builder.SetInsertPoint(latch);
+    llvm::Value *next = builder.CreateNSWAdd(
+        ssa.read(iteration, latch), llvm::ConstantInt::get(intType, 1));
+    ssa.write(iteration, latch, next);
+    builder.CreateCondBr(builder.CreateICmpSLT(next, hi), loop, exit)
+        ->setMetadata(llvm::LLVMContext::MD_loop, hints);
+    ssa.seal(loop);
+    ssa.seal(exit);
+
+    func->getBasicBlockList().push_back(exit);
+    builder.SetInsertPoint(exit);
+    for (unsigned j = 0; j < shared.size(); ++j) {
+      llvm::Value *partial = ssa.read(privates[j], exit);
+      llvm::Type *type = shared[j].type;
+      std::vector<llvm::Value *> args{shared[j].shared};
+      std::vector<llvm::Type *> params{type->getPointerTo()};
+      const char *name = "ps_reduce_int";
+      if (type == complexStruct) {
+        auto comp = Complex::getComponents(partial);
+        args.insert(args.end(), {comp.first, comp.second});
+        params = {doubleType->getPointerTo(), doubleType, doubleType};
+        args[0] = builder.CreateBitCast(args[0], params[0]);
+        name = "ps_reduce_complex";
+      } else {
+        args.push_back(partial);
+        params.push_back(type);
+        if (type == doubleType) {
+          name = "ps_reduce_double";
+        }
+      }
+      args.push_back(builder.getInt32(shared[j].op));
+      params.push_back(builder.getInt32Ty());
+      builder.CreateCall(
+          module->getOrInsertFunction(
+              name, llvm::FunctionType::get(builder.getVoidTy(), params,
+                                            false)),
+          args);
+    }
+    ArrayDefinition::release();
+    builder.CreateRetVoid();
+    symbols.pop();
+
+    ssa = std::move(outer);
+    active = std::move(loops);
+    SpawnStatement::scope = scope;
+    SpawnStatement::frame = spawnFrame;
+    ArrayDefinition::heap = std::move(heap);
+  }
+  if (llvm::verifyFunction(*func)) {
+    error("Parallel loop could not be verified", token.line);
+  }
+
+  llvm::FunctionCallee parallelFor = module->getOrInsertFunction(
+      "ps_parallel_for",
+      llvm::FunctionType::get(builder.getVoidTy(),
+                              {func->getType(), voidPtr, intType, intType},
+                              false));
+  builder.CreateCall(parallelFor,
+                     {func, builder.CreateBitCast(data, voidPtr), iterations,
+                      llvm::ConstantInt::get(intType, chunk)});
+  for (unsigned j = 0; j < shared.size(); ++j) {
+    ssa.write(shared[j].variable, builder.GetInsertBlock(),
+              builder.CreateLoad(shared[j].type, slots[j]));
+  }
   return TRUE;
 }
 
+JumpStatement::JumpStatement(Token token) : Statement(std::move(token)) {}
+
+llvm::Value *JumpStatement::generate() {
+  const bool break_ = token.tag == Tag::BREAK;
+  if (Loop::active.empty()) {
+    error(std::string(break_ ? "break" : "continue") + " outside of a loop",
+          token.line);
+  }
+  Loop *loop = Loop::active.back();
+  if (break_ && loop->parallel) {
+    error("Cannot break out of a parallel loop", token.line);
+  }
+  if (!SpawnStatement::pending.empty()) {
+    SpawnStatement::sync(0);
+  }
+  return builder.CreateBr(break_ ? loop->exit : loop->latch);
+}
+
 ReturnStatement::ReturnStatement(Token token, expr_ptr return__)
     : Statement(token), return_(std::move(return__)) {}
 
 llvm::Value *ReturnStatement::generate() {
   llvm::Function *func = builder.GetInsertBlock()->getParent();
-  return builder.CreateRet(expand(return_->generate(), func->getReturnType()));
+  // Only bodies of parallel loops are generated into void functions
+  if (func->getReturnType()->isVoidTy()) {
+    error("Cannot return from a parallel loop", token.line);
+  }
+  llvm::Value *value = expand(return_->generate(), func->getReturnType());
+  auto call = llvm::dyn_cast<llvm::CallInst>(value);
+  if (call && (!dynamic_cast<FunctionCall *>(return_.get()) ||
+               dynamic_cast<BuiltinCall *>(return_.get()) ||
+               !tailPosition(call))) {
+    call = nullptr;
+  }
+  // A call folded into a constant needs no frame at all
+  const bool guaranteed = token.tag == Tag::TAILCALL;
+  if (guaranteed && !call && !llvm::isa<llvm::Constant>(value)) {
+    error("Call after tailcall cannot be a tail call", token.line);
+  }
+  if (!SpawnStatement::pending.empty()) {
+    SpawnStatement::sync(SpawnStatement::pending.size());
+  }
+  // Instrumented loops the return leaves end their runs
+  for (auto loop = Loop::active.rbegin(); loop != Loop::active.rend();
+       ++loop) {
+    if (auto whileLoop = dynamic_cast<WhileStatement *>(*loop)) {
+      whileLoop->leave();
+    }
+  }
+
+  // Views are not variables, so they must be passed on unchanged
+  FunctionDefinition *self = symbols.getFunction(func->getName().str());
+  bool loop = call && call->getCalledFunction() == func && self &&
+              self->header;
+  for (unsigned i = 0; loop && i < call->arg_size(); ++i) {
+    loop = !call->getArgOperand(i)->getType()->isPointerTy() ||
+           (call->getArgOperand(i) == func->getArg(i) &&
+            call->getArgOperand(i + 1) == func->getArg(i + 1));
+  }
+  if (loop) {
+    std::vector<llvm::Value *> args(call->arg_begin(), call->arg_end());
+    call->eraseFromParent();
+    auto arg = args.begin();
+    for (auto &param : self->parameters) {
+      if (param->view) {
+        arg += 2;
+        continue;
+      }
+      ssa.write(param->variable, builder.GetInsertBlock(), *arg++);
+    }
+    // Heap arrays stay in their slots, to be freed when they are defined
+    // again or when the function returns
+    return builder.CreateBr(self->header);
+  }
+
+  ArrayDefinition::release();
+  if (Profiler::enabled) {
+    Profiler::exit();
+  }
+  if (call) {
+    if (guaranteed && call->getFunctionType() != func->getFunctionType()) {
+      error("Function " + call->getCalledFunction()->getName().str() +
+                " called with tailcall must have the parameter and result "
+                "types of " +
+                func->getName().str(),
+            token.line);
+    }
+    call->removeFromParent();
+    builder.Insert(call);
+    call->setTailCallKind(guaranteed ? llvm::CallInst::TCK_MustTail
+                                     : llvm::CallInst::TCK_Tail);
+  }
+  return builder.CreateRet(value);
+}
+
+bool ReturnStatement::tailPosition(llvm::CallInst *call) {
+  llvm::Function *callee = call->getCalledFunction();
+  if (call != &builder.GetInsertBlock()->back() || !callee ||
+      callee->isIntrinsic()) {
+    return false;
+  }
+  // The callee cannot use the frame it replaces, so arrays of the caller
+  // cannot be passed to it, only its views and global arrays
+  for (llvm::Value *arg : call->args()) {
+    if (arg->getType()->isPointerTy()) {
+      llvm::Value *array = arg->stripInBoundsOffsets();
+      if (!llvm::isa<llvm::Argument>(array) &&
+          !llvm::isa<llvm::GlobalVariable>(array)) {
+        return false;
+      }
+    }
+  }
+  return true;
 }
 
 Assignment::Assignment(id_ptr identifier_, expr_ptr expression_)
@@ -96,9 +866,9 @@ Assignment::Assignment(id_ptr identifier_, expr_ptr expression_)
       expression(std::move(expression_)) {}
 
 llvm::Value *Assignment::generate() {
-  Identifier *lhs = getSymbol(identifier->token.getString());
+  Identifier *lhs = assignable(identifier->token.getString());
   llvm::Value *rhs = expand(expression->generate(), getType(lhs->type));
-  builder.CreateStore(rhs, lhs->alloc);
+  assign(lhs, rhs);
   return rhs;
 }
 
@@ -113,123 +883,401 @@ llvm::Value *VariableDefinition::generate() {
   }
   llvm::Type *type = getType(identifier->type);
   const std::string name = identifier->token.getString();
-  llvm::Value *alloc;
-  if (func) {
-    llvm::Value *init = expand(expression->generate(), type);
-    alloc = entryBlockAlloca(func, name, type);
-    builder.CreateStore(init, alloc);
-  } else {
-    llvm::Constant *constInit;
-    switch (identifier->type) {
-    case TypeID::INT:
-      constInit = INT_ZERO;
-      break;
-    case TypeID::DOUBLE:
-      constInit = DOUBLE_ZERO;
-      break;
-    case TypeID::COMPLEX:
-      constInit = COMPLEX_ZERO;
-      break;
-    case TypeID::STRING:
-      constInit = STRING_ZERO;
-      break;
-    default:
-      error("Unsupported type of global variable " + name,
-            identifier->token.line);
+  Identifier *previous = symbols.get(name);
+  if (previous && SpawnStatement::isPending(previous)) {
+    error("Variable " + name + " is redefined before sync", token.line);
+  }
+  llvm::Value *alloc = nullptr, *init = nullptr;
+  size_t variable = 0;
+  if (func && identifier->constant) {
+    alloc = interpreter.fold(*expression);
+    if (!alloc) {
+      alloc = expression->generate();
+      if (!llvm::isa<llvm::Constant>(alloc)) {
+        alloc->setName(name);
+      }
+    }
+    alloc = init = expand(alloc, type);
+  } else if (func) {
+    init = expand(expression->generate(), type);
+    if (!init->hasName() && !llvm::isa<llvm::Constant>(init)) {
+      init->setName(name);
     }
+    variable = ssa.add(type);
+    ssa.write(variable, builder.GetInsertBlock(), init);
+  } else {
+    llvm::Constant *constInit = llvm::Constant::getNullValue(type);
     llvm::GlobalVariable *global = new llvm::GlobalVariable(
-        *module, type, false, llvm::GlobalValue::CommonLinkage, constInit,
+        *module, type, false, llvm::GlobalValue::InternalLinkage, constInit,
         name);
-    alloc = global;
-    symbols.addGlobal(global, std::move(expression), identifier->type);
+    alloc = init = global;
+
+    /**
+     * Constant globals are evaluated right away, so that their values can be
+     * used in compile-time evaluation of the following code. Those which
+     * cannot be evaluated yet are initialized with the other globals.
+     **/
+    llvm::Constant *init = nullptr;
+    if (identifier->constant) {
+      auto literal = dynamic_cast<Constant *>(expression.get());
+      if (identifier->type == TypeID::STRING && literal &&
+          literal->type == TypeID::STRING) {
+        init = llvm::cast<llvm::Constant>(literal->generate());
+      } else if (identifier->type != TypeID::STRING) {
+        init = interpreter.initialize(global, *expression, identifier->type,
+                                      false);
+      }
+    }
+    if (init) {
+      init = llvm::cast<llvm::Constant>(expand(init, type));
+    }
+    if (init) {
+      global->setInitializer(init);
+      global->setConstant(true);
+    } else {
+      symbols.addGlobal(global, std::move(expression), identifier->type,
+                        identifier->constant);
+    }
   }
   identifier->alloc = alloc;
-  symbols.add(name, std::move(identifier));
-  return alloc;
+  identifier->variable = variable;
+  auto symbol = std::make_unique<Identifier>(
+      identifier->token, identifier->type, alloc, identifier->constant);
+  symbol->variable = variable;
+  symbols.add(name, std::move(symbol));
+  return init;
 }
 
 FunctionDeclaration::FunctionDeclaration(Token id_, TypeID returnType_,
-                                         std::vector<id_ptr> &params)
-    : Statement(id_), parameters(std::move(params)), returnType(returnType_) {}
+                                         std::vector<id_ptr> &params,
+                                         bool exported_)
+    : Statement(id_), parameters(std::move(params)), returnType(returnType_),
+      exported(exported_) {}
+
+bool FunctionDeclaration::annotated(const std::string &name) const {
+  for (const auto &annotation : annotations) {
+    if (annotation.token.getString() == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+const unsigned FunctionDeclaration::SSE_REGISTERS = 8;
 
 llvm::Value *FunctionDeclaration::generate() {
+  // Calls are generated as if the function is defined later in the module
+  llvm::Function *func = declare(false);
+  if (annotated("memo")) {
+    error("Memo function " + token.getString() + " must have a body",
+          token.line);
+  }
+  symbols.addExternal(token.getString(), this);
+  return func;
+}
+
+void FunctionDeclaration::lower() {
+  llvm::Function *func = module->getFunction(token.getString());
+  if (!func->isDeclaration()) {
+    return;
+  }
+  llvm::Function *external = declare(true);
+  external->takeName(func);
+  if (external->getFunctionType() == func->getFunctionType()) {
+    func->replaceAllUsesWith(external);
+    func->eraseFromParent();
+    return;
+  }
+
+  std::vector<llvm::CallInst *> calls;
+  for (llvm::User *user : func->users()) {
+    calls.push_back(llvm::cast<llvm::CallInst>(user));
+  }
+  for (llvm::CallInst *call : calls) {
+    if (call->isMustTailCall()) {
+      error("Function " + external->getName().str() +
+                " called with tailcall cannot have complex parameters or a "
+                "complex32 result",
+            token.line);
+    }
+    builder.SetInsertPoint(call);
+    std::vector<llvm::Value *> args(call->arg_begin(), call->arg_end());
+    call->replaceAllUsesWith(this->call(args));
+    call->eraseFromParent();
+  }
+  builder.ClearInsertionPoint();
+  func->eraseFromParent();
+}
+
+namespace {
+// Annotations of functions which are attributes of the LLVM function
+const std::unordered_map<std::string, llvm::Attribute::AttrKind> attributes{
+    {"hot", llvm::Attribute::Hot},
+    {"cold", llvm::Attribute::Cold},
+    {"inline", llvm::Attribute::AlwaysInline},
+    {"noinline", llvm::Attribute::NoInline},
+    {"minsize", llvm::Attribute::MinSize}};
+} // namespace
+
+llvm::Function *FunctionDeclaration::declare(bool external) {
   if (token.tag != Tag::ID && token.tag != Tag::MAIN) {
     error("Cannot redefine reserved keyword " + token.getString(), token.line);
   }
 
+  if (symbols.getGeneric(token.getString())) {
+    error("Two functions with the same name: " + token.getString(),
+          token.line);
+  }
+
   if (token.tag == Tag::MAIN &&
       (!parameters.empty() || returnType != TypeID::INT)) {
     error("Invalid main function signature", token.line);
   }
 
   std::vector<llvm::Type *> types;
+  std::vector<unsigned> byval;
+  std::vector<std::pair<unsigned, const Identifier *>> views;
+  unsigned sse = SSE_REGISTERS;
+  inMemory.clear();
   for (const auto &param : parameters) {
-    types.push_back(getType(param->type));
+    llvm::Type *type = getType(param->type);
+    if (param->view) {
+      if (type == stringType) {
+        error("Views of strings are not supported", param->token.line);
+      }
+      views.emplace_back(types.size(), param.get());
+      types.push_back(type->getPointerTo());
+      types.push_back(intType);
+    } else if (external && type == complex32Struct) {
+      // A float _Complex is packed into one SSE register
+      sse -= sse > 0;
+      types.push_back(complex32Vector());
+      inMemory.push_back(false);
+    } else if (!external || type != complexStruct) {
+      if (type->isFPOrFPVectorTy() && sse > 0) {
+        --sse;
+      }
+      types.push_back(type);
+    } else if (sse >= 2) {
+      sse -= 2;
+      types.push_back(doubleType);
+      types.push_back(doubleType);
+      inMemory.push_back(false);
+    } else {
+      byval.push_back(types.size());
+      types.push_back(complexStruct->getPointerTo());
+      inMemory.push_back(true);
+    }
   }
 
   llvm::Type *funcReturnType = getType(returnType);
+  if (external && funcReturnType == complex32Struct) {
+    funcReturnType = complex32Vector();
+  }
   llvm::FunctionType *ft =
       llvm::FunctionType::get(funcReturnType, types, false);
-  return llvm::Function::Create(ft, llvm::Function::ExternalLinkage,
-                                token.getString(), *module);
+  llvm::Function *func = llvm::Function::Create(
+      ft, llvm::Function::ExternalLinkage, token.getString(), *module);
+  for (unsigned arg : byval) {
+    func->addParamAttr(
+        arg, llvm::Attribute::getWithByValType(context, complexStruct));
+    func->addParamAttr(
+        arg, llvm::Attribute::getWithAlignment(context, llvm::Align(8)));
+  }
+  annotate(func);
+  for (auto &view : views) {
+    if (view.second->noalias) {
+      func->addParamAttr(view.first, llvm::Attribute::NoAlias);
+    }
+    if (view.second->constant) {
+      func->addParamAttr(view.first, llvm::Attribute::ReadOnly);
+    }
+  }
+  return func;
+}
+
+void FunctionDeclaration::annotate(llvm::Function *func) {
+  for (auto &conflict : {std::pair{"hot", "cold"}, {"inline", "noinline"},
+                         {"inline", "minsize"}}) {
+    if (annotated(conflict.first) && annotated(conflict.second)) {
+      error("Function " + token.getString() + " cannot be both @" +
+                conflict.first + " and @" + conflict.second,
+            token.line);
+    }
+  }
+
+  for (auto &annotation : annotations) {
+    const std::string name = annotation.token.getString();
+    if (name != "fastmath" && name != "memo" && !attributes.count(name)) {
+      error("Unknown annotation @" + name, annotation.token.line);
+    }
+    if (attributes.count(name) && !annotation.arguments.empty()) {
+      error("Annotation @" + name + " expects no arguments",
+            annotation.token.line);
+    }
+    auto attribute = attributes.find(name);
+    if (attribute != attributes.end()) {
+      func->addFnAttr(attribute->second);
+    }
+  }
+  if (annotated("minsize")) {
+    func->addFnAttr(llvm::Attribute::OptimizeForSize);
+  }
+}
+
+llvm::Value *FunctionDeclaration::call(const std::vector<llvm::Value *> &args) {
+  llvm::Function *func = module->getFunction(token.getString());
+  std::vector<llvm::Value *> lowered;
+  auto memory = inMemory.begin();
+  for (llvm::Value *arg : args) {
+    if (arg->getType() == complex32Struct) {
+      ++memory;
+      auto comp = Complex::getComponents(arg);
+      llvm::Value *packed = llvm::UndefValue::get(complex32Vector());
+      packed = builder.CreateInsertElement(packed, comp.first, uint64_t(0));
+      lowered.push_back(builder.CreateInsertElement(packed, comp.second, 1));
+    } else if (arg->getType() != complexStruct) {
+      lowered.push_back(arg);
+    } else if (*memory++) {
+      // The callee gets its own copy, so the temporary can be reused
+      llvm::BasicBlock &entry =
+          builder.GetInsertBlock()->getParent()->getEntryBlock();
+      llvm::IRBuilder<> allocaBuilder(&entry, entry.begin());
+      llvm::Value *temp = allocaBuilder.CreateAlloca(complexStruct);
+      builder.CreateStore(arg, temp);
+      lowered.push_back(temp);
+    } else {
+      auto comp = Complex::getComponents(arg);
+      lowered.push_back(comp.first);
+      lowered.push_back(comp.second);
+    }
+  }
+  llvm::Value *result = builder.CreateCall(func, lowered);
+  if (result->getType() == complex32Vector()) {
+    return Complex::get(builder.CreateExtractElement(result, uint64_t(0)),
+                        builder.CreateExtractElement(result, 1));
+  }
+  return result;
+}
+
+llvm::Type *FunctionDeclaration::complex32Vector() {
+  return llvm::FixedVectorType::get(floatType, 2);
 }
 
 FunctionDefinition::FunctionDefinition(Token id_, TypeID returnType_,
                                        stmt_ptr block_,
-                                       std::vector<id_ptr> &params)
-    : FunctionDeclaration(std::move(id_), returnType_, params),
-      block(std::move(block_)) {}
+                                       std::vector<id_ptr> &params,
+                                       bool exported_)
+    : FunctionDeclaration(std::move(id_), returnType_, params, exported_),
+      block(std::move(block_)), tailRecursive(false), header(nullptr) {}
 
 llvm::Value *FunctionDefinition::generate() {
   const std::string name = token.getString();
   llvm::Function *func = module->getFunction(name);
   if (!func) {
-    func = static_cast<llvm::Function *>(FunctionDeclaration::generate());
+    func = declare(false);
   } else if (!func->empty()) {
     error("Two functions with the same name: " + name, token.line);
+  } else if (FunctionDeclaration *prototype = symbols.getExternal(name)) {
+    // Exporting either the prototype or the definition exports the function
+    exported = exported || prototype->exported;
+    annotate(func);
   }
+  func->setLinkage(exported || token.tag == Tag::MAIN
+                       ? llvm::Function::ExternalLinkage
+                       : llvm::Function::InternalLinkage);
+
+  symbols.addFunction(name, this);
 
   llvm::BasicBlock *bb = llvm::BasicBlock::Create(context, "", func);
   builder.SetInsertPoint(bb);
+  ssa.clear();
+  ssa.seal(bb);
+  Loop::active.clear();
+  SpawnStatement::pending.clear();
+  SpawnStatement::scope = 0;
+  SpawnStatement::frame = nullptr;
+  ArrayDefinition::heap.clear();
+
+  llvm::FastMathFlags flags = fastMath;
+  if (annotated("fastmath")) {
+    flags.setFast();
+  }
+  builder.setFastMathFlags(flags);
+
+  if (Profiler::enabled) {
+    Profiler::enter(Profiler::site(func, token.line, false));
+  }
 
   symbols.push();
 
-  int i = 0;
-  for (auto &arg : func->args()) {
-    if (i >= parameters.size() ||
-        arg.getType() != getType(parameters[i]->type)) {
+  auto arg = func->arg_begin();
+  for (auto &param : parameters) {
+    llvm::Type *type = getType(param->type);
+    const std::string name = param->token.getString();
+    if (arg == func->arg_end() ||
+        arg->getType() != (param->view ? type->getPointerTo() : type) ||
+        (param->view &&
+         (arg + 1 == func->arg_end() || arg[1].getType() != intType))) {
       error("Mismatch between signatures in definition and declaration of " +
                 func->getName().str(),
-            parameters[i]->token.line);
+            param->token.line);
     }
-    arg.setName(parameters[i]->token.getString());
+    arg->setName(name);
 
-    llvm::AllocaInst *alloc =
-        entryBlockAlloca(func, arg.getName().str(), arg.getType());
-    parameters[i]->alloc = alloc;
-    builder.CreateStore(&arg, alloc);
+    if (param->view) {
+      auto symbol = std::make_unique<Identifier>(param->token, param->type,
+                                                 arg, param->constant);
+      symbol->length = ++arg;
+      symbol->length->setName(name + ".length");
+      symbols.add(name, std::move(symbol));
+      ++arg;
+      continue;
+    }
+    size_t variable = ssa.add(type);
+    ssa.write(variable, bb, arg);
+    param->variable = variable;
 
-    symbols.add(arg.getName().str(), std::move(parameters[i]));
-    ++i;
+    auto symbol = std::make_unique<Identifier>(param->token, param->type);
+    symbol->variable = variable;
+    symbols.add(name, std::move(symbol));
+    ++arg;
   }
-  if (i != parameters.size()) {
+  if (arg != func->arg_end()) {
     error("Mismatch between signatures in definition and declaration of " +
               func->getName().str(),
-          parameters[i]->token.line);
+          token.line);
   }
 
+  // Returned calls of the function itself jump back to the header
+  header = nullptr;
+  if (tailRecursive) {
+    header = llvm::BasicBlock::Create(context, "", func);
+    builder.CreateBr(header);
+    builder.SetInsertPoint(header);
+  }
   llvm::Value *ret = block->generate();
-  if (llvm::dyn_cast<llvm::ReturnInst>(ret) == nullptr) {
+  if (header) {
+    ssa.seal(header);
+  }
+  if (!llvm::isa_and_nonnull<llvm::ReturnInst>(ret) &&
+      !(header && llvm::isa_and_nonnull<llvm::BranchInst>(ret))) {
     error("Function " + token.getString() +
               " does not end with a return statement",
           token.line);
   }
 
   symbols.pop();
+  // Following global variable definitions must not end up in this function
+  builder.ClearInsertionPoint();
+  builder.setFastMathFlags(fastMath);
   if (llvm::verifyFunction(*func)) {
     error("Function " + token.getString() + " could not be verified",
           token.line);
   }
+  if (annotated("memo")) {
+    return memoize(func);
+  }
   return func;
 }
 
@@ -237,18 +1285,25 @@ Sequence::Sequence(Token token, std::vector<stmt_ptr> &statements_)
     : Statement(std::move(token)), statements(std::move(statements_)) {}
 
 llvm::Value *Sequence::generate() {
+  const size_t outer = SpawnStatement::scope;
+  SpawnStatement::scope = SpawnStatement::pending.size();
   llvm::Value *ret = nullptr;
   for (auto &statement : statements) {
     ret = statement->generate();
-    if (dynamic_cast<ReturnStatement *>(statement.get())) {
+    if (terminates(ret)) {
       break;
     }
   }
+  // Calls spawned in the block are synced at its end
+  if (!terminates(ret) &&
+      SpawnStatement::pending.size() > SpawnStatement::scope) {
+    SpawnStatement::sync(SpawnStatement::scope);
+  }
+  SpawnStatement::pending.resize(SpawnStatement::scope);
+  SpawnStatement::scope = outer;
   return ret;
 }
 
-std::vector<global_tuple> SymbolTable::globals_;
-
 SymbolTable::SymbolTable() : tables(1) {}
 
 void SymbolTable::add(const std::string &token, id_ptr id) {
@@ -256,11 +1311,67 @@ void SymbolTable::add(const std::string &token, id_ptr id) {
 }
 
 void SymbolTable::addGlobal(llvm::GlobalVariable *global, expr_ptr init,
-                            TypeID type) {
-  globals_.push_back({global, std::move(init), type});
+                            TypeID type, bool constant) {
+  globals_.push_back({global, std::move(init), type, constant});
+}
+
+const std::vector<global_tuple> &SymbolTable::globals() const {
+  return globals_;
+}
+
+void SymbolTable::addFunction(const std::string &name,
+                              FunctionDefinition *function) {
+  functions[name] = function;
+}
+
+FunctionDefinition *SymbolTable::getFunction(const std::string &name) const {
+  auto function = functions.find(name);
+  return function == functions.end() ? nullptr : function->second;
+}
+
+void SymbolTable::addExternal(const std::string &name,
+                              FunctionDeclaration *function) {
+  if (externals.emplace(name, function).second) {
+    prototypes_.push_back(function);
+  }
+}
+
+FunctionDeclaration *SymbolTable::getExternal(const std::string &name) const {
+  auto function = externals.find(name);
+  return function == externals.end() ? nullptr : function->second;
+}
+
+const std::vector<FunctionDeclaration *> &SymbolTable::prototypes() const {
+  return prototypes_;
+}
+
+void SymbolTable::addStruct(const std::string &name,
+                            StructDefinition *record) {
+  structs[name] = record;
 }
 
-const std::vector<global_tuple> &SymbolTable::globals() { return globals_; }
+StructDefinition *SymbolTable::getStruct(const std::string &name) const {
+  auto record = structs.find(name);
+  return record == structs.end() ? nullptr : record->second;
+}
+
+void SymbolTable::addGeneric(const std::string &name,
+                             GenericFunction *function) {
+  generics[name] = function;
+}
+
+GenericFunction *SymbolTable::getGeneric(const std::string &name) const {
+  auto function = generics.find(name);
+  return function == generics.end() ? nullptr : function->second;
+}
+
+void SymbolTable::addMemo(FunctionDefinition *function) {
+  memos_.push_back(function);
+}
+
+const std::vector<FunctionDefinition *> &SymbolTable::memos() const {
+  return memos_;
+}
 
 Identifier *SymbolTable::get(const std::string &token) const {
   for (auto i = tables.rbegin(); i < tables.rend(); ++i) {
@@ -271,13 +1382,35 @@ Identifier *SymbolTable::get(const std::string &token) const {
   return nullptr;
 }
 
+std::vector<std::pair<std::string, Identifier *>> SymbolTable::locals() const {
+  std::map<std::string, Identifier *> visible;
+  for (auto table = tables.begin() + 1; table < tables.end(); ++table) {
+    for (auto &entry : *table) {
+      visible[entry.first] = entry.second.get();
+    }
+  }
+  return {visible.begin(), visible.end()};
+}
+
+Identifier *SymbolTable::getGlobal(const std::string &token) const {
+  auto &globals = tables.front();
+  return globals.find(token) != globals.end() ? globals.at(token).get()
+                                              : nullptr;
+}
+
 void SymbolTable::push() { tables.emplace_back(); }
 
 void SymbolTable::pop() { tables.pop_back(); }
 
-llvm::AllocaInst *entryBlockAlloca(llvm::Function *func,
-                                   const std::string &name, llvm::Type *type) {
-  llvm::IRBuilder<> builder(&func->getEntryBlock(),
-                            func->getEntryBlock().begin());
-  return builder.CreateAlloca(type, 0, name.c_str());
+void SymbolTable::suspend() {
+  suspended.emplace_back(std::make_move_iterator(tables.begin() + 1),
+                         std::make_move_iterator(tables.end()));
+  tables.resize(1);
+}
+
+void SymbolTable::resume() {
+  tables.insert(tables.end(),
+                std::make_move_iterator(suspended.back().begin()),
+                std::make_move_iterator(suspended.back().end()));
+  suspended.pop_back();
 }
\ No newline at end of file
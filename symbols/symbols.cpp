@@ -17,6 +17,6 @@ int64_t Token::getInt() { return std::get<int64_t>(value); }
 
 double Token::getDouble() { return std::get<double>(value); }
 
-std::string Token::getString() { return std::get<std::string>(value); }
+std::string Token::getString() const { return std::get<std::string>(value); }
 
 TypeID Token::getType() { return std::get<TypeID>(value); }
\ No newline at end of file
@@ -0,0 +1,202 @@
+#include "interpreter.h"
+
+std::vector<SpawnStatement::Pending> SpawnStatement::pending;
+size_t SpawnStatement::scope = 0;
+llvm::Value *SpawnStatement::frame = nullptr;
+
+namespace {
+// Types of ps_frame and ps_task from runtime.h
+llvm::StructType *frameType() {
+  return llvm::StructType::get(Node::context, {Node::intType, Node::intType});
+}
+
+llvm::StructType *taskType() {
+  llvm::Type *voidPtr = Node::builder.getInt8PtrTy();
+  llvm::Type *run =
+      llvm::FunctionType::get(Node::builder.getVoidTy(), {voidPtr}, false)
+          ->getPointerTo();
+  return llvm::StructType::get(Node::context,
+                               {run, voidPtr, frameType()->getPointerTo()});
+}
+} // namespace
+
+SpawnStatement::SpawnStatement(id_ptr identifier_,
+                               std::unique_ptr<FunctionCall> call_,
+                               bool definition_)
+    : Statement(identifier_->token), identifier(std::move(identifier_)),
+      call(std::move(call_)), definition(definition_) {}
+
+bool SpawnStatement::isPending(const Identifier *symbol) {
+  for (auto &spawn : pending) {
+    if (spawn.symbol == symbol) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void SpawnStatement::sync(size_t first) {
+  if (!frame) {
+    return;
+  }
+  llvm::Type *frameType = ::frameType();
+  builder.CreateCall(
+      module->getOrInsertFunction(
+          "ps_sync", llvm::FunctionType::get(builder.getVoidTy(),
+                                             {frameType->getPointerTo()},
+                                             false)),
+      {frame});
+  for (size_t i = first; i < pending.size(); ++i) {
+    Identifier *symbol = pending[i].symbol;
+    llvm::AllocaInst *result = pending[i].result;
+    llvm::Value *value =
+        builder.CreateLoad(result->getAllocatedType(), result);
+    if (symbol->alloc) {
+      builder.CreateStore(value, symbol->alloc);
+    } else {
+      ssa.write(symbol->variable, builder.GetInsertBlock(), value);
+    }
+  }
+}
+
+llvm::Function *SpawnStatement::task(llvm::Function *callee) {
+  const std::string name = callee->getName().str() + ".task";
+  if (llvm::Function *func = module->getFunction(name)) {
+    return func;
+  }
+  llvm::Type *voidPtr = builder.getInt8PtrTy();
+  llvm::Function *func = llvm::Function::Create(
+      llvm::FunctionType::get(builder.getVoidTy(), {voidPtr}, false),
+      llvm::Function::InternalLinkage, name, module.get());
+
+  // The context holds the arguments and a pointer to the result
+  std::vector<llvm::Type *> fields;
+  for (auto &arg : callee->args()) {
+    fields.push_back(arg.getType());
+  }
+  fields.push_back(callee->getReturnType()->getPointerTo());
+  llvm::StructType *contextType = llvm::StructType::get(context, fields);
+
+  llvm::IRBuilderBase::InsertPointGuard guard(builder);
+  builder.SetInsertPoint(llvm::BasicBlock::Create(context, "", func));
+  llvm::Value *data =
+      builder.CreateBitCast(func->getArg(0), contextType->getPointerTo());
+  std::vector<llvm::Value *> args;
+  for (unsigned i = 0; i < fields.size(); ++i) {
+    args.push_back(builder.CreateLoad(
+        fields[i], builder.CreateStructGEP(contextType, data, i)));
+  }
+  llvm::Value *result = args.back();
+  args.pop_back();
+  builder.CreateStore(builder.CreateCall(callee, args), result);
+  builder.CreateRetVoid();
+  return func;
+}
+
+llvm::Value *SpawnStatement::generate() {
+  const std::string name = identifier->token.getString();
+  std::string callee = call->token.getString();
+  llvm::BasicBlock *block = builder.GetInsertBlock();
+  if (!block) {
+    error("Cannot spawn " + callee + "() outside of a function", token.line);
+  }
+  // A generic function is spawned as its instance for the arguments
+  std::vector<llvm::Value *> values;
+  if (GenericFunction *generic = symbols.getGeneric(callee)) {
+    call->instance = call->instantiate(*generic, values);
+    callee = call->instance->token.getString();
+  }
+  llvm::Function *func = module->getFunction(callee);
+  if (!func || !symbols.getFunction(callee)) {
+    error("Only functions defined in the program can be spawned",
+          call->token.line);
+  }
+
+  Identifier *symbol = symbols.get(name);
+  if (symbol && isPending(symbol)) {
+    error("Variable " + name + " is " +
+              (definition ? "redefined" : "assigned") + " before sync",
+          token.line);
+  }
+  if (definition) {
+    llvm::Type *type = getType(identifier->type);
+    auto variable = std::make_unique<Identifier>(identifier->token,
+                                                 identifier->type);
+    variable->variable = ssa.add(type);
+    ssa.write(variable->variable, block, llvm::Constant::getNullValue(type));
+    symbol = variable.get();
+    symbols.add(name, std::move(variable));
+  } else {
+    symbol = getSymbol(name);
+    if (symbol->captured ||
+        (symbol == symbols.getGlobal(name) && Loop::inParallel())) {
+      error("Cannot assign to " + name + " inside of a parallel loop",
+            token.line);
+    }
+    if (symbol->constant) {
+      error("Cannot assign to constant " + name, token.line);
+    }
+  }
+  if (func->getReturnType() != getType(symbol->type)) {
+    error("Result of " + callee + "() does not have the type of " + name,
+          token.line);
+  }
+
+  // Calls with constant arguments are evaluated as usual
+  if (llvm::Constant *folded = interpreter.fold(*call)) {
+    if (symbol->alloc) {
+      builder.CreateStore(folded, symbol->alloc);
+    } else {
+      ssa.write(symbol->variable, block, folded);
+    }
+    return folded;
+  }
+
+  std::vector<llvm::Value *> args =
+      call->generateArguments(symbols.getFunction(callee)->parameters, values);
+
+  // Everything the task uses lives in the caller until the sync
+  llvm::Function *caller = block->getParent();
+  llvm::IRBuilder<> allocaBuilder(&caller->getEntryBlock(),
+                                  caller->getEntryBlock().begin());
+  if (!frame) {
+    frame = allocaBuilder.CreateAlloca(frameType());
+    allocaBuilder.CreateStore(llvm::Constant::getNullValue(frameType()),
+                              frame);
+  }
+  llvm::AllocaInst *result = allocaBuilder.CreateAlloca(func->getReturnType());
+  std::vector<llvm::Type *> fields;
+  for (llvm::Value *arg : args) {
+    fields.push_back(arg->getType());
+  }
+  fields.push_back(result->getType());
+  args.push_back(result);
+  llvm::StructType *contextType = llvm::StructType::get(context, fields);
+  llvm::Value *data = allocaBuilder.CreateAlloca(contextType);
+  for (unsigned i = 0; i < args.size(); ++i) {
+    builder.CreateStore(args[i], builder.CreateStructGEP(contextType, data, i));
+  }
+
+  llvm::StructType *taskType = ::taskType();
+  llvm::Value *taskData = allocaBuilder.CreateAlloca(taskType);
+  builder.CreateStore(task(func),
+                      builder.CreateStructGEP(taskType, taskData, 0));
+  builder.CreateStore(builder.CreateBitCast(data, builder.getInt8PtrTy()),
+                      builder.CreateStructGEP(taskType, taskData, 1));
+  builder.CreateCall(
+      module->getOrInsertFunction(
+          "ps_spawn", llvm::FunctionType::get(
+                          builder.getVoidTy(),
+                          {frame->getType(), taskData->getType()}, false)),
+      {frame, taskData});
+  pending.push_back({symbol, result});
+  return TRUE;
+}
+
+SyncStatement::SyncStatement(Token token) : Statement(std::move(token)) {}
+
+llvm::Value *SyncStatement::generate() {
+  SpawnStatement::sync(SpawnStatement::scope);
+  SpawnStatement::pending.resize(SpawnStatement::scope);
+  return TRUE;
+}